@@ -0,0 +1,50 @@
+//
+// Created by nick on 10/17/26.
+//
+
+#ifndef NEW_J_COMPILER_ARENA_H
+#define NEW_J_COMPILER_ARENA_H
+
+#include <cstddef>
+#include <memory>
+#include <memory_resource>
+#include <new>
+#include <utility>
+#include <vector>
+
+namespace ast {
+
+// Nodes are bump allocated from an arena owned by ast::program,
+// and all of them are released at once when the program is destroyed.
+// Node destructors never run, so a node must not own anything outside of the arena:
+// child lists use ast::list, which allocates from the same arena.
+struct arena_deleter {
+    template<typename T> void operator()(T *) const noexcept {}
+};
+
+template<typename T> using ptr = std::unique_ptr<T, arena_deleter>;
+template<typename T> using list = std::pmr::vector<T>;
+
+class arena final {
+  public:
+    arena() = default;
+
+    arena(const arena &) = delete;
+    arena & operator=(const arena &) = delete;
+
+    template<typename T, typename... Args> [[nodiscard]] ptr<T> make(Args &&... args) {
+        void * memory = resource.allocate(sizeof(T), alignof(T));
+        return ptr<T>{new (memory) T(std::forward<Args>(args)...)};
+    }
+
+    template<typename T> [[nodiscard]] list<T> make_list() { return list<T>{&resource}; }
+
+  private:
+    static constexpr size_t first_block_size = 64 * 1024;
+
+    std::pmr::monotonic_buffer_resource resource{first_block_size};
+};
+
+} // namespace ast
+
+#endif // NEW_J_COMPILER_ARENA_H
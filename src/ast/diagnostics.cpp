@@ -0,0 +1,98 @@
+//
+// Created by nick on 10/17/26.
+//
+
+#include "diagnostics.h"
+
+#include "nodes.h"
+#include "token.h"
+
+#include <iostream>
+
+diagnostic_builder::~diagnostic_builder() {
+    if (sink != nullptr) sink->add({level, where, text->str()});
+}
+
+diagnostics & diagnostics::global() {
+    static diagnostics instance;
+    return instance;
+}
+
+bool diagnostics::shows(severity level) const noexcept {
+    switch (shown) {
+    case verbosity::quiet:
+        return level == severity::error;
+    case verbosity::normal:
+        return level != severity::note;
+    case verbosity::verbose:
+        return true;
+    }
+    return true;
+}
+
+diagnostic_builder diagnostics::report(severity level, std::optional<source_span> where) {
+    if (shows(level)) return {this, level, where};
+
+    if (level == severity::error) {
+        const std::lock_guard guard{lock};
+        errors++;
+    }
+    return {nullptr, level, where};
+}
+
+void diagnostics::add(diagnostic && record) {
+    const std::lock_guard guard{lock};
+    if (record.level == severity::error) errors++;
+
+    pending.push_back(std::move(record));
+    if (pending.size() >= batch_size) print_pending();
+}
+
+void diagnostics::flush() {
+    const std::lock_guard guard{lock};
+    print_pending();
+}
+
+size_t diagnostics::error_count() const {
+    const std::lock_guard guard{lock};
+    return errors;
+}
+
+void diagnostics::print_pending() {
+    if (pending.empty()) return;
+
+    const auto & sources = source_manager::global();
+    std::ostringstream out;
+    for (const auto & [level, where, message] : pending) {
+        if (where.has_value()) {
+            const auto [line, column] = sources.locate(where->file, where->start);
+            out << sources.name(where->file) << ':' << line << ':' << column << ": ";
+        }
+
+        switch (level) {
+        case severity::note:
+            out << "note: ";
+            break;
+        case severity::warning:
+            out << "warning: ";
+            break;
+        case severity::error:
+            out << "error: ";
+            break;
+        }
+        out << message << '\n';
+    }
+    pending.clear();
+
+    std::cerr << out.str() << std::flush;
+}
+
+namespace diag {
+
+source_span span_of(const token & tok) noexcept { return {tok.src(), tok.start(), tok.end()}; }
+
+source_span span_of(const ast::node & node) noexcept {
+    return {node.src(), node.start_pos(), node.end_pos()};
+}
+
+} // namespace diag
@@ -0,0 +1,130 @@
+//
+// Created by nick on 10/17/26.
+//
+
+#ifndef NEW_J_COMPILER_DIAGNOSTICS_H
+#define NEW_J_COMPILER_DIAGNOSTICS_H
+
+#include "node_forward.h"
+#include "source_manager.h"
+
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <vector>
+
+class token;
+
+enum struct severity : uint8_t { note, warning, error };
+
+// How much of what is reported gets printed
+enum struct verbosity : uint8_t {
+    // Only errors, so compiling without any prints nothing
+    quiet,
+    // Warnings and errors
+    normal,
+    // Also notes, which trace what the compiler is doing
+    verbose,
+};
+
+struct source_span {
+    file_id file;
+    size_t start, end;
+};
+
+struct diagnostic {
+    severity level;
+    std::optional<source_span> where;
+    std::string message;
+};
+
+class diagnostics;
+
+// Collects the message of one diagnostic, which is recorded when the builder goes away.
+// If the diagnostic would not be printed, nothing is formatted.
+class diagnostic_builder final {
+  public:
+    diagnostic_builder(diagnostics * sink, severity level, std::optional<source_span> where)
+        : sink{sink}, level{level}, where{where} {
+        if (sink != nullptr) text.emplace();
+    }
+    ~diagnostic_builder();
+
+    diagnostic_builder(const diagnostic_builder &) = delete;
+    diagnostic_builder & operator=(const diagnostic_builder &) = delete;
+
+    template<typename T> diagnostic_builder & operator<<(const T & value) {
+        if (text.has_value()) text.value() << value;
+        return *this;
+    }
+
+  private:
+    // Null if the diagnostic is dropped
+    diagnostics * sink;
+    severity level;
+    std::optional<source_span> where;
+    std::optional<std::ostringstream> text{};
+};
+
+// Keeps what the compiler reports about the input and prints it to stderr in batches.
+// Records keep offsets, the line and column are only looked up once a record is printed.
+// Reporting may happen from several threads at once.
+class diagnostics final {
+  public:
+    // The diagnostics of the whole compiler
+    [[nodiscard]] static diagnostics & global();
+
+    diagnostics() = default;
+
+    diagnostics(const diagnostics &) = delete;
+    diagnostics & operator=(const diagnostics &) = delete;
+
+    // Set before anything is reported
+    void set_verbosity(verbosity level) noexcept { shown = level; }
+    [[nodiscard]] verbosity current_verbosity() const noexcept { return shown; }
+    [[nodiscard]] bool shows(severity level) const noexcept;
+
+    [[nodiscard]] diagnostic_builder report(severity level, std::optional<source_span> where = {});
+    void add(diagnostic && record);
+    // Prints the records kept so far.
+    // Whatever is still kept when the compiler exits is lost, so call this before.
+    void flush();
+
+    // Counted even when they are not printed
+    [[nodiscard]] size_t error_count() const;
+
+  private:
+    // Records kept before printing them all with one write
+    static constexpr size_t batch_size = 64;
+
+    void print_pending();
+
+    verbosity shown = verbosity::normal;
+
+    mutable std::mutex lock{};
+    std::vector<diagnostic> pending{};
+    size_t errors = 0;
+};
+
+namespace diag {
+
+[[nodiscard]] constexpr source_span span_of(source_span span) noexcept { return span; }
+[[nodiscard]] source_span span_of(const token & tok) noexcept;
+[[nodiscard]] source_span span_of(const ast::node & node) noexcept;
+
+// Takes at most one span, token or node that the diagnostic points to
+template<typename... Where> [[nodiscard]] diagnostic_builder error(const Where &... where) {
+    return diagnostics::global().report(severity::error, span_of(where)...);
+}
+template<typename... Where> [[nodiscard]] diagnostic_builder warning(const Where &... where) {
+    return diagnostics::global().report(severity::warning, span_of(where)...);
+}
+template<typename... Where> [[nodiscard]] diagnostic_builder note(const Where &... where) {
+    return diagnostics::global().report(severity::note, span_of(where)...);
+}
+
+} // namespace diag
+
+#endif // NEW_J_COMPILER_DIAGNOSTICS_H
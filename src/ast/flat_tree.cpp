@@ -0,0 +1,162 @@
+//
+// Created by nick on 10/17/26.
+//
+
+#include "flat_tree.h"
+
+namespace ast {
+
+node_ref flat_tree::add(node_type kind, uint8_t detail, size_t start, size_t end, uint32_t lhs,
+                        uint32_t rhs) {
+    kinds.push_back(kind);
+    details.push_back(detail);
+    spans.push_back({static_cast<uint32_t>(start), static_cast<uint32_t>(end)});
+    left.push_back(lhs);
+    right.push_back(rhs);
+    return {static_cast<uint32_t>(kinds.size() - 1)};
+}
+
+uint32_t flat_tree::add_list(const node_ref * first, const node_ref * last) {
+    const auto index = static_cast<uint32_t>(extra.size());
+    extra.push_back(static_cast<uint32_t>(last - first));
+    for (; first != last; ++first) extra.push_back(first->index);
+    return index;
+}
+
+node_range flat_tree::list_at(uint32_t extra_index) const noexcept {
+    const auto * first = extra.data() + extra_index + 1;
+    return {first, first + extra[extra_index]};
+}
+
+bool flat_tree::add_root(node_ref item, symbol name) {
+    if (not index.try_emplace(name, item).second) return false;
+
+    items.push_back(item);
+    return true;
+}
+
+node_ref flat_tree::find(symbol name) const {
+    const auto iter = index.find(name);
+    return iter == index.end() ? node_ref{} : iter->second;
+}
+
+std::string_view flat_tree::text(node_ref node) const {
+    return source_manager::global().text(file, start_pos(node), end_pos(node) - start_pos(node));
+}
+
+symbol flat_tree::identifier(node_ref node) const noexcept {
+    switch (kind(node)) {
+    case node_type::function:
+    case node_type::var_decl:
+        return identifier(lhs(node));
+    case node_type::opt_typed:
+    case node_type::parameter:
+    case node_type::struct_decl:
+        return symbol{left[node.index]};
+    default:
+        return {};
+    }
+}
+
+void flat_builder::start(file_id file) {
+    tree = std::make_unique<flat_tree>(file);
+    scratch.clear();
+}
+
+bool flat_builder::add_item(node_ref item) { return tree->add_root(item, tree->identifier(item)); }
+
+uint32_t flat_builder::commit(pending_list & elements, std::optional<node_ref> prefix) {
+    if (prefix.has_value()) scratch.insert(scratch.begin() + elements.first, prefix.value());
+
+    const auto * first = scratch.data() + elements.first;
+    const auto index = tree->add_list(first, scratch.data() + scratch.size());
+    clear(elements);
+    return index;
+}
+
+void flat_builder::add_param(pending_list &, token && name, token && type) {
+    scratch.push_back(tree->add(node_type::parameter, static_cast<uint8_t>(type.type()),
+                                name.start(), type.end(), static_cast<uint32_t>(name.name()),
+                                type.payload()));
+}
+
+node_ref flat_builder::literal_or_variable(token && val) {
+    return tree->add(node_type::value, static_cast<uint8_t>(val.type()), val.start(), val.end(),
+                     val.payload());
+}
+
+node_ref flat_builder::bin_op(node_ref lhs, operation op, node_ref rhs) {
+    return tree->add(node_type::binary_op, static_cast<uint8_t>(op), tree->start_pos(lhs),
+                     tree->end_pos(rhs), lhs.index, rhs.index);
+}
+
+node_ref flat_builder::func_call(node_ref callee, pending_list && arguments) {
+    // The same span as ast::func_call, which counts the parentheses
+    const auto end = size(arguments) == 0 ? tree->end_pos(callee) + 2
+                                          : tree->end_pos(scratch.back()) + 1;
+    const auto args = commit(arguments);
+    return tree->add(node_type::func_call, 0, tree->start_pos(callee), end, callee.index, args);
+}
+
+node_ref flat_builder::stmt_block(token && start, pending_list && statements, token && end) {
+    const auto stmts = commit(statements);
+    return tree->add(node_type::statement_block, 0, start.start(), end.end(), stmts);
+}
+
+node_ref flat_builder::if_stmt(node_ref condition, node_ref then_block, node_ref else_block) {
+    const node_ref blocks[] = {then_block, else_block};
+    const auto branches = tree->add_list(blocks, blocks + (else_block ? 2 : 1));
+    const auto end = tree->end_pos(else_block ? else_block : then_block);
+    return tree->add(node_type::if_statement, 0, tree->start_pos(condition), end,
+                     condition.index, branches);
+}
+
+node_ref flat_builder::while_loop(node_ref condition, node_ref body) {
+    return tree->add(node_type::while_loop, 0, tree->start_pos(condition), tree->end_pos(body),
+                     condition.index, body.index);
+}
+
+node_ref flat_builder::ret_stmt(token && ret, node_ref value) {
+    if (not value)
+        return tree->add(node_type::return_statement, 0, ret.start(), ret.end(), value.index);
+
+    return tree->add(node_type::return_statement, 0, tree->start_pos(value), tree->end_pos(value),
+                     value.index);
+}
+
+node_ref flat_builder::assign_stmt(node_ref dest, node_ref value_src, operation op) {
+    return tree->add(node_type::assign_statement, static_cast<uint8_t>(op), tree->start_pos(dest),
+                     tree->end_pos(value_src), dest.index, value_src.index);
+}
+
+node_ref flat_builder::opt_typed(token && identifier, std::optional<token> && type) {
+    const auto name = static_cast<uint32_t>(identifier.name());
+    if (not type.has_value())
+        return tree->add(node_type::opt_typed, static_cast<uint8_t>(token_type::EndOfFile),
+                         identifier.start(), identifier.end(), name);
+
+    return tree->add(node_type::opt_typed, static_cast<uint8_t>(type->type()), identifier.start(),
+                     type->end(), name, type->payload());
+}
+
+node_ref flat_builder::var_decl(node_ref name, node_ref value, ast::var_decl::details detail) {
+    return tree->add(node_type::var_decl, static_cast<uint8_t>(detail), tree->start_pos(name),
+                     tree->end_pos(value), name.index, value.index);
+}
+
+node_ref flat_builder::function(token && name, pending_list && parameters,
+                                std::optional<token> && return_type, node_ref body) {
+    const auto typed_name = opt_typed(std::move(name), std::move(return_type));
+    const auto children = commit(parameters, body);
+    return tree->add(node_type::function, 0, tree->start_pos(typed_name), tree->end_pos(body),
+                     typed_name.index, children);
+}
+
+node_ref flat_builder::struct_decl(token && name, pending_list && fields) {
+    const auto end = size(fields) == 0 ? name.end() : tree->end_pos(scratch.back());
+    const auto field_list = commit(fields);
+    return tree->add(node_type::struct_decl, 0, name.start(), end,
+                     static_cast<uint32_t>(name.name()), field_list);
+}
+
+} // namespace ast
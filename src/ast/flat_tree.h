@@ -0,0 +1,217 @@
+//
+// Created by nick on 10/17/26.
+//
+
+#ifndef NEW_J_COMPILER_FLAT_TREE_H
+#define NEW_J_COMPILER_FLAT_TREE_H
+
+#include "nodes.h"
+#include "token.h"
+
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace ast {
+
+// An index into the node arrays of a flat_tree
+struct node_ref {
+    static constexpr uint32_t none = std::numeric_limits<uint32_t>::max();
+
+    uint32_t index = none;
+
+    explicit operator bool() const noexcept { return index != none; }
+};
+
+// A list of children stored in the extra array of a flat_tree
+class node_range {
+  public:
+    class iterator {
+      public:
+        explicit iterator(const uint32_t * pos) : pos{pos} {}
+
+        node_ref operator*() const noexcept { return {*pos}; }
+        iterator & operator++() noexcept {
+            ++pos;
+            return *this;
+        }
+        bool operator!=(const iterator & rhs) const noexcept { return pos != rhs.pos; }
+
+      private:
+        const uint32_t * pos;
+    };
+
+    node_range(const uint32_t * first, const uint32_t * last) : first{first}, last{last} {}
+
+    [[nodiscard]] iterator begin() const noexcept { return iterator{first}; }
+    [[nodiscard]] iterator end() const noexcept { return iterator{last}; }
+    [[nodiscard]] size_t size() const noexcept { return last - first; }
+    [[nodiscard]] bool empty() const noexcept { return first == last; }
+    [[nodiscard]] node_ref operator[](size_t index) const noexcept { return {first[index]}; }
+    [[nodiscard]] node_ref back() const noexcept { return {last[-1]}; }
+
+  private:
+    const uint32_t * first;
+    const uint32_t * last;
+};
+
+// The AST of one file, stored as parallel arrays indexed by node_ref instead of a tree of pointers.
+// Children are always added before their parents, so a pass that does not care about nesting
+// can walk the arrays front to back.
+//
+// What lhs and rhs hold depends on the kind of the node:
+//   value              the token payload, with the token type as detail
+//   binary_op          both operands, with the operation as detail
+//   func_call          the callee and the list of arguments
+//   statement_block    the list of statements
+//   if_statement       the condition and the list holding the then and else blocks
+//   while_loop         the condition and the body
+//   return_statement   the returned value, if there is one
+//   assign_statement   the destination and the source, with the operation as detail
+//   var_decl           the opt_typed name and the value, with var_decl::details as detail
+//   opt_typed          the symbol of the name and the payload of the type,
+//   parameter            with the token type of the type as detail (EndOfFile if there is none)
+//   function           the opt_typed name and the list holding the body and then the parameters
+//   struct_decl        the symbol of the name and the list of fields, stored as parameters
+// Lists live in the extra array as their length followed by their elements.
+class flat_tree final {
+  public:
+    explicit flat_tree(file_id file) : file{file} {}
+
+    node_ref add(node_type kind, uint8_t detail, size_t start, size_t end, uint32_t lhs = 0,
+                 uint32_t rhs = 0);
+    // Returns the index of the list in the extra array
+    uint32_t add_list(const node_ref * first, const node_ref * last);
+
+    // Returns false if a root with the same name was added before
+    bool add_root(node_ref item, symbol name);
+    [[nodiscard]] node_ref find(symbol name) const;
+
+    [[nodiscard]] size_t size() const noexcept { return kinds.size(); }
+    [[nodiscard]] const std::vector<node_ref> & roots() const noexcept { return items; }
+
+    [[nodiscard]] node_type kind(node_ref node) const noexcept { return kinds[node.index]; }
+    [[nodiscard]] uint8_t detail(node_ref node) const noexcept { return details[node.index]; }
+    [[nodiscard]] size_t start_pos(node_ref node) const noexcept {
+        return node ? spans[node.index].start : 0;
+    }
+    [[nodiscard]] size_t end_pos(node_ref node) const noexcept {
+        return node ? spans[node.index].end : 0;
+    }
+    [[nodiscard]] std::string_view text(node_ref node) const;
+
+    // The children of a node, see above for which ones a kind has
+    [[nodiscard]] node_ref lhs(node_ref node) const noexcept { return {left[node.index]}; }
+    [[nodiscard]] node_ref rhs(node_ref node) const noexcept { return {right[node.index]}; }
+    [[nodiscard]] node_range lhs_list(node_ref node) const noexcept {
+        return list_at(left[node.index]);
+    }
+    [[nodiscard]] node_range rhs_list(node_ref node) const noexcept {
+        return list_at(right[node.index]);
+    }
+
+    // The name of a function, var_decl, struct_decl, opt_typed or parameter
+    [[nodiscard]] symbol identifier(node_ref node) const noexcept;
+
+  private:
+    [[nodiscard]] node_range list_at(uint32_t extra_index) const noexcept;
+
+    struct span {
+        uint32_t start, end;
+    };
+
+    file_id file;
+
+    std::vector<node_type> kinds{};
+    std::vector<uint8_t> details{};
+    std::vector<span> spans{};
+    std::vector<uint32_t> left{};
+    std::vector<uint32_t> right{};
+
+    std::vector<uint32_t> extra{};
+
+    // In declaration order
+    std::vector<node_ref> items{};
+    // Looking up a name does not touch the node arrays
+    std::unordered_map<symbol, node_ref> index{};
+};
+
+// Builds a flat_tree for basic_parser.
+// Lists under construction share one scratch stack, which works because the parser
+// always finishes an inner list before it adds to the outer one.
+class flat_builder final {
+  public:
+    using expr = node_ref;
+    using stmt = node_ref;
+    using item = node_ref;
+    using call = node_ref;
+    using decl = node_ref;
+    using typed = node_ref;
+
+    struct pending_list {
+        size_t first;
+    };
+    using params = pending_list;
+    using args = pending_list;
+    using stmts = pending_list;
+    using fields = pending_list;
+
+    using result = std::unique_ptr<flat_tree>;
+
+    // Node indices are only unique within one tree, so there is a single builder
+    static constexpr bool parallel = false;
+
+    void start(file_id file);
+    [[nodiscard]] result finish() { return std::move(tree); }
+
+    [[nodiscard]] pending_list make_list() const noexcept { return {scratch.size()}; }
+    void append(pending_list &, node_ref node) { scratch.push_back(node); }
+    void add_param(pending_list & to, token && name, token && type);
+    void add_field(pending_list & to, token && name, token && type) {
+        add_param(to, std::move(name), std::move(type));
+    }
+    [[nodiscard]] size_t size(const pending_list & elements) const noexcept {
+        return scratch.size() - elements.first;
+    }
+    void clear(pending_list & elements) { scratch.resize(elements.first); }
+
+    [[nodiscard]] symbol identifier(node_ref item) const noexcept {
+        return tree->identifier(item);
+    }
+    [[nodiscard]] bool add_item(node_ref item);
+
+    [[nodiscard]] bool is_block(node_ref node) const noexcept {
+        return node and tree->kind(node) == node_type::statement_block;
+    }
+
+    node_ref literal_or_variable(token && val);
+    node_ref bin_op(node_ref lhs, operation op, node_ref rhs);
+    node_ref func_call(node_ref callee, pending_list && arguments);
+
+    node_ref stmt_block(token && start, pending_list && statements, token && end);
+    node_ref if_stmt(node_ref condition, node_ref then_block, node_ref else_block = {});
+    node_ref while_loop(node_ref condition, node_ref body);
+    node_ref ret_stmt(token && ret, node_ref value = {});
+    node_ref assign_stmt(node_ref dest, node_ref value_src, operation op = operation::assign);
+
+    node_ref opt_typed(token && identifier, std::optional<token> && type = {});
+    node_ref var_decl(node_ref name, node_ref value, ast::var_decl::details detail);
+    node_ref function(token && name, pending_list && parameters,
+                      std::optional<token> && return_type, node_ref body);
+    node_ref struct_decl(token && name, pending_list && fields);
+
+  private:
+    // Moves a finished list from the scratch stack to the extra array
+    uint32_t commit(pending_list & elements, std::optional<node_ref> prefix = {});
+
+    std::unique_ptr<flat_tree> tree{};
+    std::vector<node_ref> scratch{};
+};
+
+} // namespace ast
+
+#endif // NEW_J_COMPILER_FLAT_TREE_H
@@ -0,0 +1,51 @@
+//
+// Created by nick on 10/17/26.
+//
+
+#include "interner.h"
+
+#include "diagnostics.h"
+
+#include <iostream>
+#include <mutex>
+
+interner & interner::global() {
+    static interner instance;
+    return instance;
+}
+
+interner::interner() {
+    // The default constructed symbol
+    [[maybe_unused]] const auto empty = intern({});
+}
+
+symbol interner::intern(std::string_view text) {
+    {
+        const std::shared_lock reader{lock};
+        if (auto iter = ids.find(text); iter != ids.end()) return iter->second;
+    }
+
+    const std::unique_lock writer{lock};
+    // Someone else may have added it between the two locks
+    if (auto iter = ids.find(text); iter != ids.end()) return iter->second;
+
+    const std::string_view stored = storage.emplace_back(text);
+    const auto id = texts.push_back(stored);
+    if (not id.has_value()) {
+        diag::error() << "Too many distinct identifiers";
+        storage.pop_back();
+        return symbol{};
+    }
+
+    ids.emplace(stored, symbol{id.value()});
+    return symbol{id.value()};
+}
+
+std::string_view interner::text(symbol sym) const noexcept {
+    const auto id = static_cast<uint32_t>(sym);
+    if (id >= texts.size()) return {};
+
+    return texts[id];
+}
+
+std::ostream & operator<<(std::ostream & lhs, symbol rhs) { return lhs << text_of(rhs); }
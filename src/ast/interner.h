@@ -0,0 +1,60 @@
+//
+// Created by nick on 10/17/26.
+//
+
+#ifndef NEW_J_COMPILER_INTERNER_H
+#define NEW_J_COMPILER_INTERNER_H
+
+#include "stable_vector.h"
+
+#include <cstdint>
+#include <deque>
+#include <iosfwd>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+// A dense id for an interned string.
+// Two symbols are equal exactly when their strings are, so comparing and hashing them is cheap.
+// The default symbol is the empty string.
+enum struct symbol : uint32_t {};
+
+// Hands out symbols for strings.
+// Interning may happen from several threads at once, and looking up the text of a symbol
+// never takes a lock.
+class interner final {
+  public:
+    // The interner used by the whole compiler
+    [[nodiscard]] static interner & global();
+
+    interner();
+
+    interner(const interner &) = delete;
+    interner & operator=(const interner &) = delete;
+
+    [[nodiscard]] symbol intern(std::string_view text);
+
+    // The returned view stays valid for the lifetime of the interner
+    [[nodiscard]] std::string_view text(symbol sym) const noexcept;
+
+    [[nodiscard]] size_t size() const noexcept { return texts.size(); }
+
+  private:
+    mutable std::shared_mutex lock{};
+    std::unordered_map<std::string_view, symbol> ids{};
+    // A deque never moves its elements, so views into the strings stay valid
+    std::deque<std::string> storage{};
+    stable_vector<std::string_view> texts{};
+};
+
+[[nodiscard]] inline symbol intern(std::string_view text) {
+    return interner::global().intern(text);
+}
+[[nodiscard]] inline std::string_view text_of(symbol sym) noexcept {
+    return interner::global().text(sym);
+}
+
+std::ostream & operator<<(std::ostream & lhs, symbol rhs);
+
+#endif // NEW_J_COMPILER_INTERNER_H
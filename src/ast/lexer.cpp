@@ -4,38 +4,79 @@
 
 #include "lexer.h"
 
+#include "diagnostics.h"
+#include "scan.h"
+
 #include <algorithm>
-#include <fstream>
+#include <array>
 #include <iostream>
+#include <limits>
 #include <map>
-#include <sstream>
+#include <string_view>
 
 namespace {
-std::optional<token_type> keyword(const std::string & identifier) {
-    static std::map<std::string, token_type> keywords;
-    if (keywords.empty()) {
-        keywords.emplace("int32", token_type::Int32);
-        keywords.emplace("int64", token_type::Int64);
-        keywords.emplace("const", token_type::Const);
-        keywords.emplace("func", token_type::Func);
-        keywords.emplace("if", token_type::If);
-        keywords.emplace("else", token_type::Else);
-        keywords.emplace("ret", token_type::Return);
-        keywords.emplace("return", token_type::Return);
-        keywords.emplace("or", token_type::Boolean_Or);
-        keywords.emplace("let", token_type::Let);
-        keywords.emplace("while", token_type::While);
-    }
 
-    for (const auto & entry : keywords) {
-        if (std::equal(
-                entry.first.begin(), entry.first.end(), identifier.begin(), identifier.end(),
-                [](const auto & lhs, const auto & rhs) { return tolower(lhs) == tolower(rhs); })) {
-            return entry.second;
-        }
-    }
+constexpr char to_lower(char c) noexcept { return (c >= 'A' and c <= 'Z') ? c - 'A' + 'a' : c; }
+
+struct keyword_entry {
+    std::string_view text;
+    token_type type;
+};
+
+// Keywords are matched case insensitively
+constexpr std::array keywords{
+    keyword_entry{"int32", token_type::Int32},  keyword_entry{"int64", token_type::Int64},
+    keyword_entry{"const", token_type::Const},  keyword_entry{"func", token_type::Func},
+    keyword_entry{"if", token_type::If},        keyword_entry{"else", token_type::Else},
+    keyword_entry{"ret", token_type::Return},   keyword_entry{"return", token_type::Return},
+    keyword_entry{"or", token_type::Boolean_Or}, keyword_entry{"let", token_type::Let},
+    keyword_entry{"while", token_type::While},
+};
+
+constexpr size_t keyword_table_size = 16;
+
+// A perfect hash for the keywords above.
+// If a new keyword collides, the static_assert below fails and the constants need changing.
+constexpr size_t keyword_hash(std::string_view word) noexcept {
+    return (word.size() + 5u * to_lower(word.front()) + 4u * to_lower(word.back()))
+           % keyword_table_size;
+}
+
+constexpr auto keyword_table = [] {
+    std::array<keyword_entry, keyword_table_size> table{};
+    for (const auto & entry : keywords) table[keyword_hash(entry.text)] = entry;
+    return table;
+}();
 
-    return {};
+constexpr bool keyword_hash_is_perfect() {
+    for (const auto & entry : keywords)
+        if (keyword_table[keyword_hash(entry.text)].text != entry.text) return false;
+    return true;
+}
+static_assert(keyword_hash_is_perfect(), "Two keywords share a slot in keyword_table");
+
+constexpr auto shortest_keyword = [] {
+    auto shortest = keywords.front().text.size();
+    for (const auto & entry : keywords) shortest = std::min(shortest, entry.text.size());
+    return shortest;
+}();
+
+constexpr auto longest_keyword = [] {
+    auto longest = keywords.front().text.size();
+    for (const auto & entry : keywords) longest = std::max(longest, entry.text.size());
+    return longest;
+}();
+
+std::optional<token_type> keyword(std::string_view identifier) {
+    if (identifier.size() < shortest_keyword or identifier.size() > longest_keyword) return {};
+
+    const auto & candidate = keyword_table[keyword_hash(identifier)];
+    if (candidate.text.size() != identifier.size()) return {};
+
+    for (size_t i = 0; i < identifier.size(); i++)
+        if (to_lower(identifier[i]) != candidate.text[i]) return {};
+
+    return candidate.type;
 }
 
 std::optional<token_type> punctuation(char symbol) {
@@ -60,6 +101,24 @@ std::optional<token_type> punctuation(char symbol) {
 
 } // namespace
 
+file_id lexer::source() {
+    // Check if we have to open a file
+    if (std::holds_alternative<std::string>(this->src)) {
+        auto & sources = source_manager::global();
+        const auto filename = std::get<std::string>(this->src);
+        auto file = sources.open(filename);
+        if (not file.has_value()) {
+            diag::error() << "Could not open " << filename;
+            file = sources.add(filename, source_buffer::from_string({}));
+        }
+
+        this->src = file.value();
+        this->input_text = &sources.buffer(file.value());
+    }
+
+    return std::get<file_id>(this->src);
+}
+
 token lexer::next() {
 
     // If we have previously peeked, just return the peeked item.
@@ -70,45 +129,59 @@ token lexer::next() {
     }
 
     // Now we actually need to parse something
-    // Check if we have to open a file
-    if (std::holds_alternative<std::string>(this->src)) {
-        // Open the file
-        const auto filename = std::get<std::string>(this->src);
-        std::stringstream stream;
-        {
-            std::ifstream file{filename};
-            std::string temp;
-            while (std::getline(file, temp)) stream << temp << '\n';
-        }
+    const auto found = scan_next();
+    return {source(), found.pos, found.len, found.type, found.payload};
+}
+
+token_buffer lexer::tokenize() {
+    token_buffer tokens{source()};
+
+    if (peeked.has_value()) {
+        tokens.push_back(peeked->type(), peeked->start(), peeked->end() - peeked->start(),
+                         peeked->payload());
+        peeked.reset();
+    }
 
-        // Store the data
-        this->src = std::make_shared<std::string>(stream.str());
+    while (tokens.empty() or tokens.back_type() != token_type::EndOfFile) {
+        const auto found = scan_next();
+        tokens.push_back(found.type, found.pos, found.len, found.payload);
     }
 
-    const auto & input_text = std::get<std::shared_ptr<std::string>>(this->src);
+    return tokens;
+}
+
+lexer::lexeme lexer::scan_next() {
+
+    // The text always ends in a '\0' sentinel, so reading at current_pos needs no bounds check
+    // as long as current_pos has not passed the end.
+    source();
+
+    // Tokens keep 32 bit offsets, so larger files are reported once and read as if empty
+    if (input_text->size() > std::numeric_limits<uint32_t>::max()) {
+        if (current_pos != input_text->size()) {
+            diag::error() << source_manager::global().name(std::get<file_id>(src))
+                          << ": Source files larger than 4 GiB are not supported";
+            current_pos = input_text->size();
+        }
+        return {0, 0, token_type::EndOfFile};
+    }
 
     {
         // The following two lambdas help preprocess the input
         // by removing non-newline whitespace and comments.
         // They are scoped to decrease name pollution and possibly help the compiler
         // (mostly to help humans)
-        const auto consume_whitespace = [&input_text, this] {
+        const auto consume_whitespace = [this] {
             const auto start = current_pos;
-            while (current_pos < input_text->size()
-                   and (input_text->at(current_pos) == ' ' or input_text->at(current_pos) == '\t'))
-                current_pos++;
-
+            current_pos = scan::skip_blanks(input_text->text(), current_pos);
             return start != current_pos;
         };
 
-        const auto consume_comment = [&input_text, this] {
+        const auto consume_comment = [this] {
             const auto start = current_pos;
-            if (current_pos < input_text->size() and input_text->at(current_pos) == '#') {
-                while (current_pos < input_text->size() and input_text->at(current_pos) != '\n')
-                    ++current_pos;
+            if (current_pos < input_text->size() and (*input_text)[current_pos] == '#')
+                current_pos = scan::line_end(input_text->text(), current_pos) + 1;
 
-                ++current_pos;
-            }
             return start != current_pos;
         };
 
@@ -116,65 +189,65 @@ token lexer::next() {
     }
 
     if (current_pos >= input_text->size())
-        return {input_text, input_text->size() - 1, 1, token_type::EndOfFile};
+        return {input_text->size(), 0, token_type::EndOfFile};
 
-    auto current_char = input_text->at(current_pos);
+    auto current_char = (*input_text)[current_pos];
 
     const auto start = current_pos;
     current_pos++;
 
     if (isalpha(current_char)) {
-        while (isalnum(input_text->at(current_pos))) current_pos++;
+        current_pos = scan::identifier_end(input_text->text(), current_pos);
 
         const auto length = current_pos - start;
 
-        const auto tokentype
-            = keyword(input_text->substr(start, length)).value_or(token_type::Identifier);
+        const auto text = input_text->text().substr(start, length);
+        if (const auto tokentype = keyword(text); tokentype.has_value())
+            return {start, length, tokentype.value()};
 
-        return token{input_text, start, length, tokentype};
+        return {start, length, token_type::Identifier, static_cast<uint32_t>(intern(text))};
 
     } else if (isdigit(current_char)) {
 
         if (current_char == '0') {
-            current_char = input_text->at(current_pos);
+            current_char = (*input_text)[current_pos];
             if (tolower(current_char) == 'x') {
                 // Eat hexadecimal literal
                 current_pos++;
-                while (isxdigit(input_text->at(current_pos))) current_pos++;
+                while (isxdigit((*input_text)[current_pos])) current_pos++;
 
-                return {input_text, start, current_pos - start, token_type::Int};
+                return numeric(start, token_type::Int);
             } else if (tolower(current_char) == 'b') {
                 // Eat binary literal
                 current_pos++;
-                while (input_text->at(current_pos) == '0' or input_text->at(current_pos) == '1')
+                while ((*input_text)[current_pos] == '0' or (*input_text)[current_pos] == '1')
                     current_pos++;
 
-                return {input_text, start, current_pos - start, token_type::Int};
+                return numeric(start, token_type::Int);
             } else if (current_char == '.') {
                 // Eat float literal
                 current_pos++;
-                while (isdigit(input_text->at(current_pos))) current_pos++;
+                current_pos = scan::digits_end(input_text->text(), current_pos);
 
-                return {input_text, start, current_pos - start, token_type::Float};
+                return numeric(start, token_type::Float);
             } else {
                 // Just 0
-                return {input_text, start, 1, token_type::Int};
+                return numeric(start, token_type::Int);
             }
         } else {
             // Does not start on a zero
-            while (isdigit(input_text->at(current_pos))) current_pos++;
+            current_pos = scan::digits_end(input_text->text(), current_pos);
 
             bool is_float = false;
-            if (input_text->at(current_pos) == '.') {
+            if ((*input_text)[current_pos] == '.') {
                 is_float = true;
                 current_pos++;
 
                 // TODO: Remove trailing zeros
-                while (isdigit(input_text->at(current_pos))) current_pos++;
+                current_pos = scan::digits_end(input_text->text(), current_pos);
             }
 
-            return {input_text, start, current_pos - start,
-                    is_float ? token_type::Float : token_type::Int};
+            return numeric(start, is_float ? token_type::Float : token_type::Int);
         }
 
     } else if (current_char == '"') {
@@ -182,8 +255,8 @@ token lexer::next() {
         char last_char = '"';
         bool done = false;
         while (not done) {
-            while (current_pos < input_text->size() and input_text->at(current_pos) != '"') {
-                last_char = input_text->at(current_pos);
+            while (current_pos < input_text->size() and (*input_text)[current_pos] != '"') {
+                last_char = (*input_text)[current_pos];
                 current_pos++;
             }
             if (last_char != '\\') {
@@ -191,80 +264,97 @@ token lexer::next() {
                 done = true;
             }
         }
-        return {input_text, start, current_pos - start, token_type ::StringLiteral};
+        const auto length = current_pos - start;
+        return {start, length, token_type ::StringLiteral,
+                static_cast<uint32_t>(intern(input_text->text().substr(start, length)))};
     } else {
 
         auto possible_token_type = punctuation(current_char);
         if (possible_token_type.has_value())
-            return {input_text, start, 1, possible_token_type.value()};
+            return {start, 1, possible_token_type.value()};
 
         switch (current_char) {
         case '=':
-            if (current_pos >= input_text->size() or input_text->at(current_pos) != current_char)
-                return {input_text, start, 1, token_type ::Assign};
+            if (current_pos >= input_text->size() or (*input_text)[current_pos] != current_char)
+                return {start, 1, token_type ::Assign};
             else {
                 current_pos++;
-                return {input_text, start, 2, token_type::Eq};
+                return {start, 2, token_type::Eq};
             }
         case '|':
-            if (current_pos >= input_text->size() or input_text->at(current_pos) != current_char)
-                return {input_text, start, 1, token_type ::Bit_Or};
+            if (current_pos >= input_text->size() or (*input_text)[current_pos] != current_char)
+                return {start, 1, token_type ::Bit_Or};
             else {
                 current_pos++;
-                return {input_text, start, 2, token_type ::Boolean_Or};
+                return {start, 2, token_type ::Boolean_Or};
             }
         case '<':
             if (current_pos >= input_text->size()
-                or (input_text->at(current_pos) != current_char
-                    and input_text->at(current_pos) != '='))
-                return {input_text, start, 1, token_type ::Lt};
-            else if (input_text->at(current_pos) == current_char) {
+                or ((*input_text)[current_pos] != current_char
+                    and (*input_text)[current_pos] != '='))
+                return {start, 1, token_type ::Lt};
+            else if ((*input_text)[current_pos] == current_char) {
                 current_pos++;
-                return {input_text, start, 2, token_type ::Shl};
+                return {start, 2, token_type ::Shl};
             } else {
                 current_pos++;
-                return {input_text, start, 2, token_type ::Le};
+                return {start, 2, token_type ::Le};
             }
         case '>':
             if (current_pos >= input_text->size()
-                or (input_text->at(current_pos) != current_char
-                    and input_text->at(current_pos) != '=')) {
-                return {input_text, start, 1, token_type::Gt};
-            } else if (input_text->at(current_pos) == current_char) {
+                or ((*input_text)[current_pos] != current_char
+                    and (*input_text)[current_pos] != '=')) {
+                return {start, 1, token_type::Gt};
+            } else if ((*input_text)[current_pos] == current_char) {
                 current_pos++;
-                return {input_text, start, 2, token_type::Shr};
+                return {start, 2, token_type::Shr};
             } else {
                 current_pos++;
-                return {input_text, start, 2, token_type::Ge};
+                return {start, 2, token_type::Ge};
             }
         case '+':
-            if (current_pos >= input_text->size() or input_text->at(current_pos) != '=')
-                return {input_text, start, 1, token_type ::Plus};
+            if (current_pos >= input_text->size() or (*input_text)[current_pos] != '=')
+                return {start, 1, token_type ::Plus};
             else {
                 current_pos++;
-                return {input_text, start, 2, token_type ::Plus_Assign};
+                return {start, 2, token_type ::Plus_Assign};
             }
         case '-':
-            if (current_pos >= input_text->size() or input_text->at(current_pos) != '=')
-                return {input_text, start, 1, token_type ::Minus};
+            if (current_pos >= input_text->size() or (*input_text)[current_pos] != '=')
+                return {start, 1, token_type ::Minus};
             else {
                 current_pos++;
-                return {input_text, start, 2, token_type ::Minus_Assign};
+                return {start, 2, token_type ::Minus_Assign};
             }
         case '*':
-            if (current_pos >= input_text->size() or input_text->at(current_pos) != '=')
-                return {input_text, start, 1, token_type::Mult};
+            if (current_pos >= input_text->size() or (*input_text)[current_pos] != '=')
+                return {start, 1, token_type::Mult};
             else {
                 current_pos++;
-                return {input_text, start, 2, token_type::Mult_Assign};
+                return {start, 2, token_type::Mult_Assign};
             }
         default:
-            std::cerr << "Unrecognized symbol: " << current_char << '\n';
-            return {input_text, start, 1, token_type ::EndOfFile};
+            diag::error(source_span{source(), start, start + 1})
+                << "Unrecognized symbol: " << current_char;
+            return {start, 1, token_type ::EndOfFile};
         }
     }
 }
 
+lexer::lexeme lexer::numeric(size_t start, token_type type) {
+    const auto length = current_pos - start;
+    const auto text = input_text->text().substr(start, length);
+
+    auto & literals = literal_table::global();
+    const auto index
+        = type == token_type::Float ? literals.add_float(text) : literals.add_integer(text);
+    if (literals[index].range == literal_range::overflow)
+        diag::error(source_span{source(), start, current_pos})
+            << "Numeric literal " << text << " does not fit in 64 bits";
+
+    return {start, length, type, index};
+}
+
 token lexer::peek() {
 
     // If there is nothing peeked, we need to read the next token.
@@ -6,17 +6,20 @@
 #define NEW_J_COMPILER_LEXER_H
 
 #include "token.h"
+#include "token_buffer.h"
 
-#include <memory>
 #include <optional>
 #include <string>
 #include <variant>
 
 class lexer final {
-    using src_impl = std::variant<std::string, std::shared_ptr<std::string>>;
+    using src_impl = std::variant<std::string, file_id>;
 
   public:
     explicit lexer(const std::string & filename) : src{filename} {}
+    // Lexes a file that is already open
+    explicit lexer(file_id file)
+        : src{file}, input_text{&source_manager::global().buffer(file)} {}
 
     // Consumes the next token, removing it from the input stream
     [[nodiscard]] token next();
@@ -24,9 +27,27 @@ class lexer final {
     // Generates the next token, but does not remove it from the input stream
     [[nodiscard]] token peek();
 
+    // Lexes the rest of the input at once, up to and including the EndOfFile token
+    [[nodiscard]] token_buffer tokenize();
+
   private:
-    // Stores either the name of a file or the stream of that file
+    struct lexeme {
+        size_t pos;
+        size_t len;
+        token_type type;
+        // See token::payload
+        uint32_t payload = 0;
+    };
+
+    // Opens the file on first use
+    file_id source();
+    lexeme scan_next();
+    // Decodes the numeric literal from start to the current position
+    lexeme numeric(size_t start, token_type type);
+
+    // Stores either the name of a file or the text of that file
     src_impl src;
+    const source_buffer * input_text = nullptr;
 
     size_t current_pos = 0;
 
@@ -0,0 +1,64 @@
+//
+// Created by nick on 10/17/26.
+//
+
+#include "literal_table.h"
+
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+
+literal_table & literal_table::global() {
+    static literal_table table;
+    return table;
+}
+
+literal_table::literal_table() {
+    // Every literal that overflows, and the one used when the table is full
+    [[maybe_unused]] const auto overflowed = literals.push_back({});
+}
+
+template<typename Key>
+uint32_t literal_table::add(std::unordered_map<Key, uint32_t> & indices, Key key,
+                            numeric_literal && literal) {
+    const std::lock_guard guard{lock};
+    if (auto iter = indices.find(key); iter != indices.end()) return iter->second;
+
+    const auto index = literals.push_back(std::move(literal));
+    if (not index.has_value()) return 0;
+    indices.emplace(key, index.value());
+    return index.value();
+}
+
+uint32_t literal_table::add_integer(std::string_view text) {
+    int base = 10;
+    if (text.size() > 2 and text[0] == '0' and (text[1] == 'x' or text[1] == 'X')) base = 16;
+    else if (text.size() > 2 and text[0] == '0' and (text[1] == 'b' or text[1] == 'B'))
+        base = 2;
+    if (base != 10) text.remove_prefix(2);
+
+    // Literals have no sign, and any value above INT64_MAX overflows, whatever the base
+    uint64_t value = 0;
+    if (auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), value, base);
+        error != std::errc{} or end != text.data() + text.size()
+        or value > static_cast<uint64_t>(std::numeric_limits<int64_t>::max()))
+        return 0;
+
+    const auto range = value <= static_cast<uint64_t>(std::numeric_limits<int32_t>::max())
+                           ? literal_range::i32
+                           : literal_range::i64;
+    return add(integers, static_cast<long>(value), {static_cast<long>(value), range});
+}
+
+uint32_t literal_table::add_float(std::string_view text) {
+    double value = 0;
+    if (auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), value);
+        error != std::errc{} or end != text.data() + text.size())
+        return 0;
+
+    uint64_t bits = 0;
+    static_assert(sizeof(bits) == sizeof(value));
+    std::memcpy(&bits, &value, sizeof(bits));
+    return add(floats, bits, {value, literal_range::f64});
+}
@@ -0,0 +1,57 @@
+//
+// Created by nick on 10/17/26.
+//
+
+#ifndef NEW_J_COMPILER_LITERAL_TABLE_H
+#define NEW_J_COMPILER_LITERAL_TABLE_H
+
+#include "stable_vector.h"
+
+#include <cstdint>
+#include <mutex>
+#include <string_view>
+#include <unordered_map>
+#include <variant>
+
+// The smallest type that holds a literal
+enum struct literal_range : uint8_t { i32, i64, f64, overflow };
+
+struct numeric_literal {
+    // Empty if the literal overflowed
+    std::variant<std::monostate, long, double> value{};
+    literal_range range = literal_range::overflow;
+};
+
+// The values of every numeric literal, decoded once by the lexer.
+// Tokens refer to their literal by its index. Index 0 is always an overflowed literal.
+// Each value is stored once, so lexing the same text again does not grow the table.
+class literal_table final {
+  public:
+    // The table used by the whole compiler
+    [[nodiscard]] static literal_table & global();
+
+    literal_table();
+
+    // Handles decimal, 0x hexadecimal and 0b binary integers, and decimal floats.
+    // Returns 0, the overflowed literal, if the text is not a literal that fits in 64 bits
+    // or if the table is full.
+    [[nodiscard]] uint32_t add_integer(std::string_view text);
+    [[nodiscard]] uint32_t add_float(std::string_view text);
+
+    [[nodiscard]] const numeric_literal & operator[](uint32_t index) const noexcept {
+        return literals[index];
+    }
+
+  private:
+    // Returns the index of the literal that is already stored under key, if there is one
+    template<typename Key>
+    uint32_t add(std::unordered_map<Key, uint32_t> & indices, Key key, numeric_literal && literal);
+
+    std::mutex lock{};
+    // By value, floats by their bits
+    std::unordered_map<long, uint32_t> integers{};
+    std::unordered_map<uint64_t, uint32_t> floats{};
+    stable_vector<numeric_literal> literals{};
+};
+
+#endif // NEW_J_COMPILER_LITERAL_TABLE_H
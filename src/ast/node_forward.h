@@ -5,10 +5,12 @@
 #ifndef NEW_J_COMPILER_NODE_FORWARD_H
 #define NEW_J_COMPILER_NODE_FORWARD_H
 
+#include <cstdint>
+
 namespace ast {
 
 // All node types
-enum struct node_type {
+enum struct node_type : uint8_t {
     assign_statement,
     binary_op,
     func_call,
@@ -27,6 +29,7 @@ enum struct node_type {
 enum class operation {
     add,
     assign,
+    bit_or,
     boolean_and,
     boolean_or,
     div,
@@ -36,12 +39,18 @@ enum class operation {
     le,
     lt,
     mult,
+    shl,
+    shr,
     sub,
 };
 
 // Not part of the AST, just a container for it
 class program;
 
+// The same AST stored as arrays, see flat_tree.h
+class flat_tree;
+struct node_ref;
+
 // Base class
 struct node;
 
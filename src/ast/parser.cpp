@@ -4,27 +4,143 @@
 
 #include "parser.h"
 
-#include "nodes.h"
-#include "program.h"
+#include "diagnostics.h"
+#include "stack_guard.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <thread>
+
+template<typename Builder>
+typename Builder::result basic_parser<Builder>::parse_program(unsigned threads) {
+
+    nodes.start(tokens->src());
+
+    if constexpr (Builder::parallel) {
+        if (threads > 1) {
+            const auto slices = split_top_level();
+            std::vector<std::vector<item>> slice_items(slices.size());
+
+            // Each worker takes the next slice nobody has started on,
+            // so a few large items do not leave the other threads idle
+            std::atomic<size_t> next_slice{0};
+            std::vector<std::thread> workers;
+            for (size_t i = 0; i < std::min<size_t>(threads, slices.size()); i++) {
+                workers.emplace_back([&, part = basic_parser{tokens, nodes.worker()}]() mutable {
+                    for (auto index = next_slice++; index < slices.size(); index = next_slice++)
+                        slice_items[index] = part.parse_slice(slices[index]);
+                });
+            }
+            for (auto & worker : workers) worker.join();
 
-#include <iostream>
+            for (auto & items : slice_items)
+                for (auto & next_item : items) add_item(std::move(next_item));
 
-std::unique_ptr<ast::program> parser::parse_program() {
+            return nodes.finish();
+        }
+    }
 
-    ast::program prog{};
     while (not done()) {
         auto next_item = parse_top_level();
-        if (next_item == nullptr) std::cerr << "Could not parse top level item\n";
-        else if (not prog.find(next_item->identifier()))
-            prog.add_item(std::move(next_item));
+        if (not next_item) diag::error() << "Could not parse top level item";
         else
-            std::cerr << "Top Level Item " << next_item->identifier() << " already exists\n";
+            add_item(std::move(next_item));
     }
-    return std::make_unique<ast::program>(std::move(prog));
+
+    return nodes.finish();
+}
+
+template<typename Builder> void basic_parser<Builder>::add_item(item && next_item) {
+    if (const auto name = nodes.identifier(next_item); not nodes.add_item(std::move(next_item)))
+        diag::error() << "Top Level Item " << name << " already exists";
 }
-std::unique_ptr<ast::top_level> parser::parse_top_level() {
 
-    switch (auto next_token_type = lex.peek().type(); next_token_type) {
+template<typename Builder>
+auto basic_parser<Builder>::split_top_level() const -> std::vector<slice> {
+    std::vector<slice> slices;
+    // Where the EndOfFile token is
+    const auto end = tokens->size() - 1;
+    size_t first = 0;
+    // Of braces and parentheses
+    int depth = 0;
+
+    const auto skip_terminators = [this, end](size_t index) {
+        while (index < end) {
+            switch (tokens->type(index)) {
+            case token_type::Comma:
+            case token_type::Newline:
+            case token_type::Semi:
+                index++;
+                continue;
+            default:
+                return index;
+            }
+        }
+        return index;
+    };
+
+    for (size_t i = 0; i < end; i++) {
+        switch (const auto type = tokens->type(i); type) {
+        case token_type::LBrace:
+        case token_type::LParen:
+            depth++;
+            break;
+        case token_type::RBrace:
+        case token_type::RParen:
+            depth = std::max(depth - 1, 0);
+            break;
+        case token_type::Func:
+        case token_type::Const:
+        case token_type::Struct:
+            if (depth != 0) break;
+
+            if (i != first) slices.push_back({first, i});
+            first = i;
+
+            if (type == token_type::Func) {
+                // Skip the header the way parse_function reads it,
+                // so a body that is a single const declaration stays with its function
+                auto body = std::min(i + 2, end);
+                if (body < end and tokens->type(body) == token_type::LParen)
+                    while (body < end and tokens->type(body++) != token_type::RParen) {}
+                if (body < end and tokens->type(body) == token_type::Colon)
+                    body = std::min(body + 2, end);
+
+                body = skip_terminators(body);
+                if (body < end and tokens->type(body) == token_type::Const) i = body;
+                else
+                    i = body - 1;
+            }
+            break;
+        default:
+            break;
+        }
+    }
+
+    if (first < end) slices.push_back({first, end});
+    return slices;
+}
+
+template<typename Builder>
+auto basic_parser<Builder>::parse_slice(slice range) -> std::vector<item> {
+    position = range.first;
+    last = range.last;
+
+    std::vector<item> items;
+    while (not done()) {
+        auto next_item = parse_top_level();
+        if (not next_item) diag::error() << "Could not parse top level item";
+        else
+            items.push_back(std::move(next_item));
+    }
+
+    return items;
+}
+
+template<typename Builder> auto basic_parser<Builder>::parse_top_level() -> item {
+
+    switch (auto next_token_type = peek(); next_token_type) {
     case token_type ::Func:
         return this->parse_function();
     case token_type ::Const:
@@ -32,64 +148,68 @@ std::unique_ptr<ast::top_level> parser::parse_top_level() {
     case token_type ::Struct:
         return this->parse_struct_decl();
     default:
-        std::cerr << "Token " << lex.peek() << " cannot start a top level item\n";
-        return nullptr;
+        diag::error(peek_token()) << "Token " << peek_token().text()
+                                  << " cannot start a top level item";
+        return {};
     }
 }
 
-std::unique_ptr<ast::function> parser::parse_function() {
+template<typename Builder> auto basic_parser<Builder>::parse_function() -> item {
     // The func token is definitely here
     consume();
 
     auto name = consume();
 
     // Generate parameter list
-    std::vector<ast::parameter> params;
-    if (lex.peek().type() == token_type::LParen) { params = parse_params(); }
+    params parameters = nodes.make_list();
+    if (peek() == token_type::LParen) { parameters = parse_params(); }
 
-    std::cout << "Parameters read for function " << name << ": " << params.size() << '\n';
+    diag::note(name) << "Parameters read for function " << name.text() << ": "
+                     << nodes.size(parameters);
 
     std::optional<token> return_type;
-    if (lex.peek().type() == token_type::Colon) {
+    if (peek() == token_type::Colon) {
         consume();
-        return_type = lex.next();
+        return_type = consume();
     }
 
-    return std::make_unique<ast::function>(std::move(name), std::move(params),
-                                           std::move(return_type), parse_statement());
+    return nodes.function(std::move(name), std::move(parameters), std::move(return_type),
+                          parse_statement());
 }
 
-std::unique_ptr<ast::statement> parser::parse_statement() {
-
-    consume_stmt_terminators();
-    switch (lex.peek().type()) {
-    case token_type ::LBrace:
-        return parse_stmt_block();
-    case token_type ::Identifier:
-        return parse_identifier_stmt();
-    case token_type ::If:
-        return parse_if_stmt();
-    case token_type::While:
-        return parse_while_loop();
-    case token_type ::Const:
-        return parse_const_decl(false);
-    case token_type::Let:
-        return parse_let_decl();
-    case token_type ::Return:
-        return parse_return_stmt();
-    default:
-        std::cerr << "Unexpected start of statement " << lex.peek() << '\n';
-        [[fallthrough]];
-    case token_type ::RBrace:
-        return nullptr;
-    }
+template<typename Builder> auto basic_parser<Builder>::parse_statement() -> stmt {
+    // Blocks, ifs and loops hold statements, so this is where statements nest
+    return stack_guard::nested([this]() -> stmt {
+        consume_stmt_terminators();
+        switch (peek()) {
+        case token_type ::LBrace:
+            return parse_stmt_block();
+        case token_type ::Identifier:
+            return parse_identifier_stmt();
+        case token_type ::If:
+            return parse_if_stmt();
+        case token_type::While:
+            return parse_while_loop();
+        case token_type ::Const:
+            return parse_const_decl(false);
+        case token_type::Let:
+            return parse_let_decl();
+        case token_type ::Return:
+            return parse_return_stmt();
+        default:
+            diag::error(peek_token()) << "Unexpected start of statement " << peek_token().text();
+            [[fallthrough]];
+        case token_type ::RBrace:
+            return {};
+        }
+    });
 }
 
-bool parser::consume_stmt_terminators() {
+template<typename Builder> bool basic_parser<Builder>::consume_stmt_terminators() {
 
     bool found_terminators = false;
     while (true) {
-        switch (lex.peek().type()) {
+        switch (peek()) {
         default:
             return found_terminators;
         case token_type::Comma:
@@ -101,240 +221,284 @@ bool parser::consume_stmt_terminators() {
     }
 }
 
-bool parser::done() {
+template<typename Builder> bool basic_parser<Builder>::done() {
     consume_stmt_terminators();
-    return this->lex.peek().type() == token_type::EndOfFile;
+    return peek() == token_type::EndOfFile;
 }
 
-token parser::consume() { return this->lex.next(); }
+template<typename Builder> token basic_parser<Builder>::consume() {
+    auto current = token_at(position);
+    // Never step past the end
+    if (position < last) position++;
+    return current;
+}
 
-std::vector<ast::parameter> parser::parse_params() {
-    if (consume().type() != token_type::LParen) {
-        std::cerr << "Tried to parse parameters without starting parenthesis\n";
-        return {};
-    }
+template<typename Builder>
+token_type basic_parser<Builder>::peek(size_t ahead) const noexcept {
+    const auto index = position + ahead;
+    return index < last ? tokens->type(index) : token_type::EndOfFile;
+}
 
-    std::vector<ast::parameter> params;
+template<typename Builder> token basic_parser<Builder>::peek_token() const {
+    return token_at(position);
+}
+
+template<typename Builder> token basic_parser<Builder>::token_at(size_t index) const {
+    if (index < last) return tokens->at(index);
+
+    // The end of a slice is where the next one starts
+    return {tokens->src(), tokens->at(last).start(), 0, token_type::EndOfFile};
+}
+
+template<typename Builder> auto basic_parser<Builder>::parse_params() -> params {
+    params parameters = nodes.make_list();
+    if (const auto tok = consume(); tok.type() != token_type::LParen) {
+        diag::error(tok) << "Tried to parse parameters without starting parenthesis";
+        return parameters;
+    }
 
     while (true) {
 
         auto name = consume();
         consume(); // colon
         auto type = consume();
-        params.emplace_back(std::move(name), std::move(type));
+        nodes.add_param(parameters, std::move(name), std::move(type));
 
-        if (lex.peek().type() == token_type::RParen) {
+        if (peek() == token_type::RParen) {
             consume();
             break;
-        } else if (lex.peek().type() == token_type::Comma)
+        } else if (peek() == token_type::Comma)
             consume();
         else {
-            std::cerr << "Unexpected token in parameter list " << lex.peek();
-            return {};
+            diag::error(peek_token())
+                << "Unexpected token in parameter list " << peek_token().text();
+            nodes.clear(parameters);
+            return parameters;
         }
     }
 
-    return params;
+    return parameters;
 }
 
-std::unique_ptr<ast::stmt_block> parser::parse_stmt_block() {
-    if (lex.peek().type() != token_type::LBrace) {
-        std::cerr << "Statement blocks always start with {\n";
-        return nullptr;
+template<typename Builder> auto basic_parser<Builder>::parse_stmt_block() -> stmt {
+    if (peek() != token_type::LBrace) {
+        diag::error(peek_token()) << "Statement blocks always start with {";
+        return {};
     }
 
-    ast::stmt_block block{consume()};
-    while (lex.peek().type() != token_type::RBrace) {
-        block.append(parse_statement());
+    auto start = consume();
+    stmts statements = nodes.make_list();
+    while (peek() != token_type::RBrace) {
+        nodes.append(statements, parse_statement());
         consume_stmt_terminators();
     }
 
     // Will be a RBrace
-    block.terminate(consume());
-
-    return std::make_unique<ast::stmt_block>(std::move(block));
+    return nodes.stmt_block(std::move(start), std::move(statements), consume());
 }
 
-std::unique_ptr<ast::statement> parser::parse_identifier_stmt() {
+template<typename Builder> auto basic_parser<Builder>::parse_identifier_stmt() -> stmt {
     auto identifier = consume();
 
-    if (lex.peek().type() == token_type::LParen)
-        return parse_call(std::make_unique<ast::literal_or_variable>(std::move(identifier)));
-    else if (lex.peek().op_assign()) {
-        auto id_expr = std::make_unique<ast::literal_or_variable>(std::move(identifier));
+    if (peek() == token_type::LParen)
+        return parse_call(nodes.literal_or_variable(std::move(identifier)));
+    else if (is_op_assign(peek())) {
+        auto id_expr = nodes.literal_or_variable(std::move(identifier));
         auto op = consume();
-        auto expr = parse_expression();
+        auto value = parse_expression();
         switch (op.type()) {
         case token_type::Assign:
-            return std::make_unique<ast::assign_stmt>(std::move(id_expr), std::move(expr));
+            return nodes.assign_stmt(std::move(id_expr), std::move(value));
         case token_type::Minus_Assign:
-            return std::make_unique<ast::assign_stmt>(std::move(id_expr), std::move(expr),
-                                                      ast::operation::sub);
+            return nodes.assign_stmt(std::move(id_expr), std::move(value), ast::operation::sub);
         case token_type::Mult_Assign:
-            return std::make_unique<ast::assign_stmt>(std::move(id_expr), std::move(expr),
-                                                      ast::operation::mult);
+            return nodes.assign_stmt(std::move(id_expr), std::move(value), ast::operation::mult);
         case token_type::Plus_Assign:
-            return std::make_unique<ast::assign_stmt>(std::move(id_expr), std::move(expr),
-                                                      ast::operation::add);
+            return nodes.assign_stmt(std::move(id_expr), std::move(value), ast::operation::add);
         default:
-            std::cerr << "Unsupported operation: " << op << '\n';
-            return nullptr;
+            diag::error(op) << "Unsupported operation: " << op.text();
+            return {};
         }
     } else {
-        std::cerr << "Unexpected token after identifier " << identifier << " : " << lex.peek()
-                  << '\n';
-        return nullptr;
+        diag::error(peek_token()) << "Unexpected token after identifier " << identifier.text()
+                                  << " : " << peek_token().text();
+        return {};
     }
 }
 
 // Will consume the left paren only if needed
-std::unique_ptr<ast::func_call> parser::parse_call(std::unique_ptr<ast::expression> tok) {
-    if (lex.peek().type() == token_type::LParen) consume();
+template<typename Builder> auto basic_parser<Builder>::parse_call(expr tok) -> call {
+    if (peek() == token_type::LParen) consume();
 
-    return std::make_unique<ast::func_call>(std::move(tok), parse_arguments());
+    // Arguments can be calls themselves
+    auto arguments = stack_guard::nested([this] { return parse_arguments(); });
+    return nodes.func_call(std::move(tok), std::move(arguments));
 }
 
-std::vector<std::unique_ptr<ast::expression>> parser::parse_arguments() {
+template<typename Builder> auto basic_parser<Builder>::parse_arguments() -> args {
 
-    std::vector<std::unique_ptr<ast::expression>> args;
-    if (lex.peek().type() != token_type::RParen) {
-        args.push_back(parse_expression());
-        while (lex.peek().type() == token_type::Comma) {
+    args arguments = nodes.make_list();
+    if (peek() != token_type::RParen) {
+        nodes.append(arguments, parse_expression());
+        while (peek() == token_type::Comma) {
             consume();
-            args.push_back(parse_expression());
+            nodes.append(arguments, parse_expression());
         }
         // Should be RParen
         if (auto tok = consume(); tok.type() != token_type::RParen)
-            std::cerr << "Expected closing parenthesis for argument list. Got " << tok
-                      << " instead\n";
+            diag::error(tok) << "Expected closing parenthesis for argument list. Got "
+                             << tok.text() << " instead";
     }
 
-    return args;
+    return arguments;
 }
 
-std::unique_ptr<ast::if_stmt> parser::parse_if_stmt() {
+template<typename Builder> auto basic_parser<Builder>::parse_if_stmt() -> stmt {
     consume(); // should be the if token
 
-    if (consume().type() != token_type::LParen) {
-        std::cerr << "If requires an opening parenthesis.\n";
-        return nullptr;
+    if (const auto tok = consume(); tok.type() != token_type::LParen) {
+        diag::error(tok) << "If requires an opening parenthesis.";
+        return {};
     }
 
     auto condition = parse_expression();
 
-    if (consume().type() != token_type::RParen) {
-        std::cerr << "If requires a closing parenthesis.\n";
-        return nullptr;
+    if (const auto tok = consume(); tok.type() != token_type::RParen) {
+        diag::error(tok) << "If requires a closing parenthesis.";
+        return {};
     }
 
     auto then_block = parse_statement();
 
-    if (then_block->type() == ast::node_type::statement_block
-        and lex.peek().type() == token_type::Else) {
+    if (nodes.is_block(then_block) and peek() == token_type::Else) {
 
         consume();
         consume_stmt_terminators();
 
-        switch (lex.peek().type()) {
+        switch (peek()) {
         case token_type ::If:
         case token_type ::LBrace:
-            return std::make_unique<ast::if_stmt>(std::move(condition), std::move(then_block),
-                                                  parse_statement());
+            return nodes.if_stmt(std::move(condition), std::move(then_block), parse_statement());
         default:
-            std::cerr << "Only '{' or 'if' allowed after 'else'.\n";
-            return nullptr;
+            diag::error(peek_token()) << "Only '{' or 'if' allowed after 'else'.";
+            return {};
         }
     } else
-        return std::make_unique<ast::if_stmt>(std::move(condition), std::move(then_block));
+        return nodes.if_stmt(std::move(condition), std::move(then_block));
 }
 
-std::unique_ptr<ast::ret_stmt> parser::parse_return_stmt() {
+template<typename Builder> auto basic_parser<Builder>::parse_return_stmt() -> stmt {
     auto tok = consume();
     if (tok.type() != token_type::Return) {
-        std::cerr << "Return statement must start with return.\n";
-        return nullptr;
+        diag::error(tok) << "Return statement must start with return.";
+        return {};
     }
 
-    if (match_expr()) return std::make_unique<ast::ret_stmt>(std::move(tok), parse_expression());
+    if (match_expr()) return nodes.ret_stmt(std::move(tok), parse_expression());
     else
-        return std::make_unique<ast::ret_stmt>(std::move(tok));
+        return nodes.ret_stmt(std::move(tok));
 }
 
 // Expression parsing
 
 namespace {
-int op_precedence(const token & tok) {
-    switch (tok.type()) {
-    case token_type ::LParen:
-        return 25;
-    case token_type ::Minus:
-    case token_type ::Plus:
-        return 20;
-    case token_type ::Lt:
-    case token_type::Gt:
-    case token_type ::Le:
-    case token_type::Ge:
-        return 15;
-    case token_type ::Eq:
-        return 12;
-    case token_type ::Boolean_Or:
-    case token_type ::Boolean_And:
-        return 1;
-    default:
-        std::cerr << "Asked for precedence of " << tok << '\n';
-        return -1;
-    }
+enum struct associativity : uint8_t { left, right };
+
+struct binary_operator {
+    // Higher binds tighter, 0 for tokens that end an expression
+    uint8_t precedence = 0;
+    associativity assoc = associativity::left;
+    ast::operation op = ast::operation::assign;
+};
+
+// Every token that can follow an operand, indexed by token_type
+constexpr auto binary_operators = [] {
+    // While is the last token_type
+    std::array<binary_operator, static_cast<size_t>(token_type::While) + 1> table{};
+    const auto set = [&table](token_type type, uint8_t precedence, ast::operation op) {
+        table[static_cast<size_t>(type)] = {precedence, associativity::left, op};
+    };
+
+    set(token_type::Boolean_Or, 1, ast::operation::boolean_or);
+    set(token_type::Boolean_And, 2, ast::operation::boolean_and);
+    set(token_type::Bit_Or, 3, ast::operation::bit_or);
+    set(token_type::Eq, 4, ast::operation::eq);
+    set(token_type::Lt, 5, ast::operation::lt);
+    set(token_type::Le, 5, ast::operation::le);
+    set(token_type::Gt, 5, ast::operation::gt);
+    set(token_type::Ge, 5, ast::operation::ge);
+    set(token_type::Shl, 6, ast::operation::shl);
+    set(token_type::Shr, 6, ast::operation::shr);
+    set(token_type::Plus, 7, ast::operation::add);
+    set(token_type::Minus, 7, ast::operation::sub);
+    set(token_type::Mult, 8, ast::operation::mult);
+    // A call, op is not used
+    set(token_type::LParen, 9, ast::operation::assign);
+    return table;
+}();
+
+constexpr const binary_operator & binary_operator_of(token_type type) noexcept {
+    return binary_operators[static_cast<size_t>(type)];
 }
 
-associativity op_associativity(const token & tok) {
-    switch (tok.type()) {
-    case token_type::LParen:
-    case token_type ::Lt:
-    case token_type ::Le:
-    case token_type ::Gt:
-    case token_type ::Ge:
-    case token_type ::Boolean_Or:
-    case token_type ::Boolean_And:
-    case token_type ::Eq:
-    case token_type ::Minus:
-    case token_type ::Plus:
-        return associativity::left;
-    default:
-        std::cerr << "Asked for associativity of " << tok << '\n';
-        return associativity::right;
-    }
+// Whether the operator already on the stack takes its right operand before the next one
+constexpr bool reduces_before(const binary_operator & top, const binary_operator & next) noexcept {
+    return top.precedence > next.precedence
+           or (top.precedence == next.precedence and next.assoc == associativity::left);
 }
 } // namespace
 
-std::unique_ptr<ast::expression> parser::parse_expression(int min_preced, associativity assoc) {
-
-    auto expr = parse_primary_expr();
-    while (match_secondary_expr()) {
-        auto precedence = op_precedence(lex.peek());
-        if (precedence < min_preced) break;
-        else if (precedence == min_preced and assoc == associativity::left)
-            break;
+// Precedence climbing with explicit stacks instead of recursion for each level
+template<typename Builder> auto basic_parser<Builder>::parse_expression() -> expr {
+    // Nested expressions, like call arguments, only use the stack above this one
+    const auto operator_base = operators.size();
+    const auto reduce = [this] {
+        auto rhs = std::move(operands.back());
+        operands.pop_back();
+        operands.back() = nodes.bin_op(std::move(operands.back()),
+                                       binary_operator_of(operators.back()).op, std::move(rhs));
+        operators.pop_back();
+    };
+
+    operands.push_back(parse_primary_expr());
+    for (auto type = peek();; type = peek()) {
+        const auto & next = binary_operator_of(type);
+        if (next.precedence == 0) break;
+
+        if (type == token_type::LParen) {
+            // Binds tighter than every operator, so it always takes the last operand
+            operands.back() = parse_call(std::move(operands.back()));
+            continue;
+        }
 
-        auto associate = op_associativity(lex.peek());
-        expr = parse_secondary_expr(std::move(expr), precedence, associate);
+        while (operators.size() > operator_base
+               and reduces_before(binary_operator_of(operators.back()), next))
+            reduce();
+        consume();
+        operators.push_back(type);
+        operands.push_back(parse_primary_expr());
     }
+    while (operators.size() > operator_base) reduce();
 
-    return expr;
+    auto result = std::move(operands.back());
+    operands.pop_back();
+    return result;
 }
-std::unique_ptr<ast::expression> parser::parse_primary_expr() {
-    switch (lex.peek().type()) {
+template<typename Builder> auto basic_parser<Builder>::parse_primary_expr() -> expr {
+    switch (peek()) {
     case token_type ::Identifier:
     case token_type ::Int:
     case token_type ::Float:
     case token_type ::StringLiteral:
-        return std::make_unique<ast::literal_or_variable>(consume());
+        return nodes.literal_or_variable(consume());
     default:
-        std::cerr << "Unexpected token as primary expression " << consume() << '\n';
-        return nullptr;
+        const auto tok = consume();
+        diag::error(tok) << "Unexpected token as primary expression " << tok.text();
+        return {};
     }
 }
-bool parser::match_expr() {
-    switch (lex.peek().type()) {
+template<typename Builder> bool basic_parser<Builder>::match_expr() {
+    switch (peek()) {
     case token_type ::LParen:
     case token_type ::StringLiteral:
     case token_type ::Float:
@@ -345,155 +509,107 @@ bool parser::match_expr() {
         return false;
     }
 }
-bool parser::match_secondary_expr() {
-    switch (lex.peek().type()) {
-    case token_type ::LParen:
-    case token_type ::Lt:
-    case token_type ::Le:
-    case token_type ::Gt:
-    case token_type ::Ge:
-    case token_type ::Plus:
-    case token_type ::Minus:
-    case token_type ::Boolean_Or:
-    case token_type ::Eq:
-        return true;
-    default:
-        std::cerr << "Token " << lex.peek() << " is not a secondary expression.\n";
-        [[fallthrough]];
-    case token_type ::RParen:
-    case token_type ::Newline:
-    case token_type ::Semi:
-    case token_type::Comma:
-        return false;
-    }
-}
-std::unique_ptr<ast::expression> parser::parse_secondary_expr(std::unique_ptr<ast::expression> lhs,
-                                                              int precedence,
-                                                              associativity associativity) {
-    switch (auto op = consume(); op.type()) {
-    case token_type ::Plus:
-        return std::make_unique<ast::bin_op>(std::move(lhs), ast::operation::add,
-                                             parse_expression(precedence, associativity));
-    case token_type ::Minus:
-        return std::make_unique<ast::bin_op>(std::move(lhs), ast::operation::sub,
-                                             parse_expression(precedence, associativity));
-    case token_type ::Le:
-        return std::make_unique<ast::bin_op>(std::move(lhs), ast::operation::le,
-                                             parse_expression(precedence, associativity));
-    case token_type::Gt:
-        return std::make_unique<ast::bin_op>(std::move(lhs), ast::operation::gt,
-                                             parse_expression(precedence, associativity));
-    case token_type ::Eq:
-        return std::make_unique<ast::bin_op>(std::move(lhs), ast::operation::eq,
-                                             parse_expression(precedence, associativity));
-    case token_type ::Boolean_Or:
-        return std::make_unique<ast::bin_op>(std::move(lhs), ast::operation::boolean_or,
-                                             parse_expression(precedence, associativity));
-    case token_type ::LParen:
-        return parse_call(std::move(lhs));
-    default:
-        std::cerr << "Unexpected token in secondary expression " << op << '\n';
-        return lhs;
-    }
-}
-std::unique_ptr<ast::var_decl> parser::parse_const_decl(bool global) {
-    if (consume().type() != token_type::Const) {
-        std::cerr << "A const declaration can only start with const\n";
-        return nullptr;
+template<typename Builder> auto basic_parser<Builder>::parse_const_decl(bool global) -> decl {
+    if (const auto tok = consume(); tok.type() != token_type::Const) {
+        diag::error(tok) << "A const declaration can only start with const";
+        return {};
     }
 
     auto ident = parse_opt_typed();
 
-    if (consume().type() != token_type::Assign) {
-        std::cerr << "Declarations must use '='\n";
-        return nullptr;
+    if (const auto tok = consume(); tok.type() != token_type::Assign) {
+        diag::error(tok) << "Declarations must use '='";
+        return {};
     }
 
-    return std::make_unique<ast::var_decl>(std::move(ident), parse_expression(),
-                                           global ? ast::var_decl::details::GlobalConst
-                                                  : ast::var_decl::details::Const);
+    return nodes.var_decl(std::move(ident), parse_expression(),
+                          global ? ast::var_decl::details::GlobalConst
+                                 : ast::var_decl::details::Const);
 }
 
-std::unique_ptr<ast::var_decl> parser::parse_let_decl() {
-    if (consume().type() != token_type::Let) {
-        std::cerr << "A let declaration can only start with let\n";
-        return nullptr;
+template<typename Builder> auto basic_parser<Builder>::parse_let_decl() -> decl {
+    if (const auto tok = consume(); tok.type() != token_type::Let) {
+        diag::error(tok) << "A let declaration can only start with let";
+        return {};
     }
 
     auto ident = parse_opt_typed();
 
-    if (consume().type() != token_type::Assign) {
-        std::cerr << "Declarations must use '='\n";
-        return nullptr;
+    if (const auto tok = consume(); tok.type() != token_type::Assign) {
+        diag::error(tok) << "Declarations must use '='";
+        return {};
     }
 
-    return std::make_unique<ast::var_decl>(std::move(ident), parse_expression(),
-                                           ast::var_decl::details::Let);
+    return nodes.var_decl(std::move(ident), parse_expression(), ast::var_decl::details::Let);
 }
 
-ast::opt_typed parser::parse_opt_typed() {
+template<typename Builder> auto basic_parser<Builder>::parse_opt_typed() -> typed {
     auto ident = consume();
-    if (lex.peek().type() == token_type::Colon) {
+    if (peek() == token_type::Colon) {
         consume();
-        return ast::opt_typed{std::move(ident), consume()};
+        return nodes.opt_typed(std::move(ident), consume());
     }
-    return ast::opt_typed{std::move(ident)};
+    return nodes.opt_typed(std::move(ident));
 }
-std::unique_ptr<ast::while_loop> parser::parse_while_loop() {
-    if (consume().type() != token_type::While) {
-        std::cerr << "While loops need to start on 'while ('\n";
-        return nullptr;
+template<typename Builder> auto basic_parser<Builder>::parse_while_loop() -> stmt {
+    if (const auto tok = consume(); tok.type() != token_type::While) {
+        diag::error(tok) << "While loops need to start on 'while ('";
+        return {};
     }
 
-    if (consume().type() != token_type::LParen) {
-        std::cerr << "The condition of a while loop needs to be parenthesized\n";
-        return nullptr;
+    if (const auto tok = consume(); tok.type() != token_type::LParen) {
+        diag::error(tok) << "The condition of a while loop needs to be parenthesized";
+        return {};
     }
 
     auto condition = parse_expression();
 
-    if (consume().type() != token_type::RParen) {
-        std::cerr << "The condition of a while loop needs to be parenthesized\n";
-        return nullptr;
+    if (const auto tok = consume(); tok.type() != token_type::RParen) {
+        diag::error(tok) << "The condition of a while loop needs to be parenthesized";
+        return {};
     }
 
-    return std::make_unique<ast::while_loop>(std::move(condition), parse_statement());
+    return nodes.while_loop(std::move(condition), parse_statement());
 }
-std::unique_ptr<ast::top_level> parser::parse_struct_decl() {
+template<typename Builder> auto basic_parser<Builder>::parse_struct_decl() -> item {
     // Definitely the 'struct' keyword
     consume();
 
     auto struct_type_name = consume();
 
-    if (consume().type() != token_type::LBrace) {
-        std::cerr << "Struct declarations need '{'\n";
-        return nullptr;
+    if (const auto tok = consume(); tok.type() != token_type::LBrace) {
+        diag::error(tok) << "Struct declarations need '{'";
+        return {};
     }
 
-    std::vector<std::pair<token, token>> fields;
+    fields members = nodes.make_list();
     while (true) {
         auto field_name = consume();
         if (field_name.type() != token_type::Identifier or consume().type() != token_type::Colon) {
-            std::cerr << "Struct fields need to be named and have an explicit type\n";
-            return nullptr;
+            diag::error(field_name) << "Struct fields need to be named and have an explicit type";
+            nodes.clear(members);
+            return {};
         }
 
         auto field_type = consume();
 
-        fields.emplace_back(field_name, field_type);
+        nodes.add_field(members, std::move(field_name), std::move(field_type));
 
         if (not consume_stmt_terminators()) {
             // Either end of struct or error
-            if (lex.peek().type() == token_type::RBrace) break;
+            if (peek() == token_type::RBrace) break;
             else {
-                std::cerr << "Unexpected " << lex.peek() << " in struct declaration\n";
-                return nullptr;
+                diag::error(peek_token())
+                    << "Unexpected " << peek_token().text() << " in struct declaration";
+                nodes.clear(members);
+                return {};
             }
         } else {
             // Either next fields or error
-            if (lex.peek().type() == token_type::RBrace) {
-                std::cerr << "Trailing separators found. Currently unsupported\n";
-                return nullptr;
+            if (peek() == token_type::RBrace) {
+                diag::error(peek_token()) << "Trailing separators found. Currently unsupported";
+                nodes.clear(members);
+                return {};
             }
         }
     }
@@ -501,5 +617,8 @@ std::unique_ptr<ast::top_level> parser::parse_struct_decl() {
     // Should be right brace
     consume();
 
-    return std::make_unique<ast::struct_decl>(std::move(struct_type_name), std::move(fields));
+    return nodes.struct_decl(std::move(struct_type_name), std::move(members));
 }
+
+template class basic_parser<ast::tree_builder>;
+template class basic_parser<ast::flat_builder>;
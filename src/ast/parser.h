@@ -5,60 +5,116 @@
 #ifndef NEW_J_COMPILER_PARSER_H
 #define NEW_J_COMPILER_PARSER_H
 
+#include "flat_tree.h"
 #include "lexer.h"
-#include "node_forward.h"
+#include "token_buffer.h"
+#include "tree_builder.h"
 
+#include <memory>
 #include <vector>
 
-enum struct associativity { left, right };
+// The grammar is shared between the AST representations.
+// Builder decides what the nodes look like, see ast::tree_builder and ast::flat_builder.
+template<typename Builder> class basic_parser final {
+    using expr = typename Builder::expr;
+    using stmt = typename Builder::stmt;
+    using item = typename Builder::item;
+    using call = typename Builder::call;
+    using decl = typename Builder::decl;
+    using typed = typename Builder::typed;
+    using params = typename Builder::params;
+    using args = typename Builder::args;
+    using stmts = typename Builder::stmts;
+    using fields = typename Builder::fields;
 
-class parser final {
   public:
-    explicit parser(lexer && lex_in) : lex{std::move(lex_in)} {}
+    explicit basic_parser(lexer && lex_in)
+        : tokens{std::make_shared<const token_buffer>(lex_in.tokenize())},
+          last{tokens->size() - 1} {}
+    // For parsing slices of tokens that were already read, with nodes from the given Builder
+    basic_parser(std::shared_ptr<const token_buffer> tokens, Builder && nodes)
+        : tokens{std::move(tokens)}, last{this->tokens->size() - 1}, nodes{std::move(nodes)} {}
 
-    std::unique_ptr<ast::program> parse_program();
+    // With more than one thread, the top level items are parsed in parallel
+    // and then added to the program in source order.
+    // Only Builders that can hand out builders for worker threads support that,
+    // see ast::tree_builder::worker. The others always use one thread.
+    typename Builder::result parse_program(unsigned threads = 1);
+
+    // Indices into the tokens, last is not part of the slice
+    struct slice {
+        size_t first, last;
+    };
+    // Splits the tokens in front of every top level item
+    [[nodiscard]] std::vector<slice> split_top_level() const;
+    [[nodiscard]] std::vector<item> parse_slice(slice range);
+
+    [[nodiscard]] const std::shared_ptr<const token_buffer> & token_list() const noexcept {
+        return tokens;
+    }
 
   private:
+    // Reports duplicate names
+    void add_item(item && next_item);
+
     bool done();
     token consume();
+
+    // The type of the token `ahead` places past the current one.
+    // Looking past the end yields EndOfFile.
+    [[nodiscard]] token_type peek(size_t ahead = 0) const noexcept;
+    // The current token, for diagnostics and operator tables
+    [[nodiscard]] token peek_token() const;
+    [[nodiscard]] token token_at(size_t index) const;
     bool consume_stmt_terminators();
 
     bool match_expr();
     bool match_unary_expr();
-    bool match_secondary_expr();
     bool match_stmt();
 
     // Top level items
-    std::unique_ptr<ast::top_level> parse_top_level();
-    std::unique_ptr<ast::function> parse_function();
-    std::vector<ast::parameter> parse_params();
+    item parse_top_level();
+    item parse_function();
+    params parse_params();
 
-    std::unique_ptr<ast::var_decl> parse_const_decl(bool global);
-    ast::opt_typed parse_opt_typed();
+    decl parse_const_decl(bool global);
+    typed parse_opt_typed();
 
     // Statements
-    std::unique_ptr<ast::statement> parse_statement();
-    std::unique_ptr<ast::stmt_block> parse_stmt_block();
-    std::unique_ptr<ast::statement> parse_identifier_stmt();
-    std::unique_ptr<ast::func_call> parse_call(std::unique_ptr<ast::expression> tok);
-    std::unique_ptr<ast::if_stmt> parse_if_stmt();
-    std::unique_ptr<ast::ret_stmt> parse_return_stmt();
-    std::unique_ptr<ast::while_loop> parse_while_loop();
-    std::unique_ptr<ast::var_decl> parse_let_decl();
+    stmt parse_statement();
+    stmt parse_stmt_block();
+    stmt parse_identifier_stmt();
+    call parse_call(expr tok);
+    stmt parse_if_stmt();
+    stmt parse_return_stmt();
+    stmt parse_while_loop();
+    decl parse_let_decl();
 
-    std::vector<std::unique_ptr<ast::expression>> parse_arguments();
+    args parse_arguments();
 
     // Expressions
-    // TODO: Make min_preced optional
-    std::unique_ptr<ast::expression> parse_expression(int min_preced = 0,
-                                                      associativity assoc = associativity::right);
-    std::unique_ptr<ast::expression> parse_primary_expr();
-    std::unique_ptr<ast::expression>
-    parse_secondary_expr(std::unique_ptr<ast::expression> unique_ptr, int precedence,
-                         associativity associativity);
-
-    lexer lex;
-    std::unique_ptr<ast::top_level> parse_struct_decl();
+    expr parse_expression();
+    expr parse_primary_expr();
+
+    // Shared between the parsers of the slices of one program
+    std::shared_ptr<const token_buffer> tokens;
+    size_t position = 0;
+    // Tokens from here on are read as EndOfFile
+    size_t last;
+
+    Builder nodes{};
+    // Operands and operators parse_expression has not combined yet
+    std::vector<expr> operands{};
+    std::vector<token_type> operators{};
+    item parse_struct_decl();
 };
 
+// Builds the pointer based ast::program
+using parser = basic_parser<ast::tree_builder>;
+// Builds an ast::flat_tree
+using flat_parser = basic_parser<ast::flat_builder>;
+
+extern template class basic_parser<ast::tree_builder>;
+extern template class basic_parser<ast::flat_builder>;
+
 #endif // NEW_J_COMPILER_PARSER_H
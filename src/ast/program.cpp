@@ -6,23 +6,20 @@
 
 #include "nodes.h"
 
-#include <algorithm>
-#include <iostream>
-
 namespace ast {
 
-top_level * program::find(const std::string & id) const {
-
-    const auto iter = std::find_if(this->items.begin(), this->items.end(),
-                                   [&id](const auto & item) { return id == item->identifier(); });
+top_level * program::find(symbol id) const {
+    const auto iter = index.find(id);
+    return iter == index.end() ? nullptr : iter->second;
+}
+bool program::add_item(ptr<top_level> item) {
+    if (not index.try_emplace(item->identifier(), item.get()).second) return false;
 
-    return iter == items.end() ? nullptr : iter->get();
+    items.push_back(std::move(item));
+    return true;
 }
-bool program::add_item(std::unique_ptr<top_level> item) {
-    if (not this->find(item->identifier())) {
-        this->items.push_back(std::move(item));
-        return true;
-    } else
-        return false;
+void program::clear_items() noexcept {
+    items.clear();
+    index.clear();
 }
 } // namespace ast
\ No newline at end of file
@@ -5,26 +5,55 @@
 #ifndef NEW_J_COMPILER_PROGRAM_H
 #define NEW_J_COMPILER_PROGRAM_H
 
+#include "arena.h"
+#include "interner.h"
 #include "node_forward.h"
 
-#include <functional>
 #include <memory>
 #include <string>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
 namespace ast {
 
 class program final {
   public:
-    bool add_item(std::unique_ptr<top_level> item);
-    [[nodiscard]] top_level * find(const std::string & id) const;
+    program() = default;
 
-    void visit(const std::function<void(top_level &)> & visitor) {
+    program(const program &) = delete;
+    program & operator=(const program &) = delete;
+
+    // Every node of the program is allocated here
+    [[nodiscard]] ast::arena & nodes() noexcept { return node_arena; }
+    // Another arena that lives as long as the program, for building nodes on another thread
+    [[nodiscard]] ast::arena & add_arena() {
+        return *worker_arenas.emplace_back(std::make_unique<ast::arena>());
+    }
+
+    // Returns false if an item with the same name was added before
+    bool add_item(ptr<top_level> item);
+    [[nodiscard]] top_level * find(symbol id) const;
+    // Forgets the items. Their nodes stay in the arenas, so they can be added again.
+    void clear_items() noexcept;
+
+    [[nodiscard]] size_t arena_count() const noexcept { return 1 + worker_arenas.size(); }
+
+    template<typename Visitor> void visit(Visitor && visitor) {
         for (auto & item : items) visitor(*item);
     }
+    template<typename Visitor> void visit(Visitor && visitor) const {
+        for (const auto & item : items) visitor(std::as_const(*item));
+    }
 
   private:
-    std::vector<std::unique_ptr<top_level>> items{};
+    // Declared first so it outlives the items
+    ast::arena node_arena{};
+    std::vector<std::unique_ptr<ast::arena>> worker_arenas{};
+    // In declaration order
+    std::vector<ptr<top_level>> items{};
+    // The nodes do not move, so the index can point straight at them
+    std::unordered_map<symbol, top_level *> index{};
 };
 
 } // namespace ast
@@ -0,0 +1,164 @@
+//
+// Created by nick on 10/17/26.
+//
+
+#include "scan.h"
+
+#include <cstdint>
+
+#if (defined(__GNUC__) or defined(__clang__)) and (defined(__x86_64__) or defined(__SSE2__))
+#define NJ_SCAN_X86
+#include <immintrin.h>
+#endif
+
+namespace scan {
+
+namespace {
+
+constexpr bool is_blank(char c) noexcept { return c == ' ' or c == '\t'; }
+constexpr bool is_digit(char c) noexcept { return c >= '0' and c <= '9'; }
+constexpr bool is_alnum(char c) noexcept {
+    const auto lower = static_cast<char>(c | 0x20);
+    return is_digit(c) or (lower >= 'a' and lower <= 'z');
+}
+
+template <bool (*in_run)(char)> size_t scalar_end(std::string_view text, size_t pos) noexcept {
+    while (pos < text.size() and in_run(text[pos])) pos++;
+    return pos;
+}
+
+constexpr bool not_newline(char c) noexcept { return c != '\n'; }
+
+#ifdef NJ_SCAN_X86
+
+// Each classify function marks the characters that are part of the run.
+// The run ends at the first unmarked character.
+
+__m128i blanks_128(__m128i chunk) noexcept {
+    return _mm_or_si128(_mm_cmpeq_epi8(chunk, _mm_set1_epi8(' ')),
+                        _mm_cmpeq_epi8(chunk, _mm_set1_epi8('\t')));
+}
+
+__m128i not_newline_128(__m128i chunk) noexcept {
+    return _mm_xor_si128(_mm_cmpeq_epi8(chunk, _mm_set1_epi8('\n')), _mm_set1_epi8(-1));
+}
+
+// Bytes above 0x7F are negative, so the signed compares leave them out
+__m128i digits_128(__m128i chunk) noexcept {
+    return _mm_and_si128(_mm_cmpgt_epi8(chunk, _mm_set1_epi8('0' - 1)),
+                         _mm_cmpgt_epi8(_mm_set1_epi8('9' + 1), chunk));
+}
+
+__m128i alnum_128(__m128i chunk) noexcept {
+    const auto lower = _mm_or_si128(chunk, _mm_set1_epi8(0x20));
+    const auto letters = _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)),
+                                       _mm_cmpgt_epi8(_mm_set1_epi8('z' + 1), lower));
+    return _mm_or_si128(letters, digits_128(chunk));
+}
+
+template <__m128i (*classify)(__m128i), bool (*in_run)(char)>
+size_t sse2_end(std::string_view text, size_t pos) noexcept {
+    // Most runs are short, so check one character before paying for a whole block
+    if (pos >= text.size() or not in_run(text[pos])) return pos;
+
+    while (pos + sizeof(__m128i) <= text.size()) {
+        const auto chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(text.data() + pos));
+        const auto outside = ~static_cast<uint32_t>(_mm_movemask_epi8(classify(chunk))) & 0xFFFFu;
+        if (outside != 0) return pos + __builtin_ctz(outside);
+        pos += sizeof(__m128i);
+    }
+
+    return scalar_end<in_run>(text, pos);
+}
+
+#define NJ_AVX2 __attribute__((target("avx2")))
+
+NJ_AVX2 __m256i blanks_256(__m256i chunk) noexcept {
+    return _mm256_or_si256(_mm256_cmpeq_epi8(chunk, _mm256_set1_epi8(' ')),
+                           _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8('\t')));
+}
+
+NJ_AVX2 __m256i not_newline_256(__m256i chunk) noexcept {
+    return _mm256_xor_si256(_mm256_cmpeq_epi8(chunk, _mm256_set1_epi8('\n')),
+                            _mm256_set1_epi8(-1));
+}
+
+NJ_AVX2 __m256i digits_256(__m256i chunk) noexcept {
+    return _mm256_and_si256(_mm256_cmpgt_epi8(chunk, _mm256_set1_epi8('0' - 1)),
+                            _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), chunk));
+}
+
+NJ_AVX2 __m256i alnum_256(__m256i chunk) noexcept {
+    const auto lower = _mm256_or_si256(chunk, _mm256_set1_epi8(0x20));
+    const auto letters = _mm256_and_si256(_mm256_cmpgt_epi8(lower, _mm256_set1_epi8('a' - 1)),
+                                          _mm256_cmpgt_epi8(_mm256_set1_epi8('z' + 1), lower));
+    return _mm256_or_si256(letters, digits_256(chunk));
+}
+
+template <__m256i (*classify)(__m256i), __m128i (*classify_half)(__m128i), bool (*in_run)(char)>
+NJ_AVX2 size_t avx2_end(std::string_view text, size_t pos) noexcept {
+    if (pos >= text.size() or not in_run(text[pos])) return pos;
+
+    while (pos + sizeof(__m256i) <= text.size()) {
+        const auto chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(text.data() + pos));
+        const auto outside = ~static_cast<uint32_t>(_mm256_movemask_epi8(classify(chunk)));
+        if (outside != 0) return pos + __builtin_ctz(outside);
+        pos += sizeof(__m256i);
+    }
+
+    // Less than a full block is left
+    return sse2_end<classify_half, in_run>(text, pos);
+}
+
+#undef NJ_AVX2
+#endif
+
+struct implementation_t {
+    size_t (*blanks)(std::string_view, size_t) noexcept;
+    size_t (*line)(std::string_view, size_t) noexcept;
+    size_t (*identifier)(std::string_view, size_t) noexcept;
+    size_t (*digits)(std::string_view, size_t) noexcept;
+    const char * name;
+};
+
+constexpr implementation_t scalar_impl{scalar_end<is_blank>, scalar_end<not_newline>,
+                                       scalar_end<is_alnum>, scalar_end<is_digit>, "scalar"};
+
+#ifdef NJ_SCAN_X86
+constexpr implementation_t sse2_impl{
+    sse2_end<blanks_128, is_blank>, sse2_end<not_newline_128, not_newline>,
+    sse2_end<alnum_128, is_alnum>, sse2_end<digits_128, is_digit>, "sse2"};
+
+constexpr implementation_t avx2_impl{avx2_end<blanks_256, blanks_128, is_blank>,
+                                     avx2_end<not_newline_256, not_newline_128, not_newline>,
+                                     avx2_end<alnum_256, alnum_128, is_alnum>,
+                                     avx2_end<digits_256, digits_128, is_digit>, "avx2"};
+#endif
+
+const implementation_t * best_implementation() noexcept {
+#ifdef NJ_SCAN_X86
+    // Needed as this may run before the cpu detection has been initialized
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return &avx2_impl;
+    return &sse2_impl;
+#else
+    return &scalar_impl;
+#endif
+}
+
+const implementation_t * active = best_implementation();
+
+} // namespace
+
+size_t skip_blanks(std::string_view text, size_t pos) noexcept { return active->blanks(text, pos); }
+size_t line_end(std::string_view text, size_t pos) noexcept { return active->line(text, pos); }
+size_t identifier_end(std::string_view text, size_t pos) noexcept {
+    return active->identifier(text, pos);
+}
+size_t digits_end(std::string_view text, size_t pos) noexcept { return active->digits(text, pos); }
+
+void use_simd(bool enabled) noexcept { active = enabled ? best_implementation() : &scalar_impl; }
+
+const char * implementation() noexcept { return active->name; }
+
+} // namespace scan
@@ -0,0 +1,37 @@
+//
+// Created by nick on 10/17/26.
+//
+
+#ifndef NEW_J_COMPILER_SCAN_H
+#define NEW_J_COMPILER_SCAN_H
+
+#include <string_view>
+
+// Helpers for the lexer that find the end of a run of similar characters.
+// Each one starts at pos and returns the position of the first character not in the run,
+// or text.size() if the run reaches the end.
+// Where the cpu allows it, they look at 16 or 32 characters at a time.
+namespace scan {
+
+// Spaces and tabs
+[[nodiscard]] size_t skip_blanks(std::string_view text, size_t pos) noexcept;
+
+// Everything up to the next '\n'
+[[nodiscard]] size_t line_end(std::string_view text, size_t pos) noexcept;
+
+// ASCII letters and digits
+[[nodiscard]] size_t identifier_end(std::string_view text, size_t pos) noexcept;
+
+// ASCII digits
+[[nodiscard]] size_t digits_end(std::string_view text, size_t pos) noexcept;
+
+// The fastest implementation is picked on first use.
+// Passing false forces the scalar one, which is mostly useful for benchmarks.
+void use_simd(bool enabled) noexcept;
+
+// One of "avx2", "sse2" or "scalar"
+[[nodiscard]] const char * implementation() noexcept;
+
+} // namespace scan
+
+#endif // NEW_J_COMPILER_SCAN_H
@@ -0,0 +1,123 @@
+//
+// Created by nick on 10/17/26.
+//
+
+#include "source_buffer.h"
+
+#include <fstream>
+#include <iostream>
+#include <iterator>
+
+#if __has_include(<sys/mman.h>)
+#define NJ_HAS_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+std::shared_ptr<const source_buffer> source_buffer::from_string(std::string text) {
+    // make_shared cannot reach the private constructor
+    std::shared_ptr<source_buffer> to_ret{new source_buffer{}};
+    to_ret->storage = std::move(text);
+    // std::string always keeps a '\0' after its contents, which is our sentinel
+    to_ret->start = to_ret->storage.c_str();
+    to_ret->length = to_ret->storage.size();
+    return to_ret;
+}
+
+#ifdef NJ_HAS_MMAP
+namespace {
+std::string read_all(int file) {
+    std::string to_ret;
+    char chunk[1u << 16u];
+    ssize_t amount_read;
+    while ((amount_read = read(file, chunk, sizeof(chunk))) > 0) to_ret.append(chunk, amount_read);
+    return to_ret;
+}
+} // namespace
+
+std::shared_ptr<const source_buffer> source_buffer::open(const std::string & filename) {
+    if (filename == "-") return from_string(read_all(STDIN_FILENO));
+
+    const auto file = ::open(filename.c_str(), O_RDONLY);
+    if (file < 0) return nullptr;
+
+    struct stat file_info {};
+    if (fstat(file, &file_info) != 0 or not S_ISREG(file_info.st_mode) or file_info.st_size == 0) {
+        auto to_ret = from_string(read_all(file));
+        close(file);
+        return to_ret;
+    }
+
+    const auto file_size = static_cast<size_t>(file_info.st_size);
+    const auto page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+
+    // The rest of the last page of a mapping reads as zeros, which gives the sentinel for free.
+    // If the file ends exactly on a page boundary,
+    // reserve one more anonymous page after it and map the file over the front of the reservation.
+    void * mapping = nullptr;
+    auto mapping_length = file_size;
+    if (file_size % page_size != 0) {
+        mapping = mmap(nullptr, file_size, PROT_READ, MAP_PRIVATE, file, 0);
+    } else {
+        mapping_length += page_size;
+        mapping = mmap(nullptr, mapping_length, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mapping != MAP_FAILED
+            and mmap(mapping, file_size, PROT_READ, MAP_PRIVATE | MAP_FIXED, file, 0)
+                    == MAP_FAILED) {
+            munmap(mapping, mapping_length);
+            mapping = MAP_FAILED;
+        }
+    }
+
+    if (mapping == MAP_FAILED) {
+        auto to_ret = from_string(read_all(file));
+        close(file);
+        return to_ret;
+    }
+
+    // The mapping stays valid after the file is closed
+    close(file);
+
+    std::shared_ptr<source_buffer> to_ret{new source_buffer{}};
+    to_ret->mapping = mapping;
+    to_ret->mapping_length = mapping_length;
+    to_ret->start = static_cast<const char *>(mapping);
+    to_ret->length = file_size;
+    return to_ret;
+}
+
+std::shared_ptr<const source_buffer> source_buffer::read(const std::string & filename) {
+    if (filename == "-") return from_string(read_all(STDIN_FILENO));
+
+    const auto file = ::open(filename.c_str(), O_RDONLY);
+    if (file < 0) return nullptr;
+
+    auto to_ret = from_string(read_all(file));
+    close(file);
+    return to_ret;
+}
+
+source_buffer::~source_buffer() noexcept {
+    if (mapping != nullptr) munmap(mapping, mapping_length);
+}
+#else
+std::shared_ptr<const source_buffer> source_buffer::open(const std::string & filename) {
+    if (filename == "-")
+        return from_string({std::istreambuf_iterator<char>{std::cin},
+                            std::istreambuf_iterator<char>{}});
+
+    std::ifstream file{filename, std::ios::binary | std::ios::in};
+    if (not file) return nullptr;
+
+    return from_string(
+        {std::istreambuf_iterator<char>{file}, std::istreambuf_iterator<char>{}});
+}
+
+std::shared_ptr<const source_buffer> source_buffer::read(const std::string & filename) {
+    return open(filename);
+}
+
+source_buffer::~source_buffer() noexcept = default;
+#endif
@@ -0,0 +1,56 @@
+//
+// Created by nick on 10/17/26.
+//
+
+#ifndef NEW_J_COMPILER_SOURCE_BUFFER_H
+#define NEW_J_COMPILER_SOURCE_BUFFER_H
+
+#include <memory>
+#include <string>
+#include <string_view>
+
+// The text of one source file.
+// Regular files are memory mapped, so tokens point straight into the mapping.
+// Anything that cannot be mapped (pipes, stdin, empty files) is read into a string instead.
+// Either way, the byte just past the end is always '\0',
+// so the lexer can look one character ahead without checking the size.
+class source_buffer final {
+  public:
+    // "-" reads from stdin. Returns nullptr if the file cannot be opened.
+    [[nodiscard]] static std::shared_ptr<const source_buffer> open(const std::string & filename);
+    // Like open, but never maps the file, so the text stays the same when the file is written.
+    // Returns nullptr if the file cannot be opened.
+    [[nodiscard]] static std::shared_ptr<const source_buffer> read(const std::string & filename);
+    [[nodiscard]] static std::shared_ptr<const source_buffer> from_string(std::string text);
+
+    source_buffer(const source_buffer &) = delete;
+    source_buffer & operator=(const source_buffer &) = delete;
+
+    ~source_buffer() noexcept;
+
+    [[nodiscard]] std::string_view text() const noexcept { return {start, length}; }
+    [[nodiscard]] size_t size() const noexcept { return length; }
+
+    // Reading at size() gives the sentinel
+    [[nodiscard]] char operator[](size_t pos) const noexcept { return start[pos]; }
+    [[nodiscard]] char at(size_t pos) const { return text().at(pos); }
+
+    [[nodiscard]] std::string substr(size_t pos, size_t len) const {
+        return std::string{text().substr(pos, len)};
+    }
+
+  private:
+    source_buffer() = default;
+
+    const char * start = nullptr;
+    size_t length = 0;
+
+    // Set if the text is mapped
+    void * mapping = nullptr;
+    size_t mapping_length = 0;
+
+    // Holds the text if it is not mapped
+    std::string storage{};
+};
+
+#endif // NEW_J_COMPILER_SOURCE_BUFFER_H
@@ -0,0 +1,71 @@
+//
+// Created by nick on 10/17/26.
+//
+
+#include "source_manager.h"
+
+#include "scan.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+source_manager & source_manager::global() {
+    static source_manager manager;
+    return manager;
+}
+
+std::optional<file_id> source_manager::open(const std::string & filename) {
+    auto text = source_buffer::open(filename);
+    if (text == nullptr) return {};
+
+    return add(filename, std::move(text));
+}
+
+file_id source_manager::add(std::string name, std::shared_ptr<const source_buffer> text) {
+    auto file = std::make_unique<source_file>();
+    file->name = std::move(name);
+    file->text = std::move(text);
+
+    const auto id = files.push_back(std::move(file));
+    if (not id.has_value()) throw std::length_error{"Too many source files"};
+    return id.value();
+}
+
+const source_manager::source_file & source_manager::get(file_id file) const {
+    if (file >= files.size()) throw std::out_of_range{"No file " + std::to_string(file)};
+    return *files[file];
+}
+
+void source_manager::release(file_id file) {
+    if (file >= files.size()) throw std::out_of_range{"No file " + std::to_string(file)};
+    files[file]->text.reset();
+}
+
+const source_buffer & source_manager::buffer(file_id file) const {
+    const auto & text = get(file).text;
+    if (text == nullptr) throw std::logic_error{"File " + std::to_string(file) + " was released"};
+    return *text;
+}
+
+const std::string & source_manager::name(file_id file) const { return get(file).name; }
+
+std::string_view source_manager::text(file_id file, size_t offset, size_t length) const {
+    return buffer(file).text().substr(offset, length);
+}
+
+source_location source_manager::locate(file_id file, size_t offset) const {
+    const auto & source = get(file);
+
+    std::call_once(source.lines_built, [this, file, &source] {
+        const auto text = buffer(file).text();
+        source.line_starts.push_back(0);
+        for (auto pos = scan::line_end(text, 0); pos < text.size();
+             pos = scan::line_end(text, pos + 1))
+            source.line_starts.push_back(pos + 1);
+    });
+
+    // The last line starting at or before offset
+    const auto line = std::upper_bound(source.line_starts.begin(), source.line_starts.end(), offset)
+                      - source.line_starts.begin();
+    return {static_cast<size_t>(line), offset - source.line_starts[line - 1] + 1};
+}
@@ -0,0 +1,68 @@
+//
+// Created by nick on 10/17/26.
+//
+
+#ifndef NEW_J_COMPILER_SOURCE_MANAGER_H
+#define NEW_J_COMPILER_SOURCE_MANAGER_H
+
+#include "source_buffer.h"
+#include "stable_vector.h"
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using file_id = uint32_t;
+
+// Lines start at 1, columns at 1
+struct source_location {
+    size_t line;
+    size_t column;
+};
+
+// Owns the text of every file the compiler has read.
+// Everything else refers to a file by its id, so a token or a node only needs
+// {file id, offset, length} to find its text.
+class source_manager final {
+  public:
+    // The manager used by the whole compiler
+    [[nodiscard]] static source_manager & global();
+
+    // "-" reads from stdin. Returns an empty optional if the file cannot be opened.
+    [[nodiscard]] std::optional<file_id> open(const std::string & filename);
+    [[nodiscard]] file_id add(std::string name, std::shared_ptr<const source_buffer> text);
+    // Frees the text of a file that nothing refers to anymore. The id is not reused,
+    // and asking for the text of the file afterwards throws.
+    // Must not happen while another thread looks at the file.
+    void release(file_id file);
+
+    [[nodiscard]] const source_buffer & buffer(file_id file) const;
+    [[nodiscard]] const std::string & name(file_id file) const;
+    [[nodiscard]] std::string_view text(file_id file, size_t offset, size_t length) const;
+
+    // Binary search over the start of each line.
+    // The table of line starts is built the first time a file is asked about.
+    [[nodiscard]] source_location locate(file_id file, size_t offset) const;
+
+  private:
+    struct source_file {
+        std::string name;
+        std::shared_ptr<const source_buffer> text;
+
+        mutable std::once_flag lines_built{};
+        mutable std::vector<size_t> line_starts{};
+    };
+
+    [[nodiscard]] const source_file & get(file_id file) const;
+
+    // Files are only ever added, and each lives behind its own pointer,
+    // so references handed out stay valid while other files are added.
+    // Looking a file up takes no lock.
+    stable_vector<std::unique_ptr<source_file>> files{};
+};
+
+#endif // NEW_J_COMPILER_SOURCE_MANAGER_H
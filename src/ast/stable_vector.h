@@ -0,0 +1,66 @@
+//
+// Created by nick on 10/17/26.
+//
+
+#ifndef NEW_J_COMPILER_STABLE_VECTOR_H
+#define NEW_J_COMPILER_STABLE_VECTOR_H
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+// An append-only array whose elements never move.
+// Appending takes a lock, but reading an element that has already been appended does not,
+// so other threads can look up entries while new ones are added.
+template<typename T> class stable_vector final {
+  public:
+    stable_vector() = default;
+
+    stable_vector(const stable_vector &) = delete;
+    stable_vector & operator=(const stable_vector &) = delete;
+
+    // Returns the index of the new element, or an empty optional if the vector is full
+    std::optional<uint32_t> push_back(T value) {
+        const std::lock_guard guard{lock};
+
+        const auto index = count.load(std::memory_order_relaxed);
+        if ((index >> chunk_bits) >= max_chunks) return {};
+
+        if (index % chunk_size == 0) {
+            owned_chunks.push_back(std::make_unique<T[]>(chunk_size));
+            chunks[index >> chunk_bits].store(owned_chunks.back().get(),
+                                              std::memory_order_release);
+        }
+
+        owned_chunks[index >> chunk_bits][index % chunk_size] = std::move(value);
+
+        // Publishes the new element to readers
+        count.store(index + 1, std::memory_order_release);
+        return index;
+    }
+
+    // index must be less than size()
+    [[nodiscard]] const T & operator[](uint32_t index) const noexcept {
+        return chunks[index >> chunk_bits].load(std::memory_order_acquire)[index % chunk_size];
+    }
+
+    [[nodiscard]] size_t size() const noexcept { return count.load(std::memory_order_acquire); }
+
+  private:
+    static constexpr size_t chunk_bits = 12;
+    static constexpr size_t chunk_size = size_t{1} << chunk_bits;
+    static constexpr size_t max_chunks = size_t{1} << 15;
+
+    std::mutex lock{};
+    std::vector<std::unique_ptr<T[]>> owned_chunks{};
+
+    // Written under the lock, read without it
+    std::array<std::atomic<const T *>, max_chunks> chunks{};
+    std::atomic<uint32_t> count{0};
+};
+
+#endif // NEW_J_COMPILER_STABLE_VECTOR_H
@@ -0,0 +1,71 @@
+//
+// Created by nick on 10/17/26.
+//
+
+#ifndef NEW_J_COMPILER_STACK_GUARD_H
+#define NEW_J_COMPILER_STACK_GUARD_H
+
+#include <exception>
+#include <optional>
+#include <system_error>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+// Nesting in the input, like blocks in blocks or calls in call arguments, turns into recursion
+// in the parser and the visitors. Generated code can nest deeper than the native stack allows,
+// so every so many levels the recursion moves to a new thread with a stack of its own,
+// while the thread that was running waits for it. Thread stacks are only touched as they grow,
+// so this stays linear in the depth of the input.
+namespace stack_guard {
+
+// Each level is a handful of frames, which this many levels of leave far from the stack limit
+constexpr unsigned levels_per_stack = 128;
+
+// How deep the recursion is on the stack of this thread
+inline thread_local unsigned depth = 0;
+
+namespace detail {
+struct level {
+    level() noexcept { depth++; }
+    ~level() { depth--; }
+
+    level(const level &) = delete;
+    level & operator=(const level &) = delete;
+};
+
+template<typename Work> auto run_on_new_stack(Work & work) -> decltype(work()) {
+    using result_type = decltype(work());
+
+    std::exception_ptr error{};
+    std::optional<std::conditional_t<std::is_void_v<result_type>, bool, result_type>> result{};
+    try {
+        std::thread{[&] {
+            try {
+                if constexpr (std::is_void_v<result_type>) {
+                    work();
+                    result.emplace(true);
+                } else
+                    result.emplace(work());
+            } catch (...) { error = std::current_exception(); }
+        }}.join();
+    } catch (const std::system_error &) {
+        // No thread to be had, so try the stack that is left
+        return work();
+    }
+
+    if (error != nullptr) std::rethrow_exception(error);
+    if constexpr (not std::is_void_v<result_type>) return std::move(*result);
+}
+} // namespace detail
+
+// Calls work one level deeper into the input
+template<typename Work> auto nested(Work && work) -> decltype(work()) {
+    const detail::level entered{};
+    if (depth % levels_per_stack != 0) return work();
+    return detail::run_on_new_stack(work);
+}
+
+} // namespace stack_guard
+
+#endif // NEW_J_COMPILER_STACK_GUARD_H
@@ -5,12 +5,17 @@
 #ifndef TOKEN_H
 #define TOKEN_H
 
-#include <memory>
+#include "interner.h"
+#include "literal_table.h"
+#include "source_manager.h"
+
+#include <cstdint>
 #include <ostream>
 #include <string>
+#include <string_view>
 #include <variant>
 
-enum struct token_type {
+enum struct token_type : uint8_t {
     Assign,
     Bit_Or,
     Boolean_And,
@@ -53,89 +58,83 @@ enum struct token_type {
     While,
 };
 
+[[nodiscard]] constexpr bool is_op_assign(token_type type) noexcept {
+    switch (type) {
+    case token_type::Mult_Assign:
+    case token_type::Plus_Assign:
+    case token_type::Minus_Assign:
+    case token_type::Assign:
+        return true;
+    default:
+        return false;
+    }
+}
+
 class token final {
   public:
-    using token_data = std::variant<std::monostate, bool, long, double, std::string, token_type>;
-    using source_t = std::shared_ptr<const std::string>;
+    using token_data = std::variant<std::monostate, bool, long, double, symbol, token_type>;
 
-    token(const std::shared_ptr<std::string> & text, size_t position, size_t length,
-          token_type type)
-        : src_text{text}, pos{position}, len{length}, tok_type{type} {}
+    // Identifiers and string literals carry the symbol of their text as payload,
+    // and numeric literals carry the index of their value in the literal_table
+    token(file_id file, size_t position, size_t length, token_type type, uint32_t payload = 0)
+        : file{file}, pos{static_cast<uint32_t>(position)}, len{static_cast<uint32_t>(length)},
+          tok_type{type}, tok_payload{payload} {}
 
     [[nodiscard]] token_data get_data() const {
-        switch (const auto & text = src_text->substr(pos, len); tok_type) {
+        switch (tok_type) {
         case token_type::Identifier:
-            return text;
-        case token_type::Int:
-            if (len < 3) return std::stol(text);
-            else if (tolower(text[1]) == 'x')
-                return std::stol(text, nullptr, 16);
-            else if (tolower(text[1]) == 'b')
-                return std::stol(text, nullptr, 2);
-            else
-                return std::stol(text, nullptr, 10);
         case token_type ::StringLiteral:
-            return text;
+            return name();
+        case token_type::Int:
+            if (const auto * value = std::get_if<long>(&number().value); value != nullptr)
+                return *value;
+            return {};
+        case token_type::Float:
+            if (const auto * value = std::get_if<double>(&number().value); value != nullptr)
+                return *value;
+            return {};
         default:
             return tok_type;
         }
     }
 
     [[nodiscard]] token_type type() const noexcept { return tok_type; }
-    [[nodiscard]] auto start() const noexcept { return pos; }
-    [[nodiscard]] auto end() const noexcept { return pos + len; }
-    [[nodiscard]] source_t src() const noexcept { return src_text; }
-
-    [[nodiscard]] bool op_assign() const noexcept {
-        switch (tok_type) {
-        case token_type::Mult_Assign:
-        case token_type::Plus_Assign:
-        case token_type::Minus_Assign:
-        case token_type::Assign:
-            return true;
-        default:
-            return false;
-        }
+    [[nodiscard]] size_t start() const noexcept { return pos; }
+    [[nodiscard]] size_t end() const noexcept { return pos + len; }
+    [[nodiscard]] file_id src() const noexcept { return file; }
+    [[nodiscard]] symbol name() const noexcept {
+        const auto has_name
+            = tok_type == token_type::Identifier or tok_type == token_type::StringLiteral;
+        return has_name ? symbol{tok_payload} : symbol{};
+    }
+    [[nodiscard]] uint32_t payload() const noexcept { return tok_payload; }
+    // Only for Int and Float tokens
+    [[nodiscard]] const numeric_literal & number() const noexcept {
+        return literal_table::global()[tok_payload];
+    }
+    [[nodiscard]] std::string_view text() const {
+        return source_manager::global().text(file, pos, len);
     }
 
+    [[nodiscard]] bool op_assign() const noexcept { return is_op_assign(tok_type); }
+
   private:
-    std::shared_ptr<const std::string> src_text;
-    size_t pos, len;
+    file_id file;
+    uint32_t pos, len;
     token_type tok_type;
+    uint32_t tok_payload;
 
     friend std::ostream & operator<<(std::ostream & lhs, const token & rhs) {
-
-        size_t line_start = 1;
-        size_t col_start = 0;
-
-        size_t index = 0;
-        while (index < rhs.pos) {
-            if (rhs.src_text->at(index) == '\n') {
-                line_start++;
-                col_start = 0;
-            }
-            index++;
-            col_start++;
-        }
-
-        // now at the start of the token
-        auto line_end = line_start;
-        auto col_end = col_start;
-        while (index < rhs.pos + rhs.len) {
-            if (rhs.src_text->at(index) == '\n') {
-                line_end++;
-                col_end = 0;
-            }
-            index++;
-            col_end++;
-        }
+        const auto & sources = source_manager::global();
+        const auto [line_start, col_start] = sources.locate(rhs.file, rhs.pos);
+        const auto [line_end, col_end] = sources.locate(rhs.file, rhs.pos + rhs.len);
 
         lhs << '[';
         if (line_start == line_end) lhs << line_start << ':' << col_start << '-' << col_end;
         else
             lhs << line_start << ':' << col_start << '-' << line_end << ':' << col_end;
 
-        return lhs << "] " << rhs.src_text->substr(rhs.pos, rhs.len);
+        return lhs << "] " << rhs.text();
     }
 };
 
@@ -0,0 +1,49 @@
+//
+// Created by nick on 10/17/26.
+//
+
+#ifndef NEW_J_COMPILER_TOKEN_BUFFER_H
+#define NEW_J_COMPILER_TOKEN_BUFFER_H
+
+#include "token.h"
+
+#include <cassert>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+// Every token of one file, stored as parallel arrays.
+// The last token is always EndOfFile.
+class token_buffer final {
+  public:
+    explicit token_buffer(file_id file) : file{file} {}
+
+    // The lexer does not lex files whose offsets do not fit
+    void push_back(token_type type, size_t offset, size_t length, uint32_t payload = 0) {
+        assert(offset + length <= std::numeric_limits<uint32_t>::max());
+        types.push_back(type);
+        offsets.push_back(static_cast<uint32_t>(offset));
+        lengths.push_back(static_cast<uint32_t>(length));
+        payloads.push_back(payload);
+    }
+
+    [[nodiscard]] file_id src() const noexcept { return file; }
+    [[nodiscard]] size_t size() const noexcept { return types.size(); }
+    [[nodiscard]] bool empty() const noexcept { return types.empty(); }
+
+    [[nodiscard]] token_type type(size_t index) const noexcept { return types[index]; }
+    [[nodiscard]] token_type back_type() const noexcept { return types.back(); }
+
+    [[nodiscard]] token at(size_t index) const {
+        return {file, offsets[index], lengths[index], types[index], payloads[index]};
+    }
+
+  private:
+    file_id file;
+    std::vector<token_type> types{};
+    std::vector<uint32_t> offsets{};
+    std::vector<uint32_t> lengths{};
+    std::vector<uint32_t> payloads{};
+};
+
+#endif // NEW_J_COMPILER_TOKEN_BUFFER_H
@@ -0,0 +1,132 @@
+//
+// Created by nick on 10/17/26.
+//
+
+#ifndef NEW_J_COMPILER_TREE_BUILDER_H
+#define NEW_J_COMPILER_TREE_BUILDER_H
+
+#include "nodes.h"
+#include "program.h"
+
+#include <memory>
+#include <optional>
+#include <utility>
+
+namespace ast {
+
+// Builds the pointer based ast::program for basic_parser.
+// Every node comes from the arena of the program being built.
+class tree_builder final {
+  public:
+    using expr = ptr<expression>;
+    using stmt = ptr<statement>;
+    using item = ptr<top_level>;
+    using call = ptr<ast::func_call>;
+    using decl = ptr<ast::var_decl>;
+    using typed = ast::opt_typed;
+
+    using params = list<parameter>;
+    using args = list<ptr<expression>>;
+    using stmts = list<ptr<statement>>;
+    using fields = list<std::pair<token, token>>;
+
+    using result = std::unique_ptr<program>;
+
+    // Items can be built on several threads, see worker()
+    static constexpr bool parallel = true;
+
+    tree_builder() = default;
+    // Only builds nodes in the given arena, for parse_slice
+    explicit tree_builder(arena & nodes) noexcept : nodes{&nodes} {}
+
+    void start(file_id) {
+        prog = std::make_unique<program>();
+        nodes = &prog->nodes();
+    }
+    // A builder for another thread, with an arena of its own that belongs to the same program.
+    // It only builds nodes, the items it returns are added with add_item on this builder.
+    [[nodiscard]] tree_builder worker() { return tree_builder{prog->add_arena()}; }
+    [[nodiscard]] result finish() {
+        nodes = nullptr;
+        return std::move(prog);
+    }
+
+    // Converts to whichever list the parser asks for
+    struct list_maker {
+        arena * nodes;
+        template<typename T> operator list<T>() const { return nodes->make_list<T>(); }
+    };
+    [[nodiscard]] list_maker make_list() const noexcept { return {nodes}; }
+
+    template<typename T> void append(list<T> & to, T node) { to.push_back(std::move(node)); }
+    void add_param(params & to, token && name, token && type) {
+        to.emplace_back(std::move(name), std::move(type));
+    }
+    void add_field(fields & to, token && name, token && type) {
+        to.emplace_back(std::move(name), std::move(type));
+    }
+    template<typename T> [[nodiscard]] size_t size(const list<T> & elements) const noexcept {
+        return elements.size();
+    }
+    template<typename T> void clear(list<T> & elements) { elements.clear(); }
+
+    [[nodiscard]] symbol identifier(const item & top) const noexcept { return top->identifier(); }
+    [[nodiscard]] bool add_item(item && top) { return prog->add_item(std::move(top)); }
+
+    [[nodiscard]] bool is_block(const stmt & node) const noexcept {
+        return node != nullptr and node->type() == node_type::statement_block;
+    }
+
+    expr literal_or_variable(token && val) {
+        return nodes->make<ast::literal_or_variable>(std::move(val));
+    }
+    expr bin_op(expr lhs, operation op, expr rhs) {
+        return nodes->make<ast::bin_op>(std::move(lhs), op, std::move(rhs));
+    }
+    call func_call(expr callee, args && arguments) {
+        return nodes->make<ast::func_call>(std::move(callee), std::move(arguments));
+    }
+
+    stmt stmt_block(token && start, stmts && statements, token && end) {
+        auto block = nodes->make<ast::stmt_block>(std::move(start), std::move(statements));
+        block->terminate(std::move(end));
+        return block;
+    }
+    stmt if_stmt(expr condition, stmt then_block, stmt else_block = nullptr) {
+        return nodes->make<ast::if_stmt>(std::move(condition), std::move(then_block),
+                                         std::move(else_block));
+    }
+    stmt while_loop(expr condition, stmt body) {
+        return nodes->make<ast::while_loop>(std::move(condition), std::move(body));
+    }
+    stmt ret_stmt(token && ret, expr value = nullptr) {
+        return nodes->make<ast::ret_stmt>(std::move(ret), std::move(value));
+    }
+    stmt assign_stmt(expr dest, expr value_src, operation op = operation::assign) {
+        return nodes->make<ast::assign_stmt>(std::move(dest), std::move(value_src), op);
+    }
+
+    typed opt_typed(token && identifier, std::optional<token> && type = {}) {
+        return ast::opt_typed{std::move(identifier), std::move(type)};
+    }
+    decl var_decl(typed && name, expr value, ast::var_decl::details detail) {
+        return nodes->make<ast::var_decl>(std::move(name), std::move(value), detail);
+    }
+    item function(token && name, params && parameters, std::optional<token> && return_type,
+                  stmt body) {
+        return nodes->make<ast::function>(std::move(name), std::move(parameters),
+                                          std::move(return_type), std::move(body));
+    }
+    item struct_decl(token && name, fields && members) {
+        return nodes->make<ast::struct_decl>(std::move(name), std::move(members));
+    }
+
+  private:
+    std::unique_ptr<program> prog{};
+    // Owned by prog
+    arena * nodes = nullptr;
+};
+
+} // namespace ast
+
+#endif // NEW_J_COMPILER_TREE_BUILDER_H
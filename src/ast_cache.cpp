@@ -0,0 +1,596 @@
+//
+// Created by nick on 10/17/26.
+//
+
+#include "ast_cache.h"
+
+#include "ast/diagnostics.h"
+#include "ast/literal_table.h"
+#include "ast/nodes.h"
+#include "ast/source_buffer.h"
+#include "ast/tree_builder.h"
+#include "visitor.h"
+
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <random>
+#include <sstream>
+#include <string_view>
+#include <system_error>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+// Records are tagged with their node_type, or with this for a missing child
+constexpr uint8_t null_record = 0xFF;
+
+// Tokens store their length and type in one word
+constexpr uint32_t max_token_length = (1u << 24u) - 1;
+
+// The length and hash of the text, a hash of the rest of the entry,
+// then the number of symbols and of node words
+constexpr size_t header_words = 8;
+constexpr size_t checked_from = 6;
+
+uint64_t hash_text(std::string_view text) { return std::hash<std::string_view>{}(text); }
+
+uint32_t read_u32(const uint8_t * bytes) {
+    uint32_t to_ret = 0;
+    for (auto i = 0u; i < sizeof(uint32_t); i++) to_ret |= uint32_t{bytes[i]} << i * 8u;
+    return to_ret;
+}
+
+// Visits the items of a program and writes the records of their nodes.
+// A record follows the records of its children, so reading them back only needs a stack.
+//
+// The first word of a record is the tag, with flags in the second byte and a detail
+// in the third. Then come the number of children in a list, if the node has one,
+// and the tokens of the node, each as its offset, its length and type, and its payload.
+// The payload of an identifier or string literal is its index in the symbol table,
+// other tokens do not need one.
+class record_writer final : public visitor<record_writer> {
+  public:
+    using visitor::visit;
+    void visit(const ast::function &);
+    void visit(const ast::var_decl &);
+    void visit(const ast::struct_decl &);
+    void visit(const ast::stmt_block &);
+    void visit(const ast::if_stmt &);
+    void visit(const ast::while_loop &);
+    void visit(const ast::ret_stmt &);
+    void visit(const ast::assign_stmt &);
+    void visit(const ast::func_call &);
+    void visit(const ast::literal_or_variable &);
+    void visit(const ast::bin_op &);
+
+    // Set if some node cannot be written, in which case the words are incomplete
+    [[nodiscard]] bool failed() const noexcept { return not complete; }
+    [[nodiscard]] const std::vector<uint32_t> & words() const noexcept { return records; }
+    [[nodiscard]] const std::vector<symbol> & symbol_table() const noexcept { return symbols; }
+
+  private:
+    void record(ast::node_type tag, uint32_t flags = 0, uint32_t detail = 0) {
+        records.push_back(static_cast<uint32_t>(tag) | flags << 8u | detail << 16u);
+    }
+    void null() { records.push_back(null_record); }
+    void write(const token & tok);
+
+    bool complete = true;
+    std::vector<uint32_t> records{};
+    std::vector<symbol> symbols{};
+    std::unordered_map<symbol, uint32_t> symbol_index{};
+};
+
+void record_writer::write(const token & tok) {
+    if (tok.end() - tok.start() > max_token_length) complete = false;
+
+    uint32_t payload = 0;
+    if (tok.type() == token_type::Identifier or tok.type() == token_type::StringLiteral) {
+        const auto [iter, added] = symbol_index.try_emplace(tok.name(), symbols.size());
+        if (added) symbols.push_back(tok.name());
+        payload = iter->second;
+    }
+
+    records.push_back(static_cast<uint32_t>(tok.start()));
+    records.push_back(static_cast<uint32_t>(tok.end() - tok.start()) << 8u
+                      | static_cast<uint32_t>(tok.type()));
+    records.push_back(payload);
+}
+
+void record_writer::visit(const ast::function & func) {
+    if (func.body == nullptr) null();
+    else
+        visit(*func.body);
+
+    const auto has_return = func.name.user_explicit();
+    record(ast::node_type::function, has_return);
+    records.push_back(static_cast<uint32_t>(func.params.size()));
+    write(func.name.identifier_token());
+    if (has_return) write(func.name.type_data());
+    for (const auto & param : func.params) {
+        write(param.name);
+        write(param.val_type);
+    }
+}
+
+void record_writer::visit(const ast::var_decl & decl) {
+    visit(decl.value_expr());
+
+    const auto has_type = decl.name.user_explicit();
+    record(ast::node_type::var_decl, has_type, static_cast<uint32_t>(decl.detail));
+    write(decl.name.identifier_token());
+    if (has_type) write(decl.name.type_data());
+}
+
+void record_writer::visit(const ast::struct_decl & decl) {
+    record(ast::node_type::struct_decl);
+    records.push_back(static_cast<uint32_t>(decl.fields.size()));
+    write(decl.name);
+    for (const auto & [name, type] : decl.fields) {
+        write(name);
+        write(type);
+    }
+}
+
+void record_writer::visit(const ast::stmt_block & block) {
+    for (const auto & stmt : block.stmts) visit(*stmt);
+
+    // The parser always closes a block it builds
+    if (not block.end.has_value()) complete = false;
+    record(ast::node_type::statement_block);
+    records.push_back(static_cast<uint32_t>(block.stmts.size()));
+    write(block.start);
+    write(block.end.value_or(block.start));
+}
+
+void record_writer::visit(const ast::if_stmt & if_stmt) {
+    visit(*if_stmt.cond);
+    visit(*if_stmt.then_block);
+    if (if_stmt.else_block != nullptr) visit(*if_stmt.else_block);
+    record(ast::node_type::if_statement, if_stmt.else_block != nullptr);
+}
+
+void record_writer::visit(const ast::while_loop & while_loop) {
+    visit(*while_loop.condition);
+    visit(*while_loop.body);
+    record(ast::node_type::while_loop);
+}
+
+void record_writer::visit(const ast::ret_stmt & ret_stmt) {
+    if (ret_stmt.value != nullptr) visit(*ret_stmt.value);
+    record(ast::node_type::return_statement, ret_stmt.value != nullptr);
+    write(ret_stmt.ret);
+}
+
+void record_writer::visit(const ast::assign_stmt & assign) {
+    visit(*assign.dest);
+    visit(*assign.value_src);
+    record(ast::node_type::assign_statement, 0, static_cast<uint32_t>(assign.assign_op));
+}
+
+void record_writer::visit(const ast::func_call & call) {
+    visit(*call.func_name);
+    for (const auto & arg : call.arguments) visit(*arg);
+    record(ast::node_type::func_call);
+    records.push_back(static_cast<uint32_t>(call.arguments.size()));
+}
+
+void record_writer::visit(const ast::literal_or_variable & value) {
+    record(ast::node_type::value);
+    write(value.val);
+}
+
+void record_writer::visit(const ast::bin_op & bin_op) {
+    // Without recursion along operator chains, like printing_visitor.
+    // An operator is written once both of its operands are.
+    std::vector<std::pair<const ast::expression *, bool /* operands written */>> pending{
+        {&bin_op, false}};
+    while (not pending.empty()) {
+        const auto [expr, operands_written] = pending.back();
+        pending.pop_back();
+        if (expr->type() != ast::node_type::binary_op) {
+            visit(*expr);
+            continue;
+        }
+
+        const auto & op = static_cast<const ast::bin_op &>(*expr);
+        if (operands_written) {
+            record(ast::node_type::binary_op, 0, static_cast<uint32_t>(op.oper()));
+            continue;
+        }
+        pending.emplace_back(&op, true);
+        pending.emplace_back(&op.rhs_ref(), false);
+        pending.emplace_back(&op.lhs_ref(), false);
+    }
+}
+
+// Rebuilds a program from the records of record_writer with an ast::tree_builder.
+// Anything out of place marks the entry as damaged instead of being trusted.
+class record_reader final {
+  public:
+    record_reader(const uint8_t * words, size_t word_count, file_id file,
+                  std::vector<symbol> && symbols)
+        : words{words}, word_count{word_count}, file{file}, symbols{std::move(symbols)},
+          text_size{source_manager::global().buffer(file).size()} {}
+
+    // Returns nullptr if the records are damaged
+    [[nodiscard]] std::unique_ptr<ast::program> read();
+
+  private:
+    // A node that was read and waits for its parent
+    struct built {
+        bool present = false;
+        // Whichever of these the node can be used as
+        ast::expression * expr = nullptr;
+        ast::statement * stmt = nullptr;
+        ast::top_level * item = nullptr;
+    };
+
+    uint32_t next_word();
+    token next_token();
+    std::optional<token> next_token_if(bool present);
+
+    built pop();
+    ast::tree_builder::expr pop_expr(bool required = true);
+    ast::tree_builder::stmt pop_stmt(bool required = true);
+    // Checks that a list of count nodes is on the stack
+    bool has_list(uint32_t count);
+
+    void read_record(uint32_t first_word);
+
+    const uint8_t * words;
+    size_t word_count;
+    size_t position = 0;
+
+    file_id file;
+    std::vector<symbol> symbols;
+    size_t text_size;
+
+    ast::tree_builder nodes{};
+    std::vector<built> stack{};
+    bool damaged = false;
+};
+
+uint32_t record_reader::next_word() {
+    if (position >= word_count) {
+        damaged = true;
+        return 0;
+    }
+    return read_u32(words + sizeof(uint32_t) * position++);
+}
+
+token record_reader::next_token() {
+    const auto start = next_word();
+    const auto length_and_type = next_word();
+    auto payload = next_word();
+
+    const auto length = length_and_type >> 8u;
+    const auto type = static_cast<token_type>(length_and_type & 0xFFu);
+    if (static_cast<uint8_t>(type) > static_cast<uint8_t>(token_type::While)
+        or size_t{start} + length > text_size) {
+        damaged = true;
+        return {file, 0, 0, token_type::EndOfFile};
+    }
+
+    switch (type) {
+    case token_type::Identifier:
+    case token_type::StringLiteral:
+        if (payload >= symbols.size()) damaged = true;
+        else
+            payload = static_cast<uint32_t>(symbols[payload]);
+        break;
+    case token_type::Int:
+    case token_type::Float: {
+        // Decoding the literal again is as cheap as storing its value
+        const auto text = source_manager::global().text(file, start, length);
+        auto & literals = literal_table::global();
+        payload = type == token_type::Int ? literals.add_integer(text) : literals.add_float(text);
+    } break;
+    default:
+        payload = 0;
+    }
+
+    return {file, start, length, type, payload};
+}
+
+std::optional<token> record_reader::next_token_if(bool present) {
+    if (not present) return {};
+    return next_token();
+}
+
+record_reader::built record_reader::pop() {
+    if (stack.empty()) {
+        damaged = true;
+        return {};
+    }
+    const auto to_ret = stack.back();
+    stack.pop_back();
+    return to_ret;
+}
+
+ast::tree_builder::expr record_reader::pop_expr(bool required) {
+    const auto node = pop();
+    if (node.present ? node.expr == nullptr : required) damaged = true;
+    return ast::tree_builder::expr{node.expr};
+}
+
+ast::tree_builder::stmt record_reader::pop_stmt(bool required) {
+    const auto node = pop();
+    if (node.present ? node.stmt == nullptr : required) damaged = true;
+    return ast::tree_builder::stmt{node.stmt};
+}
+
+bool record_reader::has_list(uint32_t count) {
+    if (count > stack.size()) damaged = true;
+    return not damaged;
+}
+
+std::unique_ptr<ast::program> record_reader::read() {
+    nodes.start(file);
+    while (position < word_count and not damaged) read_record(next_word());
+
+    for (auto & node : stack) {
+        if (node.item == nullptr) damaged = true;
+        if (damaged) break;
+        if (not nodes.add_item(ast::tree_builder::item{node.item})) damaged = true;
+    }
+
+    auto program = nodes.finish();
+    if (damaged) return nullptr;
+    return program;
+}
+
+void record_reader::read_record(uint32_t first_word) {
+    const auto tag = static_cast<uint8_t>(first_word & 0xFFu);
+    const auto flags = (first_word >> 8u) & 0xFFu;
+    const auto detail = (first_word >> 16u) & 0xFFu;
+
+    if (tag == null_record) {
+        stack.push_back({});
+        return;
+    }
+
+    switch (static_cast<ast::node_type>(tag)) {
+    case ast::node_type::value: {
+        auto value = nodes.literal_or_variable(next_token());
+        stack.push_back({true, value.release()});
+    } break;
+    case ast::node_type::binary_op: {
+        if (detail > static_cast<uint32_t>(ast::operation::sub)) damaged = true;
+        auto rhs = pop_expr();
+        auto lhs = pop_expr();
+        auto op = nodes.bin_op(std::move(lhs), static_cast<ast::operation>(detail), std::move(rhs));
+        stack.push_back({true, op.release()});
+    } break;
+    case ast::node_type::func_call: {
+        const auto count = next_word();
+        if (not has_list(count + 1)) return;
+
+        ast::tree_builder::args arguments = nodes.make_list();
+        arguments.reserve(count);
+        for (auto i = stack.size() - count; i < stack.size(); i++) {
+            if (not stack[i].present or stack[i].expr == nullptr) damaged = true;
+            nodes.append(arguments, ast::tree_builder::expr{stack[i].expr});
+        }
+        stack.resize(stack.size() - count);
+
+        auto call = nodes.func_call(pop_expr(), std::move(arguments));
+        auto * node = call.release();
+        stack.push_back({true, node, node});
+    } break;
+    case ast::node_type::statement_block: {
+        const auto count = next_word();
+        auto start = next_token();
+        auto end = next_token();
+        if (not has_list(count)) return;
+
+        ast::tree_builder::stmts statements = nodes.make_list();
+        statements.reserve(count);
+        for (auto i = stack.size() - count; i < stack.size(); i++) {
+            if (not stack[i].present or stack[i].stmt == nullptr) damaged = true;
+            nodes.append(statements, ast::tree_builder::stmt{stack[i].stmt});
+        }
+        stack.resize(stack.size() - count);
+
+        auto block = nodes.stmt_block(std::move(start), std::move(statements), std::move(end));
+        stack.push_back({true, nullptr, block.release()});
+    } break;
+    case ast::node_type::if_statement: {
+        auto else_block = flags != 0 ? pop_stmt() : nullptr;
+        auto then_block = pop_stmt();
+        auto cond = pop_expr();
+        auto node = nodes.if_stmt(std::move(cond), std::move(then_block), std::move(else_block));
+        stack.push_back({true, nullptr, node.release()});
+    } break;
+    case ast::node_type::while_loop: {
+        auto body = pop_stmt();
+        auto cond = pop_expr();
+        auto node = nodes.while_loop(std::move(cond), std::move(body));
+        stack.push_back({true, nullptr, node.release()});
+    } break;
+    case ast::node_type::return_statement: {
+        auto value = flags != 0 ? pop_expr() : nullptr;
+        auto node = nodes.ret_stmt(next_token(), std::move(value));
+        stack.push_back({true, nullptr, node.release()});
+    } break;
+    case ast::node_type::assign_statement: {
+        if (detail > static_cast<uint32_t>(ast::operation::sub)) damaged = true;
+        auto value_src = pop_expr();
+        auto dest = pop_expr();
+        auto node = nodes.assign_stmt(std::move(dest), std::move(value_src),
+                                      static_cast<ast::operation>(detail));
+        stack.push_back({true, nullptr, node.release()});
+    } break;
+    case ast::node_type::var_decl: {
+        if (detail > static_cast<uint32_t>(ast::var_decl::details::GlobalConst)) damaged = true;
+        auto name = next_token();
+        auto type = next_token_if(flags != 0);
+        auto decl = nodes.var_decl(nodes.opt_typed(std::move(name), std::move(type)), pop_expr(),
+                                   static_cast<ast::var_decl::details>(detail));
+        auto * node = decl.release();
+        stack.push_back({true, nullptr, node, node});
+    } break;
+    case ast::node_type::function: {
+        const auto count = next_word();
+        auto name = next_token();
+        auto return_type = next_token_if(flags != 0);
+        ast::tree_builder::params parameters = nodes.make_list();
+        for (uint32_t i = 0; i < count and not damaged; i++) {
+            auto param_name = next_token();
+            nodes.add_param(parameters, std::move(param_name), next_token());
+        }
+
+        auto func = nodes.function(std::move(name), std::move(parameters),
+                                   std::move(return_type), pop_stmt(false));
+        stack.push_back({true, nullptr, nullptr, func.release()});
+    } break;
+    case ast::node_type::struct_decl: {
+        const auto count = next_word();
+        auto name = next_token();
+        ast::tree_builder::fields fields = nodes.make_list();
+        for (uint32_t i = 0; i < count and not damaged; i++) {
+            auto field_name = next_token();
+            nodes.add_field(fields, std::move(field_name), next_token());
+        }
+
+        auto decl = nodes.struct_decl(std::move(name), std::move(fields));
+        stack.push_back({true, nullptr, nullptr, decl.release()});
+    } break;
+    default:
+        damaged = true;
+    }
+}
+} // namespace
+
+std::string ast_cache::entry_name(uint64_t text_hash) const {
+    std::ostringstream name;
+    name << directory << '/' << std::hex << std::setw(16) << std::setfill('0') << text_hash
+         << ".ast";
+    return name.str();
+}
+
+std::unique_ptr<ast::program> ast_cache::load(file_id file) const {
+    const auto text = source_manager::global().buffer(file).text();
+    const auto text_hash = hash_text(text);
+
+    const auto name = entry_name(text_hash);
+    const auto entry = source_buffer::open(name);
+    if (entry == nullptr) return nullptr;
+
+    const auto * bytes = reinterpret_cast<const uint8_t *>(entry->text().data());
+    const auto size = entry->size();
+    const auto word_at = [bytes](size_t index) { return read_u32(bytes + 4 + 4 * index); };
+    const auto double_word_at = [&word_at](size_t index) {
+        return word_at(index) | uint64_t{word_at(index + 1)} << 32u;
+    };
+
+    if (size < 4 + 4 * header_words or bytes[0] != 'N' or bytes[1] != 'J' or bytes[2] != 'A') {
+        diag::note() << "Ignoring " << name << ", it is not a syntax tree";
+        return nullptr;
+    }
+    if (bytes[3] != format_version) {
+        diag::note() << "Ignoring " << name << ", it was written by another version";
+        return nullptr;
+    }
+    // Different texts with the same hash
+    if (double_word_at(0) != text.size() or double_word_at(2) != text_hash) return nullptr;
+
+    // A tree that is only slightly off could still be read, and then trip up code generation
+    const auto * checked = reinterpret_cast<const char *>(bytes + 4 + 4 * checked_from);
+    if (double_word_at(4) != hash_text({checked, size - 4 - 4 * checked_from})) {
+        diag::note() << "Ignoring " << name << ", it is damaged";
+        return nullptr;
+    }
+
+    const auto word_count = (size - 4) / 4;
+    auto position = header_words;
+    const auto symbol_count = word_at(6);
+    const auto node_words = word_at(7);
+
+    std::vector<symbol> symbols;
+    symbols.reserve(symbol_count);
+    for (uint32_t i = 0; i < symbol_count; i++) {
+        if (position >= word_count) break;
+        const auto length = word_at(position++);
+        const auto padded_words = (size_t{length} + 3) / 4;
+        if (padded_words > word_count - position) break;
+
+        const auto * chars = reinterpret_cast<const char *>(bytes + 4 + 4 * position);
+        symbols.push_back(intern({chars, length}));
+        position += padded_words;
+    }
+
+    if (symbols.size() != symbol_count or word_count - position != node_words) {
+        diag::note() << "Ignoring " << name << ", it is truncated";
+        return nullptr;
+    }
+
+    auto program = record_reader{bytes + 4 + 4 * position, node_words, file, std::move(symbols)}
+                       .read();
+    if (program == nullptr) diag::note() << "Ignoring " << name << ", it is damaged";
+    return program;
+}
+
+bool ast_cache::store(file_id file, const ast::program & tree) const {
+    record_writer writer{};
+    tree.visit([&writer](const ast::top_level & item) { writer.visit(item); });
+    if (writer.failed()) return false;
+
+    const auto text = source_manager::global().buffer(file).text();
+    const auto text_hash = hash_text(text);
+
+    std::vector<uint8_t> bytes{'N', 'J', 'A', format_version};
+    const auto push_word = [&bytes](uint32_t word) {
+        for (auto i = 0u; i < sizeof(uint32_t); i++) bytes.push_back((word >> i * 8u) & 0xFFu);
+    };
+    const auto push_double_word = [&push_word](uint64_t word) {
+        push_word(static_cast<uint32_t>(word));
+        push_word(static_cast<uint32_t>(word >> 32u));
+    };
+
+    push_double_word(text.size());
+    push_double_word(text_hash);
+    // The hash of the rest goes here once it is written
+    push_double_word(0);
+    push_word(static_cast<uint32_t>(writer.symbol_table().size()));
+    push_word(static_cast<uint32_t>(writer.words().size()));
+
+    for (const auto sym : writer.symbol_table()) {
+        const auto name = text_of(sym);
+        push_word(static_cast<uint32_t>(name.size()));
+        bytes.insert(bytes.end(), name.begin(), name.end());
+        bytes.resize(bytes.size() + (4 - name.size() % 4) % 4, 0);
+    }
+    bytes.reserve(bytes.size() + 4 * writer.words().size());
+    for (const auto word : writer.words()) push_word(word);
+
+    const auto * checked = reinterpret_cast<const char *>(bytes.data() + 4 + 4 * checked_from);
+    const auto checksum = hash_text({checked, bytes.size() - 4 - 4 * checked_from});
+    for (auto i = 0u; i < sizeof(uint64_t); i++)
+        bytes[4 + 4 * 4 + i] = (checksum >> i * 8u) & 0xFFu;
+
+    std::error_code error;
+    std::filesystem::create_directories(directory, error);
+    if (error) return false;
+
+    // Written beside the entry and then moved over it,
+    // so nobody compiling the same text at the same time maps half of an entry
+    const auto name = entry_name(text_hash);
+    const auto temporary = name + '.' + std::to_string(std::random_device{}());
+    {
+        std::ofstream output{temporary, std::ios::binary | std::ios::out};
+        output.write(reinterpret_cast<const char *>(bytes.data()),
+                     static_cast<std::streamsize>(bytes.size()));
+        if (not output) error = std::make_error_code(std::errc::io_error);
+    }
+
+    if (not error) std::filesystem::rename(temporary, name, error);
+    if (error) {
+        std::filesystem::remove(temporary, error);
+        return false;
+    }
+    return true;
+}
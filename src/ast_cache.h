@@ -0,0 +1,44 @@
+//
+// Created by nick on 10/17/26.
+//
+
+#ifndef NEW_J_COMPILER_AST_CACHE_H
+#define NEW_J_COMPILER_AST_CACHE_H
+
+#include "ast/program.h"
+#include "ast/source_manager.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+// Keeps the syntax trees of parsed files in a directory, one file per tree,
+// named after a hash of the source text. A file whose text was parsed before
+// is loaded from there instead of being lexed and parsed again.
+//
+// An entry starts with 'N', 'J', 'A' and the format version, followed by little endian
+// 32 bit words: the length and hash of the source text, a checksum of the rest,
+// the symbols the tree uses, and the nodes in postfix order. Tokens keep their offsets
+// into the source text, so the text itself is not stored, and neither are the values
+// of numeric literals.
+// Entries are memory mapped when they are loaded.
+class ast_cache final {
+  public:
+    // Bump whenever the layout of an entry or the shape of the tree changes
+    static constexpr uint8_t format_version = 1;
+
+    explicit ast_cache(std::string directory) : directory{std::move(directory)} {}
+
+    // Returns nullptr if there is no usable entry for the text of the file
+    [[nodiscard]] std::unique_ptr<ast::program> load(file_id file) const;
+    // Only trees parsed without errors should be stored.
+    // Returns false if the entry could not be written.
+    bool store(file_id file, const ast::program & tree) const;
+
+  private:
+    [[nodiscard]] std::string entry_name(uint64_t text_hash) const;
+
+    std::string directory;
+};
+
+#endif // NEW_J_COMPILER_AST_CACHE_H
@@ -4,10 +4,15 @@
 
 #include "bytecode.h"
 
+#include "ast/diagnostics.h"
+
+#include <algorithm>
+#include <array>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
 #include <set>
+#include <stdexcept>
 
 namespace bytecode {
 
@@ -26,28 +31,28 @@ std::pair<std::optional<operation>, operation> load_64_bits(uint8_t dest, uint64
                                                            val & mask_low_32_bit)};
     return std::make_pair(first, second);
 }
-operation program::print(const ir::three_address & inst,
-                         const std::map<std::string, register_info> & reg_info) {
+operation program::print(const ir::three_address & inst, const register_map & reg_info,
+                         const ir::function & func) {
     auto print_val = inst.inputs().back();
     switch (static_cast<ir::ir_type>(*print_val.type)) {
     case ir::ir_type::i32:
-        if (not print_val.is_immediate) {
-            auto name = std::get<std::string>(print_val.data);
+        if (not print_val.is_immediate()) {
             append_instruction(opcode::ori, make_reg_with_imm(1, 0, 1));
-            return {opcode::syscall, make_reg_with_imm(1, reg_info.at(name).reg_num, 1)};
+            const auto reg = register_of(reg_info, print_val).reg_num;
+            return {opcode::syscall, make_reg_with_imm(1, reg, 1)};
         } else {
-            auto value = std::get<long>(print_val.data);
+            auto value = print_val.integer();
             append_instruction(opcode::ori, make_reg_with_imm(1, 0, 1));
             append_instruction(opcode::ori, make_reg_with_imm(2, 0, value));
             return {opcode::syscall, make_reg_with_imm(1, 2, 1)};
         }
     case ir::ir_type::i64:
-        if (not print_val.is_immediate) {
-            auto name = std::get<std::string>(print_val.data);
+        if (not print_val.is_immediate()) {
             append_instruction(opcode::ori, make_reg_with_imm(1, 0, 5));
-            return {opcode::syscall, make_reg_with_imm(1, reg_info.at(name).reg_num, 1)};
+            const auto reg = register_of(reg_info, print_val).reg_num;
+            return {opcode::syscall, make_reg_with_imm(1, reg, 1)};
         } else {
-            auto value = std::get<long>(print_val.data);
+            auto value = print_val.integer();
             append_instruction(opcode::ori, make_reg_with_imm(1, 0, 5));
 
             auto [first, second] = load_64_bits(2, value);
@@ -57,115 +62,181 @@ operation program::print(const ir::three_address & inst,
             return {opcode::syscall, make_reg_with_imm(1, 2, 1)};
         }
     case ir::ir_type::str:
-        if (print_val.is_immediate) {
-            auto str_ptr = append_data(std::get<std::string>(print_val.data));
+        if (print_val.is_immediate()) {
+            auto str_ptr = append_data(text_of(print_val.name()));
             auto [first, second] = load_64_bits(2, str_ptr);
 
             append_instruction(opcode::ori, make_reg_with_imm(1, 0, 4));
             if (first.has_value()) append_instruction(std::move(*first));
+            data_refs.push_back(text_end);
             append_instruction(std::move(second));
         } else {
-            std::cerr << "Tried to print string " << print_val << std::endl;
+            diag::error() << "Tried to print string " << func.named(print_val);
         }
         return {opcode::syscall, make_reg_with_imm(1, 2, 1)};
     default:
-        std::cerr << "Cannot print " << print_val << std::endl;
+        diag::error() << "Cannot print " << func.named(print_val);
         return {opcode::add, std::array<uint8_t, 3>{0, 0, 0}};
     }
 }
 
+std::string output_filename(std::string input_filename) {
+    if (input_filename == "-") return "a.bin";
+
+    // Delete everything after the dot
+    if (auto dot = input_filename.find_last_of('.'); dot != std::string::npos)
+        input_filename.erase(dot);
+    return input_filename + ".bin";
+}
+
 std::optional<program> program::from_ir(const ir::program & input) {
 
-    auto * main_func = input.lookup_function("main");
+    auto * main_func = input.lookup_function(intern("main"));
     if (main_func == nullptr) return {};
 
-    bytecode::program output{};
-    output.generate_bytecode(*main_func);
-
-    input.for_each_func([&output, main_func](auto * func) {
-        if (func != nullptr and func != main_func) output.generate_bytecode(*func);
+    std::vector<program> functions;
+    functions.push_back(from_function(*main_func));
+    input.for_each_func([&functions, main_func](auto * func) {
+        if (func != nullptr and func != main_func) functions.push_back(from_function(*func));
     });
 
+    std::vector<const program *> order;
+    for (const auto & function : functions) order.push_back(&function);
+    return link(order);
+}
+
+program program::from_function(const ir::function & function) {
+    program output{};
+    output.generate_bytecode(function);
+    output.function_name = function.name;
     return output;
 }
 
-constexpr uint8_t return_value_start = 10;
-constexpr uint8_t param_start = 13;
-constexpr uint8_t param_end = 19;
-constexpr auto max_inputs = (param_end - param_start) + 1;
-constexpr uint8_t temp_start = 20;
-constexpr uint8_t stack_pointer = 61;
-constexpr auto temp_end = stack_pointer;
-constexpr uint8_t frame_pointer = 62;
-constexpr uint8_t return_address = 63;
+program program::link(const std::vector<const program *> & functions) {
+    program output{};
+
+    std::unordered_map<symbol, uint64_t> entry_points;
+    std::vector<std::pair<size_t, symbol>> calls;
+    for (const auto * function : functions) {
+        const auto text_offset = output.text_end - pc_start;
+        const auto data_offset = output.data.size();
+        const auto first = output.bytecode.size();
+
+        output.bytecode.insert(output.bytecode.end(), function->bytecode.begin(),
+                               function->bytecode.end());
+        output.data.insert(output.data.end(), function->data.begin(), function->data.end());
+
+        // Functions that could not be generated have no label
+        if (function->labels.count(function->function_name) != 0)
+            entry_points.emplace(function->function_name, output.text_end);
+        output.text_end += function->text_end - pc_start;
+
+        for (const auto & [label, address] : function->labels)
+            output.labels.emplace(label, address + text_offset);
+        // Never defined within the function, so they stay unresolved
+        for (const auto & [label, uses] : function->label_queue)
+            for (const auto & [location, absolute] : uses)
+                output.label_queue[label].emplace_back(location + text_offset, absolute);
+        for (const auto & [location, callee] : function->calls)
+            calls.emplace_back(location + text_offset, callee);
+
+        for (const auto location : function->text_refs) {
+            auto & inst = output.bytecode.at(first + (location - pc_start) / 8);
+            std::get<uint64_t>(inst.data) += text_offset >> 3u;
+            output.text_refs.push_back(location + text_offset);
+        }
+        for (const auto location : function->data_refs) {
+            // Data addresses always fit in the immediate of a single ori
+            auto & inst = output.bytecode.at(first + (location - pc_start) / 8);
+            std::get<operation::reg_with_imm>(inst.data).immediate += data_offset;
+            output.data_refs.push_back(location + text_offset);
+        }
+    }
+
+    for (const auto & [location, callee] : calls) {
+        auto & inst = output.bytecode.at((location - pc_start) / 8);
+        if (auto entry = entry_points.find(callee); entry != entry_points.end()) {
+            inst.data = entry->second >> 3u;
+            output.text_refs.push_back(location);
+        } else
+            output.calls.emplace_back(location, callee);
+    }
+
+    return output;
+}
 
 void program::generate_bytecode(const ir::function & function) {
 
     assign_label(function.name, text_end);
 
-    std::map<std::string, register_info> register_alloc;
+    register_map register_alloc(function.value_count());
+    // How many operands are in each register, so finding a free one does not look at all of them
+    std::array<size_t, UINT8_MAX + 1> register_uses{};
     auto register_for_operand = [&register_alloc](const ir::operand & operand) -> register_info & {
-        return register_alloc.at(std::get<std::string>(operand.data));
+        return register_of(register_alloc, operand);
     };
 
-    auto allocate_register
-        = [&register_alloc](const ir::operand & operand, size_t instruction) -> void {
-        std::set<uint8_t> used_registers;
-        for (const auto & entry : register_alloc) used_registers.insert(entry.second.reg_num);
-
+    auto allocate_register = [&register_alloc, &register_uses](const ir::operand & operand,
+                                                               size_t instruction) -> void {
+        // The first register from temp_start on that is not in use
         uint8_t last_reg = temp_start;
-        // Should loop in a sorted order
-        for (const auto & reg : used_registers)
-            if (reg == last_reg) last_reg++;
-            else if (reg > last_reg)
-                break;
+        while (register_uses[last_reg] != 0 and last_reg < UINT8_MAX) last_reg++;
 
-        if (last_reg >= temp_end) { std::cerr << "Too many temporaries" << std::endl; }
+        if (last_reg >= temp_end) { diag::error() << "Too many temporaries"; }
 
-        const auto & ir_name = std::get<std::string>(operand.data);
-        if (auto iter = register_alloc.find(ir_name); iter != register_alloc.end()) {
-            iter->second.writes.push_back(instruction);
+        if (auto & allocated = register_alloc.at(static_cast<size_t>(operand.value()));
+            allocated.has_value()) {
+            allocated->writes.push_back(instruction);
         } else {
-            register_alloc.insert(iter,
-                                  std::make_pair(ir_name, register_info{last_reg, instruction}));
+            allocated.emplace(last_reg, instruction);
+            register_uses[last_reg]++;
         }
     };
 
     // Parameters start at 13 and end at 19
     if (uint8_t param_num = 13; function.parameters().size() <= max_inputs)
-        for (auto & param : function.parameters())
-            register_alloc.insert_or_assign(std::get<std::string>(param.data),
-                                            register_info{param_num++, 0});
+        for (auto & param : function.parameters()) {
+            auto & allocated = register_alloc.at(static_cast<size_t>(param.value()));
+            // A later parameter with the same name takes over
+            if (allocated.has_value()) register_uses[allocated->reg_num]--;
+            allocated.emplace(param_num, 0);
+            register_uses[param_num++]++;
+        }
     else {
         // Too many parameters were declared
-        std::cerr << "Function " << function.name << " has more than " << max_inputs
-                  << " parameters.\n"
-                     "Currently, "
-                  << function.parameters().size() << " parameter functions are not supported.\n";
+        diag::error() << "Function " << function.name << " has more than " << max_inputs
+                      << " parameters. Currently, " << function.parameters().size()
+                      << " parameter functions are not supported.";
         labels.erase(function.name);
         return;
     }
 
     // Preallocate registers
+    std::vector<size_t> call_positions;
     auto ir_inst_num = 0u;
-    for (auto & block : function.body) {
-        for (const auto & inst : block->contents) {
+    for (const auto & block : function.blocks()) {
+        for (const auto & inst : block.instructions) {
+            if (inst.op == ir::operation::call) call_positions.push_back(ir_inst_num);
+
             if (auto res = inst.result(); inst.op == ir::operation::phi) {
                 uint8_t phi_register = UINT8_MAX;
                 for (const auto & op : inst.inputs())
                     phi_register = std::min(phi_register, register_for_operand(op).reg_num);
 
-                for (auto & operand : inst.operands)
-                    register_for_operand(operand).reg_num = phi_register;
+                for (auto & operand : inst.operands) {
+                    auto & reg_num = register_for_operand(operand).reg_num;
+                    register_uses[reg_num]--;
+                    register_uses[phi_register]++;
+                    reg_num = phi_register;
+                }
 
             } else if (res.has_value())
                 allocate_register(res.value(), ir_inst_num);
 
             for (auto & input : inst.inputs()) {
-                if (not input.is_immediate and *input.type != ir::ir_type::str) {
+                if (not input.is_immediate() and *input.type != ir::ir_type::str) {
                     // Either a user defined variable or compiler temporary
-                    auto name = std::get<std::string>(input.data);
-                    register_alloc.at(name).reads.push_back(ir_inst_num);
+                    register_for_operand(input).reads.push_back(ir_inst_num);
                 }
             }
 
@@ -173,27 +244,57 @@ void program::generate_bytecode(const ir::function & function) {
         }
     }
 
+    // A register is saved around a call if it was written before and is read after it.
+    // Writes and reads are in order, so only the calls in between have to be looked at.
+    live_across_calls.clear();
+    for (const auto & allocated : register_alloc) {
+        if (not allocated.has_value()) continue;
+        const auto & reg_info = *allocated;
+        if (reg_info.writes.empty() or reg_info.reads.empty()) continue;
+
+        auto call = std::upper_bound(call_positions.begin(), call_positions.end(),
+                                     reg_info.writes.front());
+        auto write = reg_info.writes.begin();
+        for (; call != call_positions.end() and *call < reg_info.reads.back(); ++call) {
+            // Not if the call itself writes it
+            write = std::lower_bound(write, reg_info.writes.end(), *call);
+            if (write != reg_info.writes.end() and *write == *call) continue;
+            live_across_calls[*call].push_back(reg_info.reg_num);
+        }
+    }
+
     ir_inst_num = 0;
-    for (auto & block : function.body) {
-        assign_label(block->name, text_end);
-        for (auto & instruction : block->contents) {
+    for (const auto & block : function.blocks()) {
+        assign_label(block.name, text_end);
+        for (const auto & instruction : block.instructions) {
             make_instruction(instruction, register_alloc, ir_inst_num++, function);
         }
     }
 }
-uint64_t program::append_data(const std::string & item) {
+program::register_info & program::register_of(register_map & registers,
+                                              const ir::operand & operand) {
+    return const_cast<register_info &>(
+        register_of(static_cast<const register_map &>(registers), operand));
+}
+const program::register_info & program::register_of(const register_map & registers,
+                                                    const ir::operand & operand) {
+    if (not operand.is_value()) throw std::out_of_range{"Immediates are not in registers"};
+    return registers.at(static_cast<size_t>(operand.value())).value();
+}
+uint64_t program::append_data(std::string_view item) {
     auto to_ret = this->data.size() + data_start;
     for (size_t i = 1; i < item.size() - 1; i++) data.push_back(item.at(i));
     data.push_back('\0');
     return to_ret;
 }
 void program::make_instruction(const ir::three_address & instruction,
-                               std::map<std::string, register_info> & register_alloc,
-                               size_t inst_num, const ir::function & func) {
+                               register_map & register_alloc, size_t inst_num,
+                               const ir::function & func) {
 
     // TODO: record the last written times
-    const auto get_register_info = [&register_alloc](const std::string & name) -> register_info & {
-        return register_alloc.at(name);
+    const auto get_register_info
+        = [&register_alloc](const ir::operand & operand) -> register_info & {
+        return register_of(register_alloc, operand);
     };
 
     auto res = instruction.result();
@@ -202,38 +303,39 @@ void program::make_instruction(const ir::three_address & instruction,
     case ir::operation::add: {
         auto lhs = instruction.operands.at(1);
         auto rhs = instruction.operands.at(2);
-        auto result_reg = get_register_info(std::get<std::string>(res.value().data)).reg_num;
-        if (lhs.is_immediate and rhs.is_immediate) {
-            auto & lhs_value = std::get<long>(lhs.data);
-            auto & rhs_value = std::get<long>(rhs.data);
+        auto result_reg = get_register_info(res.value()).reg_num;
+        if (lhs.is_immediate() and rhs.is_immediate()) {
+            const auto lhs_value = lhs.integer();
+            const auto rhs_value = rhs.integer();
             if (lhs_value >= INT64_MAX - rhs_value) {
-                std::cerr << "Detected integer overflow of " << lhs << " + " << rhs << '\n';
+                diag::warning() << "Detected integer overflow of " << func.named(lhs) << " + "
+                                << func.named(rhs);
             }
             auto [first, second] = load_64_bits(result_reg, lhs_value + rhs_value);
             if (first.has_value()) append_instruction(std::move(*first));
             append_instruction(std::move(second));
-        } else if (lhs.is_immediate and not rhs.is_immediate) {
+        } else if (lhs.is_immediate() and not rhs.is_immediate()) {
             // ori lhs + add rhs
             append_instruction(
                 opcode::ori,
-                make_reg_with_imm(result_reg, 0, static_cast<uint32_t>(std::get<long>(lhs.data))));
+                make_reg_with_imm(result_reg, 0, static_cast<uint32_t>(lhs.integer())));
 
-            auto rhs_reg = get_register_info(std::get<std::string>(rhs.data)).reg_num;
+            auto rhs_reg = get_register_info(rhs).reg_num;
             append_instruction(opcode::add, std::array{result_reg, result_reg, rhs_reg});
-        } else if (rhs.is_immediate and not lhs.is_immediate) {
+        } else if (rhs.is_immediate() and not lhs.is_immediate()) {
             // ori rhs + add lhs
             append_instruction(
                 opcode::ori,
-                make_reg_with_imm(result_reg, 0, static_cast<uint32_t>(std::get<long>(rhs.data))));
+                make_reg_with_imm(result_reg, 0, static_cast<uint32_t>(rhs.integer())));
 
-            auto lhs_reg = get_register_info(std::get<std::string>(lhs.data)).reg_num;
+            auto lhs_reg = get_register_info(lhs).reg_num;
             append_instruction(opcode::add, std::array{result_reg, result_reg, lhs_reg});
         } else {
             // both are not immediates
             // simple add
 
-            auto lhs_reg = get_register_info(std::get<std::string>(lhs.data)).reg_num;
-            auto rhs_reg = get_register_info(std::get<std::string>(rhs.data)).reg_num;
+            auto lhs_reg = get_register_info(lhs).reg_num;
+            auto rhs_reg = get_register_info(rhs).reg_num;
             append_instruction(opcode::add, std::array{result_reg, lhs_reg, rhs_reg});
         }
 
@@ -241,81 +343,83 @@ void program::make_instruction(const ir::three_address & instruction,
     case ir::operation::sub: {
         auto lhs = instruction.operands.at(1);
         auto rhs = instruction.operands.at(2);
-        auto result_reg = get_register_info(std::get<std::string>(res.value().data)).reg_num;
-        if (lhs.is_immediate and rhs.is_immediate) {
-            auto & lhs_value = std::get<long>(lhs.data);
-            auto & rhs_value = std::get<long>(rhs.data);
+        auto result_reg = get_register_info(res.value()).reg_num;
+        if (lhs.is_immediate() and rhs.is_immediate()) {
+            const auto lhs_value = lhs.integer();
+            const auto rhs_value = rhs.integer();
             if (rhs_value >= INT64_MIN - lhs_value) {
-                std::cerr << "Detected negative integer overflow of " << lhs << " + " << rhs
-                          << '\n';
+                diag::warning() << "Detected negative integer overflow of " << func.named(lhs)
+                                << " + " << func.named(rhs);
             }
             auto [first, second] = load_64_bits(result_reg, lhs_value - rhs_value);
             if (first.has_value()) append_instruction(std::move(*first));
             append_instruction(std::move(second));
 
-        } else if (lhs.is_immediate and not rhs.is_immediate) {
+        } else if (lhs.is_immediate() and not rhs.is_immediate()) {
             // ori lhs + sub rhs
             append_instruction(
                 opcode::ori,
-                make_reg_with_imm(result_reg, 0, static_cast<uint32_t>(std::get<long>(lhs.data))));
+                make_reg_with_imm(result_reg, 0, static_cast<uint32_t>(lhs.integer())));
 
-            auto rhs_reg = get_register_info(std::get<std::string>(rhs.data)).reg_num;
+            auto rhs_reg = get_register_info(rhs).reg_num;
             append_instruction(opcode::sub, std::array{result_reg, result_reg, rhs_reg});
-        } else if (rhs.is_immediate and not lhs.is_immediate) {
+        } else if (rhs.is_immediate() and not lhs.is_immediate()) {
             // addi of negative rhs
-            auto lhs_reg = get_register_info(std::get<std::string>(lhs.data)).reg_num;
+            auto lhs_reg = get_register_info(lhs).reg_num;
             append_instruction(opcode::addi,
                                make_reg_with_imm(result_reg, lhs_reg,
-                                                 static_cast<uint32_t>(-std::get<long>(rhs.data))));
+                                                 static_cast<uint32_t>(-rhs.integer())));
 
         } else {
             // both are not immediates
             // simple sub
 
-            auto lhs_reg = get_register_info(std::get<std::string>(lhs.data)).reg_num;
-            auto rhs_reg = get_register_info(std::get<std::string>(rhs.data)).reg_num;
+            auto lhs_reg = get_register_info(lhs).reg_num;
+            auto rhs_reg = get_register_info(rhs).reg_num;
             append_instruction(opcode::sub, std::array{result_reg, lhs_reg, rhs_reg});
         }
     } break;
     case ir::operation::mul: {
         auto lhs = instruction.operands.at(1);
         auto rhs = instruction.operands.at(2);
-        auto result_reg = get_register_info(std::get<std::string>(res.value().data)).reg_num;
-        if (lhs.is_immediate and rhs.is_immediate) {
-            auto result = std::get<long>(lhs.data) * std::get<long>(rhs.data);
+        auto result_reg = get_register_info(res.value()).reg_num;
+        if (lhs.is_immediate() and rhs.is_immediate()) {
+            auto result = lhs.integer() * rhs.integer();
             auto [first, second] = load_64_bits(result_reg, result);
             if (first.has_value()) append_instruction(std::move(*first));
             append_instruction(std::move(second));
-        } else if (not lhs.is_immediate and not rhs.is_immediate) {
-            auto lhs_reg = get_register_info(std::get<std::string>(lhs.data)).reg_num;
-            auto rhs_reg = get_register_info(std::get<std::string>(rhs.data)).reg_num;
+        } else if (not lhs.is_immediate() and not rhs.is_immediate()) {
+            auto lhs_reg = get_register_info(lhs).reg_num;
+            auto rhs_reg = get_register_info(rhs).reg_num;
             append_instruction(opcode::mul, std::array{result_reg, lhs_reg, rhs_reg});
         } else {
-            std::cerr << "Mul instruction in " << instruction << " cannot be translated.\n";
+            diag::error() << "Mul instruction in " << func.named(instruction)
+                          << " cannot be translated.";
         }
     } break;
     case ir::operation::assign: {
-        auto result_reg = get_register_info(std::get<std::string>(res.value().data)).reg_num;
+        auto result_reg = get_register_info(res.value()).reg_num;
         auto src = instruction.operands.back();
-        if (src.is_immediate) {
+        if (src.is_immediate()) {
             switch (static_cast<ir::ir_type>(*src.type)) {
             case ir::ir_type::str: {
                 auto [first, second]
-                    = load_64_bits(result_reg, append_data(std::get<std::string>(src.data)));
+                    = load_64_bits(result_reg, append_data(text_of(src.name())));
                 if (first.has_value()) append_instruction(std::move(*first));
                 append_instruction(std::move(second));
             } break;
             case ir::ir_type::i32:
                 append_instruction(opcode::ori,
-                                   make_reg_with_imm(result_reg, 0, std::get<long>(src.data)));
+                                   make_reg_with_imm(result_reg, 0, src.integer()));
                 break;
             case ir::ir_type::i64: {
-                auto [first, second] = load_64_bits(result_reg, std::get<long>(src.data));
+                auto [first, second] = load_64_bits(result_reg, src.integer());
                 if (first.has_value()) append_instruction(std::move(*first));
                 append_instruction(std::move(second));
             } break;
             default:
-                std::cerr << "Cannot use " << src << " as the rhs of an assignment.\n";
+                diag::error() << "Cannot use " << func.named(src)
+                              << " as the rhs of an assignment.";
                 break;
             }
         }
@@ -323,9 +427,9 @@ void program::make_instruction(const ir::three_address & instruction,
     case ir::operation::bit_or: {
         auto lhs = instruction.operands.at(1);
         auto rhs = instruction.operands.at(2);
-        auto result_reg = get_register_info(std::get<std::string>(res.value().data)).reg_num;
-        if (lhs.is_immediate and rhs.is_immediate) {
-            uint64_t val = std::get<long>(lhs.data) | std::get<long>(rhs.data);
+        auto result_reg = get_register_info(res.value()).reg_num;
+        if (lhs.is_immediate() and rhs.is_immediate()) {
+            uint64_t val = lhs.integer() | rhs.integer();
             if (val >= UINT32_MAX) {
                 append_instruction(opcode::lui, make_reg_with_imm(result_reg, 0, val >> 32u));
                 val &= mask_low_32_bit;
@@ -333,17 +437,17 @@ void program::make_instruction(const ir::three_address & instruction,
 
             append_instruction(opcode::ori, make_reg_with_imm(result_reg, result_reg, val));
 
-        } else if (rhs.is_immediate and not lhs.is_immediate) {
-            auto lhs_reg = get_register_info(std::get<std::string>(lhs.data)).reg_num;
+        } else if (rhs.is_immediate() and not lhs.is_immediate()) {
+            auto lhs_reg = get_register_info(lhs).reg_num;
             append_instruction(opcode::ori,
-                               make_reg_with_imm(result_reg, lhs_reg, std::get<long>(rhs.data)));
-        } else if (lhs.is_immediate and not rhs.is_immediate) {
-            auto rhs_reg = get_register_info(std::get<std::string>(rhs.data)).reg_num;
+                               make_reg_with_imm(result_reg, lhs_reg, rhs.integer()));
+        } else if (lhs.is_immediate() and not rhs.is_immediate()) {
+            auto rhs_reg = get_register_info(rhs).reg_num;
             append_instruction(opcode::ori,
-                               make_reg_with_imm(result_reg, rhs_reg, std::get<long>(lhs.data)));
+                               make_reg_with_imm(result_reg, rhs_reg, lhs.integer()));
         } else {
-            auto lhs_reg = get_register_info(std::get<std::string>(lhs.data)).reg_num;
-            auto rhs_reg = get_register_info(std::get<std::string>(rhs.data)).reg_num;
+            auto lhs_reg = get_register_info(lhs).reg_num;
+            auto rhs_reg = get_register_info(rhs).reg_num;
             append_instruction(opcode::or_, std::array{result_reg, lhs_reg, rhs_reg});
         }
     } break;
@@ -360,25 +464,25 @@ void program::make_instruction(const ir::three_address & instruction,
                 append_instruction(
                     opcode::ori,
                     make_reg_with_imm(
-                        ret_loc++, get_register_info(std::get<std::string>(val.data)).reg_num, 0));
+                        ret_loc++, get_register_info(val).reg_num, 0));
         }
         append_instruction(opcode::jr, std::array<uint8_t, 3>{return_address, 0, 0});
         break;
     case ir::operation::shift_left: {
         auto lhs = instruction.operands.at(1);
-        if (lhs.is_immediate) {
-            std::cerr << "Cannot use " << lhs << " as the lhs of <<.\n";
+        if (lhs.is_immediate()) {
+            diag::error() << "Cannot use " << func.named(lhs) << " as the lhs of <<.";
             break;
         }
 
         auto rhs = instruction.operands.at(2);
-        auto lhs_reg = get_register_info(std::get<std::string>(lhs.data)).reg_num;
-        auto result_reg = get_register_info(std::get<std::string>(res.value().data)).reg_num;
-        if (rhs.is_immediate) {
+        auto lhs_reg = get_register_info(lhs).reg_num;
+        auto result_reg = get_register_info(res.value()).reg_num;
+        if (rhs.is_immediate()) {
             // sli
-            auto imm = std::get<long>(rhs.data);
+            auto imm = rhs.integer();
             if (imm >= UINT32_MAX) {
-                std::cerr << "Cannot put " << rhs << " in the imm field.\n";
+                diag::error() << "Cannot put " << func.named(rhs) << " in the imm field.";
                 break;
             }
             append_instruction(opcode::sli, make_reg_with_imm(result_reg, lhs_reg, imm));
@@ -386,24 +490,24 @@ void program::make_instruction(const ir::three_address & instruction,
             // sl
             append_instruction(
                 opcode::sl, std::array{result_reg, lhs_reg,
-                                       get_register_info(std::get<std::string>(rhs.data)).reg_num});
+                                       get_register_info(rhs).reg_num});
         }
     } break;
     case ir::operation::shift_right: {
         auto lhs = instruction.operands.at(1);
-        if (lhs.is_immediate) {
-            std::cerr << "Cannot use " << lhs << " as the lhs of <<.\n";
+        if (lhs.is_immediate()) {
+            diag::error() << "Cannot use " << func.named(lhs) << " as the lhs of <<.";
             break;
         }
 
         auto rhs = instruction.operands.at(2);
-        auto lhs_reg = get_register_info(std::get<std::string>(lhs.data)).reg_num;
-        auto result_reg = get_register_info(std::get<std::string>(res.value().data)).reg_num;
-        if (rhs.is_immediate) {
+        auto lhs_reg = get_register_info(lhs).reg_num;
+        auto result_reg = get_register_info(res.value()).reg_num;
+        if (rhs.is_immediate()) {
             // sli
-            auto imm = std::get<long>(rhs.data);
+            auto imm = rhs.integer();
             if (imm >= UINT32_MAX) {
-                std::cerr << "Cannot put " << rhs << " in the imm field.\n";
+                diag::error() << "Cannot put " << func.named(rhs) << " in the imm field.";
                 break;
             }
             append_instruction(opcode::sri, make_reg_with_imm(result_reg, lhs_reg, imm));
@@ -411,49 +515,18 @@ void program::make_instruction(const ir::three_address & instruction,
             // sl
             append_instruction(
                 opcode::sr, std::array{result_reg, lhs_reg,
-                                       get_register_info(std::get<std::string>(rhs.data)).reg_num});
+                                       get_register_info(rhs).reg_num});
         }
     } break;
     case ir::operation::call: {
 
         const auto & func_name
-            = std::get<std::string>(instruction.operands.at(res.has_value()).data);
+            = instruction.operands.at(res.has_value()).name();
 
         // Determine which items to save
         std::set registers_to_save{stack_pointer, frame_pointer, return_address};
-        for (const auto & entry : register_alloc) {
-            const auto & reg_info = entry.second;
-            const auto & writes = reg_info.writes;
-            const auto & reads = reg_info.reads;
-
-            // check that we are in between a write and a read
-            bool written_to = false;
-            size_t write_loc = 0;
-            // find the latest write before us
-            for (const auto & write : writes) {
-                if (write <= inst_num) {
-                    write_loc = std::max(write_loc, write);
-                    written_to = true;
-                }
-            }
-
-            if (not written_to) continue;
-
-            size_t read_loc = write_loc;
-            // find the earliest read after us
-            for (const auto & read : reads) {
-                if (read < read_loc) continue;
-                else if (read > inst_num) {
-                    read_loc = read;
-                    break;
-                }
-            }
-
-            if (inst_num > write_loc and inst_num < read_loc) {
-                // save that register
-                registers_to_save.insert(reg_info.reg_num);
-            }
-        }
+        if (auto live = live_across_calls.find(inst_num); live != live_across_calls.end())
+            registers_to_save.insert(live->second.begin(), live->second.end());
 
         const auto stack_size = static_cast<uint32_t>(registers_to_save.size() * -8);
 
@@ -464,44 +537,44 @@ void program::make_instruction(const ir::three_address & instruction,
             auto & operands = instruction.operands;
             for (auto iter = operands.begin() + (has_result ? 2 : 1); iter != operands.end();
                  ++iter) {
-                if (not iter->is_immediate)
+                if (not iter->is_immediate())
                     append_instruction(
                         opcode::or_,
                         std::array<uint8_t, 3>{
                             param_reg++, 0,
-                            get_register_info(std::get<std::string>(iter->data)).reg_num});
+                            get_register_info(*iter).reg_num});
                 else {
                     switch (static_cast<ir::ir_type>(*iter->type)) {
 
                     case ir::ir_type::boolean:
                         append_instruction(
                             opcode::ori,
-                            make_reg_with_imm(param_reg++, 0, std::get<bool>(iter->data) ? 1 : 0));
+                            make_reg_with_imm(param_reg++, 0, iter->boolean() ? 1 : 0));
                         break;
                     case ir::ir_type::str: {
                         auto [first, second] = load_64_bits(
-                            param_reg++, append_data(std::get<std::string>(iter->data)));
+                            param_reg++, append_data(text_of(iter->name())));
                         if (first.has_value()) append_instruction(std::move(*first));
                         append_instruction(std::move(second));
                     } break;
                     case ir::ir_type::i32:
                     case ir::ir_type::i64: {
                         auto [first, second]
-                            = load_64_bits(param_reg++, std::get<long>(iter->data));
+                            = load_64_bits(param_reg++, iter->integer());
                         if (first.has_value()) append_instruction(std::move(*first));
                         append_instruction(std::move(second));
                     } break;
                     default:
-                        std::cerr << "Cannot load " << *iter << " into register " << param_reg++
-                                  << '\n';
+                        diag::error()
+                            << "Cannot load " << *iter << " into register " << param_reg++;
                     }
                 }
             }
         };
 
-        if (func_name == "print") {
+        if (text_of(func_name) == "print") {
             // setup_args();
-            append_instruction(print(instruction, register_alloc));
+            append_instruction(print(instruction, register_alloc, func));
             break;
         }
 
@@ -515,12 +588,19 @@ void program::make_instruction(const ir::three_address & instruction,
         }
 
         setup_args();
-        append_instruction(opcode::jal, read_label(func_name, true, text_end));
+        if (func_name == func.name)
+            append_instruction(opcode::jal, read_label(func_name, true, text_end));
+        else {
+            // Block labels can have the same name as a function, so other functions are only
+            // looked up among the functions by link
+            calls.emplace_back(text_end, func_name);
+            append_instruction(opcode::jal, uint64_t{0});
+        }
 
         // TODO: Implement multiple return value copies
         if (res.has_value()) {
             // Some return value (the register has already been allocated)
-            auto dest_reg = get_register_info(std::get<std::string>(res.value().data)).reg_num;
+            auto dest_reg = get_register_info(res.value()).reg_num;
             append_instruction(opcode::ori, make_reg_with_imm(dest_reg, return_value_start, 0));
         }
 
@@ -535,78 +615,76 @@ void program::make_instruction(const ir::three_address & instruction,
     case ir::operation::branch:
         if (instruction.operands.size() == 1) {
             append_instruction(opcode::jmp,
-                               read_label(std::get<std::string>(instruction.operands.front().data),
+                               read_label(instruction.operands.front().name(),
                                           true, text_end));
         } else {
             // conditional branch
-            const auto & condition = std::get<std::string>(instruction.operands.front().data);
-
-            const auto & writes = register_alloc.at(condition).writes;
+            const auto & writes = get_register_info(instruction.operands.front()).writes;
             size_t write_loc = 0;
             for (auto & write : writes)
                 if (write < inst_num) write_loc = std::max(write_loc, write);
 
-            auto * cond_inst = func.instruction_number(write_loc);
+            const auto * cond_inst = func.instruction_number(write_loc);
             if (cond_inst == nullptr or cond_inst->operands.size() != 3) {
-                std::cerr << "Could determine condition for " << instruction << std::endl;
+                diag::error() << "Could determine condition for " << func.named(instruction);
                 break;
             }
 
             const auto & lhs = cond_inst->operands.at(1);
             const auto & rhs = cond_inst->operands.at(2);
 
-            const auto & true_dest = std::get<std::string>(instruction.operands.at(1).data);
-            const auto & false_dest = std::get<std::string>(instruction.operands.back().data);
+            const auto true_dest = instruction.operands.at(1).name();
+            const auto false_dest = instruction.operands.back().name();
 
             switch (cond_inst->op) {
             case ir::operation::eq:
-                if (not lhs.is_immediate and not rhs.is_immediate) {
-                    auto lhs_reg = get_register_info(std::get<std::string>(lhs.data)).reg_num;
-                    auto rhs_reg = get_register_info(std::get<std::string>(rhs.data)).reg_num;
+                if (not lhs.is_immediate() and not rhs.is_immediate()) {
+                    auto lhs_reg = get_register_info(lhs).reg_num;
+                    auto rhs_reg = get_register_info(rhs).reg_num;
                     append_instruction(opcode::jeq,
                                        make_reg_with_imm(lhs_reg, rhs_reg,
                                                          read_label(true_dest, false, text_end)));
-                } else if (lhs.is_immediate and rhs.is_immediate) {
-                    auto lhs_val = std::get<long>(lhs.data);
-                    auto rhs_val = std::get<long>(rhs.data);
+                } else if (lhs.is_immediate() and rhs.is_immediate()) {
+                    auto lhs_val = lhs.integer();
+                    auto rhs_val = rhs.integer();
                     if (lhs_val == rhs_val) {
                         append_instruction(opcode::jmp, read_label(true_dest, true, text_end));
                     } else {
                         append_instruction(opcode::jmp, read_label(false_dest, true, text_end));
                     }
-                } else if (lhs.is_immediate and not rhs.is_immediate) {
-                    auto lhs_val = std::get<long>(lhs.data);
+                } else if (lhs.is_immediate() and not rhs.is_immediate()) {
+                    auto lhs_val = lhs.integer();
                     {
                         auto [first, second] = load_64_bits(1, lhs_val);
                         if (first.has_value()) append_instruction(std::move(*first));
                         append_instruction(std::move(second));
                     }
-                    auto rhs_reg = get_register_info(std::get<std::string>(rhs.data)).reg_num;
+                    auto rhs_reg = get_register_info(rhs).reg_num;
                     append_instruction(
                         opcode::jeq,
                         make_reg_with_imm(1, rhs_reg, read_label(true_dest, false, text_end)));
                     append_instruction(opcode::jmp, read_label(false_dest, true, text_end));
-                } else if (not lhs.is_immediate and rhs.is_immediate) {
-                    auto rhs_val = std::get<long>(rhs.data);
+                } else if (not lhs.is_immediate() and rhs.is_immediate()) {
+                    auto rhs_val = rhs.integer();
                     {
                         auto [first, second] = load_64_bits(1, rhs_val);
                         if (first.has_value()) append_instruction(std::move(*first));
                         append_instruction(std::move(second));
                     }
-                    auto lhs_reg = get_register_info(std::get<std::string>(lhs.data)).reg_num;
+                    auto lhs_reg = get_register_info(lhs).reg_num;
                     append_instruction(
                         opcode::jeq,
                         make_reg_with_imm(lhs_reg, 1, read_label(true_dest, false, text_end)));
                     append_instruction(opcode::jmp, read_label(false_dest, true, text_end));
                 } else {
-                    std::cerr << "Cannot generate jeq for " << *cond_inst << std::endl;
+                    diag::error() << "Cannot generate jeq for " << func.named(*cond_inst);
                 }
                 break;
             case ir::operation::le:
                 // First, do the less than and then the equal
-                if (not lhs.is_immediate and not rhs.is_immediate) {
-                    auto lhs_reg = get_register_info(std::get<std::string>(lhs.data)).reg_num;
-                    auto rhs_reg = get_register_info(std::get<std::string>(rhs.data)).reg_num;
+                if (not lhs.is_immediate() and not rhs.is_immediate()) {
+                    auto lhs_reg = get_register_info(lhs).reg_num;
+                    auto rhs_reg = get_register_info(rhs).reg_num;
                     append_instruction(opcode::slt, std::array<uint8_t, 3>{1, lhs_reg, rhs_reg});
                     append_instruction(
                         opcode::jne,
@@ -615,10 +693,10 @@ void program::make_instruction(const ir::three_address & instruction,
                                        make_reg_with_imm(lhs_reg, rhs_reg,
                                                          read_label(true_dest, false, text_end)));
                     append_instruction(opcode::jmp, read_label(false_dest, true, text_end));
-                } else if (rhs.is_immediate and not lhs.is_immediate) {
-                    auto lhs_reg = get_register_info(std::get<std::string>(lhs.data)).reg_num;
+                } else if (rhs.is_immediate() and not lhs.is_immediate()) {
+                    auto lhs_reg = get_register_info(lhs).reg_num;
                     // changes the less than or equal into just less than
-                    auto rhs_val = std::get<long>(rhs.data) + 1;
+                    auto rhs_val = rhs.integer() + 1;
 
                     append_instruction(opcode::slti, make_reg_with_imm(1, lhs_reg, rhs_val));
 
@@ -629,23 +707,23 @@ void program::make_instruction(const ir::three_address & instruction,
                     append_instruction(opcode::jmp, read_label(false_dest, true, text_end));
 
                 } else {
-                    std::cerr << "Cannot generate jle for " << *cond_inst << std::endl;
+                    diag::error() << "Cannot generate jle for " << func.named(*cond_inst);
                 }
                 break;
             case ir::operation::gt:
                 // First, do the less than and then the equal
-                if (not lhs.is_immediate and not rhs.is_immediate) {
-                    auto lhs_reg = get_register_info(std::get<std::string>(lhs.data)).reg_num;
-                    auto rhs_reg = get_register_info(std::get<std::string>(rhs.data)).reg_num;
+                if (not lhs.is_immediate() and not rhs.is_immediate()) {
+                    auto lhs_reg = get_register_info(lhs).reg_num;
+                    auto rhs_reg = get_register_info(rhs).reg_num;
                     append_instruction(opcode::slt, std::array<uint8_t, 3>{1, rhs_reg, lhs_reg});
                     append_instruction(
                         opcode::jne,
                         make_reg_with_imm(1, 0, read_label(true_dest, false, text_end)));
                     append_instruction(opcode::jmp, read_label(false_dest, true, text_end));
-                } else if (not rhs.is_immediate and lhs.is_immediate) {
-                    auto rhs_reg = get_register_info(std::get<std::string>(rhs.data)).reg_num;
+                } else if (not rhs.is_immediate() and lhs.is_immediate()) {
+                    auto rhs_reg = get_register_info(rhs).reg_num;
                     // changes the less than or equal into just less than
-                    auto lhs_val = std::get<long>(lhs.data) + 1;
+                    auto lhs_val = lhs.integer() + 1;
 
                     append_instruction(opcode::slti, make_reg_with_imm(1, rhs_reg, lhs_val));
 
@@ -654,44 +732,71 @@ void program::make_instruction(const ir::three_address & instruction,
                         make_reg_with_imm(1, 0, read_label(true_dest, false, text_end)));
 
                     append_instruction(opcode::jmp, read_label(false_dest, true, text_end));
-                } else if (rhs.is_immediate and not lhs.is_immediate) {
+                } else if (rhs.is_immediate() and not lhs.is_immediate()) {
                     uint8_t rhs_reg = 1;
                     {
-                        auto [first, second] = load_64_bits(rhs_reg, std::get<long>(rhs.data));
+                        auto [first, second] = load_64_bits(rhs_reg, rhs.integer());
                         if (first.has_value()) append_instruction(std::move(*first));
                         append_instruction(std::move(second));
                     }
 
-                    auto lhs_reg = get_register_info(std::get<std::string>(lhs.data)).reg_num;
+                    auto lhs_reg = get_register_info(lhs).reg_num;
                     append_instruction(opcode::slt, std::array{rhs_reg, rhs_reg, lhs_reg});
                     append_instruction(
                         opcode::jne,
                         make_reg_with_imm(rhs_reg, 0, read_label(true_dest, false, text_end)));
                     append_instruction(opcode::jmp, read_label(false_dest, true, text_end));
                 } else {
-                    std::cerr << "Cannot generate jgt for " << *cond_inst << std::endl;
+                    diag::error() << "Cannot generate jgt for " << func.named(*cond_inst);
                 }
                 break;
+            case ir::operation::lt:
+            case ir::operation::ge: {
+                // lhs >= rhs is the opposite of lhs < rhs, so both test for less than
+                const auto is_lt = cond_inst->op == ir::operation::lt;
+                const auto less_dest = is_lt ? true_dest : false_dest;
+                const auto not_less_dest = is_lt ? false_dest : true_dest;
+
+                if (lhs.is_immediate() and rhs.is_immediate()) {
+                    const auto dest = lhs.integer() < rhs.integer() ? less_dest : not_less_dest;
+                    append_instruction(opcode::jmp, read_label(dest, true, text_end));
+                    break;
+                }
+
+                // At most one side is an immediate, which is loaded into register 1
+                const auto register_for = [&](const ir::operand & operand) -> uint8_t {
+                    if (not operand.is_immediate()) return get_register_info(operand).reg_num;
+                    auto [first, second] = load_64_bits(1, operand.integer());
+                    if (first.has_value()) append_instruction(std::move(*first));
+                    append_instruction(std::move(second));
+                    return 1;
+                };
+                const auto lhs_reg = register_for(lhs);
+                const auto rhs_reg = register_for(rhs);
+                append_instruction(opcode::slt, std::array<uint8_t, 3>{1, lhs_reg, rhs_reg});
+                append_instruction(
+                    opcode::jne, make_reg_with_imm(1, 0, read_label(less_dest, false, text_end)));
+                append_instruction(opcode::jmp, read_label(not_less_dest, true, text_end));
+            } break;
                 /*
             case ir::operation::ne:
                 break;
-            case ir::operation::ge:
-                break;
-            case ir::operation::lt:
-                break;
                  */
             default:
-                std::cerr << "Instruction " << *cond_inst << " is not a valid condition"
-                          << std::endl;
+                diag::error() << "Instruction " << func.named(*cond_inst)
+                              << " is not a valid condition";
             }
         }
         break;
     case ir::operation::le:
+    case ir::operation::lt:
     case ir::operation::eq:
+    case ir::operation::ge:
     case ir::operation::gt:
         break;
     default:
-        std::cerr << "Instruction " << instruction << " cannot be translated to bytecode.\n";
+        diag::error() << "Instruction " << func.named(instruction)
+                      << " cannot be translated to bytecode.";
         break;
     }
 }
@@ -744,14 +849,6 @@ void operation::print_human_readable(std::ostream & lhs) const {
     }
 }
 
-constexpr uint8_t reg_width = 6;
-constexpr uint8_t imm_width = 32;
-constexpr uint8_t opcode_offset = 54;
-constexpr uint8_t r0_offset = opcode_offset - reg_width;
-constexpr uint8_t r1_offset = opcode_offset - (2 * reg_width);
-constexpr uint8_t r2_offset = opcode_offset - (3 * reg_width);
-constexpr uint8_t imm_offset = opcode_offset - (2 * reg_width + imm_width);
-
 uint64_t operation::raw_form() const {
 
     auto shift_field
@@ -783,8 +880,12 @@ uint64_t operation::raw_form() const {
 void program::print_human_readable(std::ostream & lhs) const {
 
     const std::map label_map = [this] {
-        std::map<uint64_t, std::string> label_map;
-        for (const auto & entry : this->labels) { label_map.emplace(entry.second, entry.first); }
+        // A function and its entry block share an address; print the shorter name
+        std::map<uint64_t, std::string_view> label_map;
+        for (const auto & [label, address] : this->labels) {
+            auto [iter, inserted] = label_map.emplace(address, text_of(label));
+            if (not inserted and text_of(label) < iter->second) iter->second = text_of(label);
+        }
         return label_map;
     }();
 
@@ -813,47 +914,47 @@ void program::append_instruction(operation && op) {
     bytecode.push_back(op);
     text_end += 8;
 }
-void program::assign_label(const std::string & label, size_t bytecode_loc) {
+void program::assign_label(symbol label, size_t bytecode_loc) {
     labels.emplace(label, text_end);
 
-    std::vector<size_t> fulfilled;
-    for (auto & entry : label_queue)
-        if (entry.second.first == label) {
-            auto & inst = bytecode.at((entry.first - pc_start) / 8);
-            if (entry.second.second) {
-                // use absolute addressing
-                inst.data = bytecode_loc >> 3u;
-            } else {
-                // use relative addressing
-                auto dist = bytecode_loc - (entry.first + 8);
-                std::get<operation::reg_with_imm>(inst.data).immediate = dist >> 3u;
-            }
-            fulfilled.push_back(entry.first);
-        }
+    const auto uses = label_queue.find(label);
+    if (uses == label_queue.end()) return;
 
-    for (auto & satisfied : fulfilled) label_queue.erase(satisfied);
+    for (const auto & [location, absolute] : uses->second) {
+        auto & inst = bytecode.at((location - pc_start) / 8);
+        if (absolute) {
+            // use absolute addressing
+            inst.data = bytecode_loc >> 3u;
+            text_refs.push_back(location);
+        } else {
+            // use relative addressing
+            auto dist = bytecode_loc - (location + 8);
+            std::get<operation::reg_with_imm>(inst.data).immediate = dist >> 3u;
+        }
+    }
+    label_queue.erase(uses);
 }
-size_t program::read_label(const std::string & label, bool absolute, size_t bytecode_loc) {
+size_t program::read_label(symbol label, bool absolute, size_t bytecode_loc) {
     if (labels.count(label) == 0) {
         // Label does not exist. Fake it
-        label_queue.insert(std::make_pair(bytecode_loc, std::make_pair(label, absolute)));
+        label_queue[label].emplace_back(bytecode_loc, absolute);
         return 0;
     }
 
     auto & addr = labels.at(label);
-    if (absolute) return addr >> 3u;
-    else {
+    if (absolute) {
+        text_refs.push_back(bytecode_loc);
+        return addr >> 3u;
+    } else {
         auto dist = bytecode_loc - (addr + 8);
         return dist >> 3u;
     }
 }
 
-constexpr uint8_t magic_byte = 0x7e;
-
 void program::print_file(const std::string & filename) const {
 
-    std::vector<uint8_t> file_contents{magic_byte, 'N', 'J'};
-    file_contents.reserve(data.size() + bytecode.size() * 8);
+    std::vector<uint8_t> file_contents{magic_byte, 'N', 'J', format_version};
+    file_contents.reserve(3 * section_alignment + data.size() + bytecode.size() * 8);
 
     {
         const auto header_table = generate_header_table();
@@ -871,9 +972,16 @@ void program::print_file(const std::string & filename) const {
             return (iter - file_contents.begin()) + content.size();
     };
 
+    const auto align_to_section = [&file_contents] {
+        const auto misalignment = file_contents.size() % section_alignment;
+        if (misalignment != 0)
+            file_contents.resize(file_contents.size() + section_alignment - misalignment, 0);
+    };
+
     {
         auto data_offset = find_in_file({'.', 'd', 'a', 't', 'a', 0});
         if (data_offset != file_contents.size() and not data.empty()) {
+            align_to_section();
             auto data_pos = file_contents.size();
             for (auto i = 0u; i < 4; i++)
                 file_contents.at(data_offset + i) = (data_pos >> i * 8u) & 0xFFu;
@@ -885,6 +993,7 @@ void program::print_file(const std::string & filename) const {
     {
         auto text_offset = find_in_file({'.', 't', 'e', 'x', 't', 0});
         if (text_offset != file_contents.size() and not bytecode.empty()) {
+            align_to_section();
             auto text_pos = file_contents.size();
             for (auto i = 0u; i < 4; i++)
                 file_contents.at(text_offset + i) = (text_pos >> i * 8u) & 0xFFu;
@@ -912,14 +1021,14 @@ std::vector<uint8_t> program::generate_header_table() const {
         for (auto i = 0u; i < sizeof(uint32_t); i++) header_table.push_back(0);
         // length of section
         auto data_length = data.size();
-        if (data_length > UINT32_MAX) std::cerr << "Data section too long\n";
+        if (data_length > UINT32_MAX) diag::error() << "Data section too long";
         for (auto i = 0u; i < sizeof(uint32_t); i++)
             header_table.push_back((data_length >> i * 8u) & 0xFFu);
         // null byte
         header_table.push_back('\0');
     }
 
-    if (bytecode.empty()) std::cerr << "No runnable code generated\n";
+    if (bytecode.empty()) diag::error() << "No runnable code generated";
 
     // text entry in header table
     for (auto c : ".text") header_table.push_back(c);
@@ -929,13 +1038,13 @@ std::vector<uint8_t> program::generate_header_table() const {
     {
         static_assert(sizeof(uint64_t) == 8);
         const auto text_length = bytecode.size() * sizeof(uint64_t);
-        if (text_length > UINT32_MAX) std::cerr << "Text section too long\n";
+        if (text_length > UINT32_MAX) diag::error() << "Text section too long";
         for (auto i = 0u; i < 4; i++) header_table.push_back((text_length >> i * 8u) & 0xFFu);
     }
     header_table.push_back('\0');
 
     if (header_table.size() > UINT32_MAX) {
-        std::cerr << "Header table too long\n";
+        diag::error() << "Header table too long";
         return {};
     }
 
@@ -9,6 +9,9 @@
 
 #include <map>
 #include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
 #include <variant>
 #include <vector>
 
@@ -61,10 +64,46 @@ struct operation {
 static constexpr uint64_t pc_start = 0x80000000;
 static constexpr uint64_t data_start = 0x8C000000;
 
+// Layout of the file written by program::print_file:
+// magic, format version, header table length, header table,
+// then .data and .text, each starting on a page boundary so a loader can map them directly
+static constexpr uint8_t magic_byte = 0x7e;
+static constexpr uint8_t format_version = 1;
+static constexpr uint32_t section_alignment = 0x1000;
+
+// Register conventions shared by the code generator and the vm
+static constexpr uint8_t return_value_start = 10;
+static constexpr uint8_t param_start = 13;
+static constexpr uint8_t param_end = 19;
+static constexpr auto max_inputs = (param_end - param_start) + 1;
+static constexpr uint8_t temp_start = 20;
+static constexpr uint8_t stack_pointer = 61;
+static constexpr auto temp_end = stack_pointer;
+static constexpr uint8_t frame_pointer = 62;
+static constexpr uint8_t return_address = 63;
+
+// Layout of operation::raw_form
+static constexpr uint8_t reg_width = 6;
+static constexpr uint8_t imm_width = 32;
+static constexpr uint8_t opcode_offset = 54;
+static constexpr uint8_t r0_offset = opcode_offset - reg_width;
+static constexpr uint8_t r1_offset = opcode_offset - (2 * reg_width);
+static constexpr uint8_t r2_offset = opcode_offset - (3 * reg_width);
+static constexpr uint8_t imm_offset = opcode_offset - (2 * reg_width + imm_width);
+
+// Where new_jc writes the bytecode of an input file: the same name ending in .bin
+[[nodiscard]] std::string output_filename(std::string input_filename);
+
 class program {
   public:
     static std::optional<program> from_ir(const ir::program &);
 
+    // The code of one function on its own, as if it was the only one in the program.
+    // References to other functions are left for link to fill in.
+    static program from_function(const ir::function &);
+    // Places the functions one after the other, the first one being where the program starts
+    static program link(const std::vector<const program *> & functions);
+
     void print_human_readable(std::ostream &) const;
     void print_file(const std::string & file_name) const;
 
@@ -76,29 +115,47 @@ class program {
 
         register_info(uint8_t register_number, size_t first_written);
     };
+    // Indexed by the values of the function, empty for values that were not written yet
+    using register_map = std::vector<std::optional<register_info>>;
+    // Throws if the value of the operand has no register
+    static register_info & register_of(register_map &, const ir::operand &);
+    static const register_info & register_of(const register_map &, const ir::operand &);
 
     void generate_bytecode(const ir::function & function);
-    uint64_t append_data(const std::string &);
-    void make_instruction(const ir::three_address &, std::map<std::string, register_info> &, size_t,
-                          const ir::function &);
+    uint64_t append_data(std::string_view);
+    void make_instruction(const ir::three_address &, register_map &, size_t, const ir::function &);
 
     void append_instruction(operation &&);
     void append_instruction(opcode op, decltype(operation::data) && data) {
         append_instruction({op, data});
     }
 
-    std::map<size_t, std::pair<std::string, bool /* is absolute*/>> label_queue;
-    void assign_label(const std::string &, size_t bytecode_loc);
-    size_t read_label(const std::string &, bool absolute, size_t bytecode_loc);
+    // Where each label is used before it is assigned
+    std::unordered_map<symbol, std::vector<std::pair<size_t, bool /* is absolute*/>>> label_queue;
+    void assign_label(symbol, size_t bytecode_loc);
+    size_t read_label(symbol, bool absolute, size_t bytecode_loc);
 
-    operation print(const ir::three_address &, const std::map<std::string, register_info> &);
+    operation print(const ir::three_address &, const register_map &, const ir::function &);
 
     std::vector<uint8_t> generate_header_table() const;
 
     std::vector<char> data{};
     std::vector<operation> bytecode{};
 
-    std::map<std::string, uint64_t> labels{};
+    // Where instructions hold an absolute address in the text or data section,
+    // which link has to move along with the sections
+    std::vector<size_t> text_refs{};
+    std::vector<size_t> data_refs{};
+    // Where other functions are called, and which
+    std::vector<std::pair<size_t, symbol>> calls{};
+    // Set by from_function
+    symbol function_name{};
+
+    std::unordered_map<symbol, uint64_t> labels{};
+
+    // Only valid during generate_bytecode: the registers that stay live across each call,
+    // by the number of the call instruction
+    std::unordered_map<size_t, std::vector<uint8_t>> live_across_calls{};
 
     uint64_t text_end = pc_start;
 };
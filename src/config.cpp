@@ -1,6 +1,7 @@
 
 #include "config.h"
 
+#include <charconv>
 #include <iostream>
 
 [[nodiscard]] std::shared_ptr<const user_settings> parse_cmdline_args(int arg_count,
@@ -13,13 +14,39 @@
             settings.print_help = true;
         } else if (arg == "-v" or arg == "--version") {
             settings.print_version = true;
+        } else if (arg == "-q" or arg == "--quiet") {
+            settings.diagnostics = verbosity::quiet;
+        } else if (arg == "--verbose") {
+            settings.diagnostics = verbosity::verbose;
+        } else if (arg == "--watch") {
+            settings.watch = true;
         } else if (arg == "-fsyntax-tree") {
             settings.print_syntax = true;
         } else if (arg == "-fir-dump") {
             settings.print_ir = true;
         } else if (arg == "-fbytecode") {
             settings.print_bytecode = true;
-        } else if (arg.front() != '-') {
+        } else if (arg == "-flex-only") {
+            settings.lex_only = true;
+        } else if (arg == "-fparse-only") {
+            settings.parse_only = true;
+        } else if (arg == "-fflat-ast") {
+            settings.flat_ast = true;
+        } else if (arg.rfind("-fparse-threads=", 0) == 0) {
+            const auto * first = arg.data() + arg.find('=') + 1;
+            const auto * last = arg.data() + arg.size();
+            if (auto [end, error] = std::from_chars(first, last, settings.parse_threads);
+                error != std::errc{} or end != last or settings.parse_threads == 0) {
+                std::cout << "Unrecognized option: " << arg << std::endl;
+                settings.parse_threads = 1;
+            }
+        } else if (arg.rfind("-fcache-dir=", 0) == 0) {
+            settings.cache_directory = arg.substr(arg.find('=') + 1);
+            if (settings.cache_directory.empty())
+                std::cout << "Unrecognized option: " << arg << std::endl;
+        } else if (arg == "-fsimd" or arg == "-fno-simd") {
+            settings.simd = arg == "-fsimd";
+        } else if (arg == "-" or arg.front() != '-') {
             settings.input_filename = arg;
         } else {
             std::cout << "Unrecognized option: " << arg << std::endl;
@@ -2,6 +2,8 @@
 #ifndef CONFIG_H
 #define CONFIG_H
 
+#include "ast/diagnostics.h"
+
 #include <memory>
 #include <string>
 
@@ -12,6 +14,16 @@ struct user_settings {
     bool print_syntax{false};
     bool print_ir{false};
     bool print_bytecode{false};
+    bool lex_only{false};
+    bool parse_only{false};
+    bool flat_ast{false};
+    bool simd{true};
+    bool watch{false};
+    // Threads that parse top level items, see basic_parser::parse_program
+    unsigned parse_threads{1};
+    // Where parsed syntax trees are kept, see ast_cache. Empty if they are not kept.
+    std::string cache_directory{};
+    verbosity diagnostics{verbosity::normal};
 };
 
 [[nodiscard]] std::shared_ptr<const user_settings> parse_cmdline_args(int arg_count,
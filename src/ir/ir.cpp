@@ -4,96 +4,115 @@
 
 #include "ir.h"
 
+#include "ast/diagnostics.h"
+
 #include <algorithm>
-#include <iostream>
 #include <ostream>
+#include <stdexcept>
+#include <string>
 
 namespace ir {
 
-program::program() {
-    types.emplace("int32", std::make_shared<ir::i32_type>());
-    types.emplace("int64", std::make_shared<ir::i64_type>());
-    types.emplace("float32", std::make_shared<ir::f32_type>());
-    types.emplace("float64", std::make_shared<ir::f64_type>());
-    types.emplace("boolean", std::make_shared<ir::boolean_type>());
-    types.emplace("string", std::make_shared<ir::string_type>());
-    types.emplace("unit", std::make_shared<ir::unit_type>());
+program::program() = default;
+
+bool program::function_exists(symbol name) const noexcept {
+    return lookup_function(name) != nullptr;
 }
 
-bool program::function_exists(const std::string & name) const noexcept {
-    return std::find_if(prog.begin(), prog.end(),
-                        [&name](const auto & func) -> bool { return func->name == name; })
-           != prog.end();
+bool program::function_exists(symbol name, size_t param_count) const noexcept {
+    return lookup_function(name, param_count) != nullptr;
 }
 
-bool program::function_exists(const std::string & name, size_t param_count) const noexcept {
+bool program::function_exists(symbol name,
+                              const ir::function_type & func_type) const noexcept {
+    return lookup_function(name, func_type) != nullptr;
+}
 
-    return std::find_if(this->prog.begin(), this->prog.end(),
-                        [&](const auto & func) -> bool {
-                            return func->name == name and func->parameters().size() == param_count;
-                        })
-           != this->prog.end();
+function * program::lookup_function(symbol name) const noexcept {
+    const auto iter = by_name.find(name);
+    return iter != by_name.end() ? iter->second.front() : nullptr;
 }
 
-function * program::lookup_function(const std::string & name) const noexcept {
-    if (not function_exists(name)) return nullptr;
+function * program::lookup_function(symbol name, size_t param_count) const noexcept {
+    const auto & found = candidates(name, param_count);
+    return found.empty() ? nullptr : found.front();
+}
 
-    return std::find_if(prog.begin(), prog.end(),
-                        [&name](const auto & func) -> bool { return func->name == name; })
-        ->get();
+function * program::lookup_function(symbol name,
+                                    const ir::function_type & func_type) const noexcept {
+    const auto iter = by_signature.find({name, &func_type});
+    return iter != by_signature.end() ? iter->second : nullptr;
 }
 
-function * program::register_function(const std::string & name,
-                                      std::shared_ptr<ir::function_type> func_type) {
+const std::vector<function *> & program::candidates(symbol name,
+                                                   size_t param_count) const noexcept {
+    static const std::vector<function *> none{};
+    const auto iter = by_arity.find({name, param_count});
+    return iter != by_arity.end() ? iter->second : none;
+}
 
-    if (this->function_exists(name, *func_type)) return lookup_function(name, *func_type);
+function * program::register_function(symbol name, const ir::function_type * func_type) {
+    auto & registered = by_signature[{name, func_type}];
+    if (registered != nullptr) return registered;
 
-    prog.push_back(std::make_unique<ir::function>(name, std::move(func_type)));
-    return prog.back().get();
+    registered = prog.emplace_back(std::make_unique<ir::function>(name, func_type)).get();
+    by_name[name].push_back(registered);
+    by_arity[{name, func_type->parameters.size()}].push_back(registered);
+    return registered;
 }
-function * program::lookup_function(const std::string & name, size_t param_count) const noexcept {
-    if (not this->function_exists(name, param_count)) return nullptr;
 
-    return std::find_if(this->prog.begin(), this->prog.end(),
-                        [&](const auto & func) -> bool {
-                            return func->name == name and func->parameters().size() == param_count;
-                        })
-        ->get();
-}
+void program::remove_function(symbol name) {
+    const auto removed = by_name.find(name);
+    if (removed == by_name.end()) return;
 
-bool program::function_exists(const std::string & name,
-                              const ir::function_type & func_type) const noexcept {
-    return std::find_if(this->prog.begin(), this->prog.end(),
-                        [&](const auto & func) -> bool {
-                            return func->name == name and *func->type == func_type;
-                        })
-           != this->prog.end();
+    for (const auto * func : removed->second) {
+        by_signature.erase({name, func->type});
+        by_arity.erase({name, func->type->parameters.size()});
+    }
+    by_name.erase(removed);
+
+    // Only watch mode removes functions, one changed function at a time
+    prog.erase(std::remove_if(prog.begin(), prog.end(),
+                              [name](const auto & func) { return func->name == name; }),
+               prog.end());
 }
 
-function * program::lookup_function(const std::string & name,
-                                    const ir::function_type & func_type) const noexcept {
-    if (not this->function_exists(name, func_type)) return nullptr;
+size_t program::key_hash::operator()(const name_and_arity & key) const noexcept {
+    return std::hash<uint64_t>{}(static_cast<uint64_t>(key.name) << 32u ^ key.param_count);
+}
 
-    return std::find_if(this->prog.begin(), this->prog.end(),
-                        [&](const auto & func) -> bool {
-                            return func->name == name and *func->type == func_type;
-                        })
-        ->get();
+size_t program::key_hash::operator()(const name_and_type & key) const noexcept {
+    return std::hash<const void *>{}(key.type)
+           ^ std::hash<uint32_t>{}(static_cast<uint32_t>(key.name)) * 0x9e3779b97f4a7c15ul;
 }
-std::shared_ptr<ir::type> program::lookup_type(const std::string & name) {
-    auto iter = this->types.find(name);
-    if (iter != types.end()) { return iter->second; }
 
-    if (function_exists(name)) return this->lookup_function(name)->type;
+const ir::type * program::lookup_type(symbol name) {
+    if (const auto * named = type_context.named(name); named != nullptr) return named;
 
-    std::cerr << "Failed to lookup type " << name << std::endl;
+    if (const auto * func = lookup_function(name); func != nullptr) return func->type;
+
+    diag::error() << "Failed to lookup type " << name;
     return nullptr;
 }
 
-bool basic_block::terminated() {
-    if (contents.empty()) return false;
+const ir::function_type * program::generate_func_type(const std::vector<std::string> & param_types,
+                                                      const std::string & return_type) {
+    std::vector<const ir::type *> params;
+    params.reserve(param_types.size());
+    for (const auto & name : param_types) {
+        params.push_back(type_context.named(intern(name)));
+        if (params.back() == nullptr) return nullptr;
+    }
+
+    const auto * returned = type_context.named(intern(return_type));
+    if (returned == nullptr) return nullptr;
+    return type_context.function(std::move(params), returned);
+}
+
+bool basic_block::terminated() const {
+    if (instructions.empty()) return false;
     else
-        switch (this->contents.back().op) {
+        switch (this->instructions.back().op) {
         case operation::halt:
         case operation::branch:
         case operation::ret:
@@ -103,8 +122,28 @@ bool basic_block::terminated() {
         }
 }
 
-std::ostream & operator<<(std::ostream & lhs, const operand & rhs) {
-    if (rhs.type == nullptr) { return lhs << "(null type)" << std::flush; }
+namespace {
+// Values are printed by name when the function they belong to is known
+struct shown {
+    const operand & op;
+    const function * names;
+};
+
+std::ostream & operator<<(std::ostream & lhs, const shown & rhs) {
+    if (not rhs.op.is_value()) return lhs << rhs.op.name();
+
+    const auto id = static_cast<uint32_t>(rhs.op.value());
+    if (rhs.names == nullptr) return lhs << '%' << id;
+    if (const auto name = rhs.names->value_name(rhs.op.value()); name != symbol{})
+        return lhs << name;
+    return lhs << "temp_" << id;
+}
+
+void print(std::ostream & lhs, const operand & rhs, const function * names) {
+    if (rhs.type == nullptr) {
+        lhs << "(null type)" << std::flush;
+        return;
+    }
 
     lhs << '(';
     switch (static_cast<ir_type>(*rhs.type)) {
@@ -112,124 +151,165 @@ std::ostream & operator<<(std::ostream & lhs, const operand & rhs) {
         lhs << "unit";
         break;
     case ir_type::boolean:
-        if (const auto * val = std::get_if<bool>(&rhs.data); val != nullptr)
-            lhs << "boolean imm. " << *val;
+        if (rhs.is_immediate()) lhs << "boolean imm. " << rhs.boolean();
         else
-            lhs << "boolean " << std::get<std::string>(rhs.data);
+            lhs << "boolean " << shown{rhs, names};
         break;
     case ir_type::str:
-        if (rhs.is_immediate) lhs << "string imm. " << std::get<std::string>(rhs.data);
-        else
-            lhs << "string " << std::get<std::string>(rhs.data);
+        lhs << (rhs.is_immediate() ? "string imm. " : "string ") << shown{rhs, names};
         break;
     case ir_type::i32:
-        if (rhs.is_immediate) lhs << "i32 imm. " << std::get<long>(rhs.data);
+        if (rhs.is_immediate()) lhs << "i32 imm. " << rhs.integer();
         else
-            lhs << "i32 " << std::get<std::string>(rhs.data);
+            lhs << "i32 " << shown{rhs, names};
         break;
     case ir_type::i64:
-        if (rhs.is_immediate) lhs << "i64 imm. " << std::get<long>(rhs.data);
+        if (rhs.is_immediate()) lhs << "i64 imm. " << rhs.integer();
         else
-            lhs << "i64 " << std::get<std::string>(rhs.data);
+            lhs << "i64 " << shown{rhs, names};
         break;
     case ir_type::f32:
-        if (rhs.is_immediate) lhs << "f32 imm. " << std::get<double>(rhs.data);
+        if (rhs.is_immediate()) lhs << "f32 imm. " << rhs.floating();
         else
-            lhs << "f32 " << std::get<std::string>(rhs.data);
+            lhs << "f32 " << shown{rhs, names};
         break;
     case ir_type::f64:
-        if (rhs.is_immediate) lhs << "f64 imm. " << std::get<double>(rhs.data);
+        if (rhs.is_immediate()) lhs << "f64 imm. " << rhs.floating();
         else
-            lhs << "f64 " << std::get<std::string>(rhs.data);
+            lhs << "f64 " << shown{rhs, names};
         break;
     case ir_type::func:
-        lhs << "func " << std::get<std::string>(rhs.data);
+        lhs << "func " << shown{rhs, names};
         break;
     default:
         lhs << "unknown type";
         break;
     }
-    return lhs << ')' << std::flush;
+    lhs << ')' << std::flush;
 }
 
-std::ostream & operator<<(std::ostream & lhs, const three_address & rhs) {
-    if (auto result = rhs.result(); result) lhs << result.value() << " = ";
+void print(std::ostream & lhs, const three_address & rhs, const function * names) {
+    const auto show = [&lhs, names](const operand & op) -> std::ostream & {
+        print(lhs, op, names);
+        return lhs;
+    };
+    const auto binary = [&rhs, &show](const char * sign) {
+        show(rhs.operands.at(1)) << sign;
+        show(rhs.operands.at(2));
+    };
+
+    if (auto result = rhs.result(); result) show(result.value()) << " = ";
 
     switch (rhs.op) {
     case operation::add:
-        return lhs << rhs.operands.at(1) << " + " << rhs.operands.at(2);
+        binary(" + ");
+        break;
     case operation::sub:
-        return lhs << rhs.operands.at(1) << " - " << rhs.operands.at(2);
+        binary(" - ");
+        break;
     case operation::mul:
-        return lhs << rhs.operands.at(1) << " * " << rhs.operands.at(2);
+        binary(" * ");
+        break;
     case operation::div:
-        return lhs << rhs.operands.at(1) << " / " << rhs.operands.at(2);
+        binary(" / ");
+        break;
     case operation::shift_left:
-        return lhs << rhs.operands.at(1) << " << " << rhs.operands.at(2);
+        binary(" << ");
+        break;
     case operation::shift_right:
-        return lhs << rhs.operands.at(1) << " >> " << rhs.operands.at(2);
+        binary(" >> ");
+        break;
     case operation::bit_or:
-        return lhs << rhs.operands.at(1) << " | " << rhs.operands.at(2);
+        binary(" | ");
+        break;
     case operation::bit_and:
-        return lhs << rhs.operands.at(1) << " & " << rhs.operands.at(2);
+        binary(" & ");
+        break;
     case operation::bool_or:
-        return lhs << rhs.operands.at(1) << " || " << rhs.operands.at(2);
+        binary(" || ");
+        break;
     case operation::bool_and:
-        return lhs << rhs.operands.at(1) << " && " << rhs.operands.at(2);
+        binary(" && ");
+        break;
     case operation::eq:
-        return lhs << rhs.operands.at(1) << " == " << rhs.operands.at(2);
+        binary(" == ");
+        break;
     case operation::lt:
-        return lhs << rhs.operands.at(1) << " < " << rhs.operands.at(2);
+        binary(" < ");
+        break;
     case operation::le:
-        return lhs << rhs.operands.at(1) << " <= " << rhs.operands.at(2);
+        binary(" <= ");
+        break;
     case operation::gt:
-        return lhs << rhs.operands.at(1) << " > " << rhs.operands.at(2);
+        binary(" > ");
+        break;
     case operation::ge:
-        return lhs << rhs.operands.at(1) << " >= " << rhs.operands.at(2);
+        binary(" >= ");
+        break;
     case operation::assign:
-        return lhs << rhs.operands.back();
+        show(rhs.operands.back());
+        break;
     case operation::halt:
         lhs << "halt ";
-        if (not rhs.operands.empty()) lhs << rhs.operands.front();
+        if (not rhs.operands.empty()) show(rhs.operands.front());
         break;
     case operation::branch:
         lhs << "branch ";
-        if (rhs.operands.size() == 1) return lhs << rhs.operands.front();
+        if (rhs.operands.size() == 1) show(rhs.operands.front());
         else
-            for (const auto & op : rhs.operands) lhs << op << ' ';
+            for (const auto & op : rhs.operands) show(op) << ' ';
 
         break;
     case operation::call:
         lhs << "call ";
         if (rhs.result())
             for (auto iter = rhs.operands.begin() + 1; iter != rhs.operands.end(); ++iter)
-                lhs << *iter << ' ';
+                show(*iter) << ' ';
         else
-            for (const auto & op : rhs.operands) lhs << op << ' ';
+            for (const auto & op : rhs.operands) show(op) << ' ';
 
         break;
     case operation::ret:
         lhs << "ret ";
-        if (not rhs.operands.empty()) lhs << rhs.operands.front();
+        if (not rhs.operands.empty()) show(rhs.operands.front());
         break;
     case operation::load:
         lhs << "load ";
         for (auto iter = rhs.operands.begin() + 1; iter != rhs.operands.end(); ++iter)
-            lhs << *iter << ' ';
+            show(*iter) << ' ';
         break;
     case operation::store:
         lhs << "store ";
-        for (const auto & op : rhs.operands) lhs << op << ' ';
+        for (const auto & op : rhs.operands) show(op) << ' ';
         break;
     case operation::phi:
         lhs << "phi ";
         for (auto iter = rhs.operands.begin() + 1; iter != rhs.operands.end(); ++iter)
-            lhs << *iter << ' ';
+            show(*iter) << ' ';
         break;
     default:
         lhs << "Unimplemented operation printer";
     }
+}
+} // namespace
+
+std::ostream & operator<<(std::ostream & lhs, const operand & rhs) {
+    print(lhs, rhs, nullptr);
+    return lhs;
+}
 
+std::ostream & operator<<(std::ostream & lhs, const three_address & rhs) {
+    print(lhs, rhs, nullptr);
+    return lhs;
+}
+
+std::ostream & operator<<(std::ostream & lhs, const function::named_operand & rhs) {
+    print(lhs, rhs.op, &rhs.func);
+    return lhs;
+}
+
+std::ostream & operator<<(std::ostream & lhs, const function::named_instruction & rhs) {
+    print(lhs, rhs.inst, &rhs.func);
     return lhs;
 }
 std::optional<operand> three_address::result() const {
@@ -266,7 +346,7 @@ std::optional<operand> three_address::result() const {
         return {};
     }
 }
-std::vector<operand> three_address::inputs() const {
+operand_range three_address::inputs() const {
     // The operand at the front is usually the output
     switch (this->op) {
     case operation::add:
@@ -286,64 +366,138 @@ std::vector<operand> three_address::inputs() const {
     case operation::shift_left:
     case operation::shift_right:
     case operation::sub:
-        return {operands.at(1), operands.at(2)};
+        return operands.slice(1, 3);
     case operation::assign:
-        return {operands.back()};
+        return operands.slice(operands.size() - 1, operands.size());
     case operation::branch:
     case operation::halt:
-        return {operands.front()};
+        return operands.slice(0, 1);
     case operation::call:
-        if (result().has_value()) {
-            std::vector<operand> to_ret;
-            bool first = true;
-            for (auto & operand : operands)
-                if (first) first = false;
-                else
-                    to_ret.push_back(operand);
-
-            return to_ret;
-        } else
-            return operands;
-
-    case operation::load: {
-        std::vector<operand> to_ret;
-        bool first = true;
-        for (auto & operand : operands)
-            if (first) first = false;
-            else
-                to_ret.push_back(operand);
-
-        return to_ret;
-    }
+        return operands.slice(result().has_value() ? 1 : 0, operands.size());
+    case operation::load:
+        return operands.slice(1, operands.size());
     case operation::ret:
     case operation::store:
-        return operands;
+        return operands.slice(0, operands.size());
     default:
-        std::cerr << "Unimplemented ir inputs helper" << *this << std::endl;
+        diag::error() << "Unimplemented ir inputs helper" << *this;
         return {};
     }
 }
-three_address * function::instruction_number(size_t pos) const {
-    size_t block_num = 0;
-    while (block_num < body.size() and pos >= this->body.at(block_num)->contents.size()) {
-        pos -= this->body.at(block_num)->contents.size();
-        block_num++;
+operand * operand_arena::allocate(size_t count) {
+    if (count > capacity - used) {
+        // Longer lists get a chunk of their own size
+        capacity = std::max(count, chunk_size);
+        chunks.push_back(std::make_unique<operand[]>(capacity));
+        used = 0;
     }
 
-    if (block_num >= body.size()) return nullptr;
-    else
-        return &body.at(block_num)->contents.at(pos);
+    auto * to_ret = chunks.back().get() + used;
+    used += count;
+    return to_ret;
+}
+operand_list::operand_list(std::initializer_list<operand> operands)
+    : count{static_cast<uint32_t>(operands.size())} {
+    if (operands.size() > inline_capacity)
+        throw std::length_error{"Too many operands to keep in the instruction"};
+    std::copy(operands.begin(), operands.end(), inline_operands.begin());
+}
+operand_list::operand_list(const std::vector<operand> & operands, operand_arena & overflow)
+    : count{static_cast<uint32_t>(operands.size())} {
+    if (operands.size() > inline_capacity) this->overflow = overflow.allocate(operands.size());
+    std::copy(operands.begin(), operands.end(), data());
+}
+const operand & operand_list::at(size_t pos) const {
+    if (pos >= count) throw std::out_of_range{"No operand " + std::to_string(pos)};
+    return data()[pos];
+}
+operand_range operand_list::slice(size_t first, size_t last) const {
+    if (first > last or last > count)
+        throw std::out_of_range{"No operands " + std::to_string(first) + " to "
+                                + std::to_string(last)};
+    return {data() + first, data() + last};
+}
+instruction * instruction_arena::allocate(const three_address & inst) {
+    instruction * to_ret;
+    if (not released.empty()) {
+        to_ret = released.back();
+        released.pop_back();
+    } else {
+        if (used == chunk_size) {
+            chunk_size = chunks.empty() ? first_chunk_size
+                                        : std::min(chunk_size * 2, last_chunk_size);
+            chunks.push_back(std::make_unique<instruction[]>(chunk_size));
+            used = 0;
+        }
+        to_ret = chunks.back().get() + used++;
+    }
+
+    static_cast<three_address &>(*to_ret) = inst;
+    return to_ret;
+}
+void instruction_arena::release(instruction * inst) { released.push_back(inst); }
+basic_block & function::append_block(symbol name) { return insert_block(body.end(), name); }
+basic_block & function::insert_block(intrusive_list<basic_block>::iterator pos, symbol name) {
+    auto & block = *block_storage.emplace_back(std::make_unique<basic_block>(name));
+    body.insert(pos, block);
+    return block;
+}
+void function::erase_block(basic_block & block) {
+    // The block itself is kept until the function goes away
+    while (not block.instructions.empty()) erase(block, block.instructions.back());
+    body.erase(body.iterator_to(block));
+}
+instruction & function::append(basic_block & block, const three_address & inst) {
+    auto * to_ret = instruction_storage.allocate(inst);
+    block.instructions.push_back(*to_ret);
+    numbering_valid = false;
+    return *to_ret;
+}
+instruction & function::insert(basic_block & block, instruction & pos,
+                               const three_address & inst) {
+    auto * to_ret = instruction_storage.allocate(inst);
+    block.instructions.insert(block.instructions.iterator_to(pos), *to_ret);
+    numbering_valid = false;
+    return *to_ret;
+}
+void function::erase(basic_block & block, instruction & inst) {
+    block.instructions.erase(block.instructions.iterator_to(inst));
+    instruction_storage.release(&inst);
+    numbering_valid = false;
+}
+const instruction * function::instruction_number(size_t pos) const {
+    if (not numbering_valid) {
+        numbering.clear();
+        for (const auto & block : body)
+            for (const auto & inst : block.instructions) numbering.push_back(&inst);
+        numbering_valid = true;
+    }
+
+    return pos < numbering.size() ? numbering[pos] : nullptr;
 }
 std::vector<ir::operand> function::parameters() const {
     std::vector<ir::operand> to_ret;
     to_ret.reserve(type->parameters.size());
 
     for (size_t i = 0; i < type->parameters.size(); i++) {
-        auto param_name = param_names.at(i);
+        auto param_value = named_values.at(param_names.at(i));
         auto param_type = this->type->parameters.at(i);
-        to_ret.push_back({param_name, param_type, false});
+        to_ret.emplace_back(param_value, param_type);
     }
 
     return to_ret;
 }
+value_id function::new_value() {
+    const auto value = static_cast<value_id>(value_names.size());
+    value_names.emplace_back();
+    return value;
+}
+value_id function::named_value(symbol name) {
+    const auto [iter, added] = named_values.try_emplace(name, value_id{});
+    if (added) {
+        iter->second = new_value();
+        value_names.back() = name;
+    }
+    return iter->second;
+}
 } // namespace ir
\ No newline at end of file
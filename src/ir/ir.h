@@ -5,14 +5,22 @@
 #ifndef NEW_J_COMPILER_IR_H
 #define NEW_J_COMPILER_IR_H
 
+#include "ast/interner.h"
 #include "ir_type.h"
 
-#include <functional>
+#include <array>
+#include <cassert>
+#include <cstdint>
+#include <cstddef>
+#include <initializer_list>
 #include <iosfwd>
-#include <map>
+#include <iterator>
 #include <memory>
+#include <optional>
 #include <string>
-#include <variant>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
 #include <vector>
 
 namespace ir {
@@ -44,47 +52,394 @@ enum struct operation {
     sub,
 };
 
+// A value computed in a function. Values are numbered from 0 in the order the function
+// makes them, and the names of variables are kept by the function for dumps.
+enum struct value_id : uint32_t {};
+
+// What an instruction works on: an immediate, a value of the function or the name of a block.
+// Instructions are copied around by value, so operands are plain data that fit in three words;
+// the type belongs to the program.
 struct operand {
-    std::variant<std::monostate, bool, long, double, std::string> data;
-    std::shared_ptr<ir::type> type;
-    bool is_immediate;
+    enum struct kind : uint8_t { immediate, value, label };
+
+    constexpr operand() noexcept = default;
+    operand(bool boolean, const ir::type * type) noexcept : type{type} {
+        payload.boolean = boolean;
+    }
+    operand(long integer, const ir::type * type) noexcept : type{type} {
+        payload.integer = integer;
+    }
+    operand(double floating, const ir::type * type) noexcept : type{type} {
+        payload.floating = floating;
+    }
+    // A string literal or the name of a function
+    operand(symbol name, const ir::type * type) noexcept : type{type} { payload.name = name; }
+    operand(value_id value, const ir::type * type) noexcept : type{type}, tag{kind::value} {
+        payload.value = value;
+    }
+
+    [[nodiscard]] static operand label(symbol block, const ir::type * type) noexcept {
+        operand to_ret{block, type};
+        to_ret.tag = kind::label;
+        return to_ret;
+    }
+
+    [[nodiscard]] bool is_immediate() const noexcept { return tag == kind::immediate; }
+    [[nodiscard]] bool is_value() const noexcept { return tag == kind::value; }
+
+    // Which of these holds something depends on the kind and the type
+    [[nodiscard]] bool boolean() const noexcept { return payload.boolean; }
+    [[nodiscard]] long integer() const noexcept { return payload.integer; }
+    [[nodiscard]] double floating() const noexcept { return payload.floating; }
+    [[nodiscard]] symbol name() const noexcept { return payload.name; }
+    [[nodiscard]] value_id value() const noexcept { return payload.value; }
+
+    const ir::type * type = nullptr;
 
   private:
+    union {
+        long integer = 0;
+        bool boolean;
+        double floating;
+        symbol name;
+        value_id value;
+    } payload;
+    kind tag = kind::immediate;
+
     friend std::ostream & operator<<(std::ostream & lhs, const operand & rhs);
 };
+static_assert(std::is_trivially_copyable_v<operand>);
+
+// Where instructions keep the operands that do not fit in them. Operands are handed out in
+// chunks and stay where they are until the arena goes away.
+class operand_arena {
+  public:
+    [[nodiscard]] operand * allocate(size_t count);
+
+  private:
+    static constexpr size_t chunk_size = 256;
+
+    std::vector<std::unique_ptr<operand[]>> chunks{};
+    // The size of the last chunk, and how much of it is handed out
+    size_t capacity = 0;
+    size_t used = 0;
+};
+
+// Operands that are next to each other, like the inputs of an instruction
+class operand_range {
+  public:
+    constexpr operand_range() noexcept = default;
+    constexpr operand_range(const operand * first, const operand * last) noexcept
+        : first{first}, last{last} {}
+
+    [[nodiscard]] constexpr const operand * begin() const noexcept { return first; }
+    [[nodiscard]] constexpr const operand * end() const noexcept { return last; }
+    [[nodiscard]] constexpr size_t size() const noexcept { return last - first; }
+    [[nodiscard]] constexpr bool empty() const noexcept { return first == last; }
+    [[nodiscard]] constexpr const operand & front() const noexcept { return *first; }
+    [[nodiscard]] constexpr const operand & back() const noexcept { return *(last - 1); }
+    [[nodiscard]] constexpr const operand & operator[](size_t pos) const noexcept {
+        return first[pos];
+    }
+
+  private:
+    const operand * first = nullptr;
+    const operand * last = nullptr;
+};
+
+// The operands of an instruction. Most instructions have at most three, which are kept in the
+// instruction itself. Longer lists, like the arguments of calls, are kept in an operand_arena
+// that has to outlive the instruction.
+class operand_list {
+  public:
+    static constexpr size_t inline_capacity = 3;
+
+    operand_list() noexcept = default;
+    // Throws if there are more than inline_capacity operands
+    operand_list(std::initializer_list<operand> operands);
+    operand_list(const std::vector<operand> & operands, operand_arena & overflow);
+
+    [[nodiscard]] operand * begin() noexcept { return data(); }
+    [[nodiscard]] operand * end() noexcept { return data() + count; }
+    [[nodiscard]] const operand * begin() const noexcept { return data(); }
+    [[nodiscard]] const operand * end() const noexcept { return data() + count; }
+    [[nodiscard]] size_t size() const noexcept { return count; }
+    [[nodiscard]] bool empty() const noexcept { return count == 0; }
+
+    [[nodiscard]] operand & front() noexcept { return *begin(); }
+    [[nodiscard]] const operand & front() const noexcept { return *begin(); }
+    [[nodiscard]] operand & back() noexcept { return *(end() - 1); }
+    [[nodiscard]] const operand & back() const noexcept { return *(end() - 1); }
+    [[nodiscard]] const operand & at(size_t pos) const;
+
+    // The operands from first up to last, which throws if last is past the end
+    [[nodiscard]] operand_range slice(size_t first, size_t last) const;
+
+  private:
+    [[nodiscard]] operand * data() noexcept {
+        return overflow != nullptr ? overflow : inline_operands.data();
+    }
+    [[nodiscard]] const operand * data() const noexcept {
+        return overflow != nullptr ? overflow : inline_operands.data();
+    }
+
+    std::array<operand, inline_capacity> inline_operands{};
+    operand * overflow = nullptr;
+    uint32_t count = 0;
+};
 
 struct three_address {
     operation op;
-    std::vector<operand> operands;
+    operand_list operands;
     [[nodiscard]] std::optional<operand> result() const;
-    [[nodiscard]] std::vector<operand> inputs() const;
+    [[nodiscard]] operand_range inputs() const;
 
   private:
     friend std::ostream & operator<<(std::ostream & lhs, const three_address & rhs);
 };
 
-struct basic_block {
-    explicit basic_block(std::string name, std::vector<three_address> inst = {})
-        : name{std::move(name)}, contents{std::move(inst)} {}
-    std::string name;
-    std::vector<three_address> contents;
-    bool terminated();
+// Links an element into an intrusive_list. Copies are not linked into any list.
+template <typename T> class list_node {
+  public:
+    list_node() noexcept = default;
+    list_node(const list_node &) noexcept {}
+    list_node & operator=(const list_node &) noexcept { return *this; }
+
+  private:
+    T * prev = nullptr;
+    T * next = nullptr;
+
+    template <typename> friend class intrusive_list;
+};
+
+// A doubly linked list of elements that are owned somewhere else. The elements are their own
+// nodes, so they are inserted and erased without allocating and without walking the list.
+template <typename T> class intrusive_list {
+    template <typename U> class basic_iterator {
+      public:
+        using iterator_category = std::bidirectional_iterator_tag;
+        using value_type = std::remove_const_t<U>;
+        using difference_type = std::ptrdiff_t;
+        using pointer = U *;
+        using reference = U &;
+
+        basic_iterator(U * node, const intrusive_list * list) noexcept
+            : node{node}, list{list} {}
+
+        reference operator*() const noexcept { return *node; }
+        pointer operator->() const noexcept { return node; }
+
+        basic_iterator & operator++() noexcept {
+            node = next_of(*node);
+            return *this;
+        }
+        basic_iterator operator++(int) noexcept {
+            auto to_ret = *this;
+            ++*this;
+            return to_ret;
+        }
+        // Going back from the end goes to the last element
+        basic_iterator & operator--() noexcept {
+            node = node != nullptr ? prev_of(*node) : list->tail;
+            return *this;
+        }
+        basic_iterator operator--(int) noexcept {
+            auto to_ret = *this;
+            --*this;
+            return to_ret;
+        }
+
+        bool operator==(const basic_iterator & rhs) const noexcept { return node == rhs.node; }
+        bool operator!=(const basic_iterator & rhs) const noexcept { return node != rhs.node; }
+
+      private:
+        U * node;
+        const intrusive_list * list;
+
+        friend class intrusive_list;
+    };
+
+  public:
+    using iterator = basic_iterator<T>;
+    using const_iterator = basic_iterator<const T>;
+
+    intrusive_list() noexcept = default;
+    intrusive_list(const intrusive_list &) = delete;
+    intrusive_list & operator=(const intrusive_list &) = delete;
+
+    [[nodiscard]] iterator begin() noexcept { return {head, this}; }
+    [[nodiscard]] iterator end() noexcept { return {nullptr, this}; }
+    [[nodiscard]] const_iterator begin() const noexcept { return {head, this}; }
+    [[nodiscard]] const_iterator end() const noexcept { return {nullptr, this}; }
+    [[nodiscard]] size_t size() const noexcept { return count; }
+    [[nodiscard]] bool empty() const noexcept { return count == 0; }
+
+    // The list must not be empty
+    [[nodiscard]] T & front() noexcept {
+        assert(head != nullptr);
+        return *head;
+    }
+    [[nodiscard]] const T & front() const noexcept {
+        assert(head != nullptr);
+        return *head;
+    }
+    [[nodiscard]] T & back() noexcept {
+        assert(tail != nullptr);
+        return *tail;
+    }
+    [[nodiscard]] const T & back() const noexcept {
+        assert(tail != nullptr);
+        return *tail;
+    }
+
+    void push_back(T & item) noexcept { insert(end(), item); }
+    // Links item in before pos. The item must not be in a list already.
+    iterator insert(iterator pos, T & item) noexcept {
+        auto & links = node_of(item);
+        links.next = pos.node;
+        links.prev = pos.node != nullptr ? prev_of(*pos.node) : tail;
+
+        if (links.prev != nullptr) node_of(*links.prev).next = &item;
+        else
+            head = &item;
+        if (links.next != nullptr) node_of(*links.next).prev = &item;
+        else
+            tail = &item;
+
+        count++;
+        return {&item, this};
+    }
+    // Unlinks the element at pos, and returns the one after it
+    iterator erase(iterator pos) noexcept {
+        auto & links = node_of(*pos.node);
+        if (links.prev != nullptr) node_of(*links.prev).next = links.next;
+        else
+            head = links.next;
+        if (links.next != nullptr) node_of(*links.next).prev = links.prev;
+        else
+            tail = links.prev;
+
+        const iterator to_ret{links.next, this};
+        links.prev = links.next = nullptr;
+        count--;
+        return to_ret;
+    }
+    [[nodiscard]] iterator iterator_to(T & item) noexcept { return {&item, this}; }
+
+  private:
+    static list_node<T> & node_of(T & item) noexcept { return item; }
+    static T * next_of(const T & item) noexcept {
+        return static_cast<const list_node<T> &>(item).next;
+    }
+    static T * prev_of(const T & item) noexcept {
+        return static_cast<const list_node<T> &>(item).prev;
+    }
+
+    T * head = nullptr;
+    T * tail = nullptr;
+    size_t count = 0;
+};
+
+// An instruction in a block of a function
+struct instruction : three_address, list_node<instruction> {};
+
+// Where the instructions of a function are kept. Instructions stay where they are until they
+// are erased, and erased ones are reused for the next instructions.
+class instruction_arena {
+  public:
+    [[nodiscard]] instruction * allocate(const three_address & inst);
+    void release(instruction * inst);
+
+  private:
+    // Most functions are small, so chunks start small and grow with the function
+    static constexpr size_t first_chunk_size = 16;
+    static constexpr size_t last_chunk_size = 256;
+
+    std::vector<std::unique_ptr<instruction[]>> chunks{};
+    size_t chunk_size = 0;
+    // How much of the last chunk is handed out
+    size_t used = 0;
+    std::vector<instruction *> released{};
+};
+
+struct basic_block : list_node<basic_block> {
+    explicit basic_block(symbol name) : name{name} {}
+    symbol name;
+    // Added and removed through the function the block is in
+    intrusive_list<instruction> instructions{};
+    [[nodiscard]] bool terminated() const;
 };
 
 struct function {
-    explicit function(std::string name, std::shared_ptr<ir::function_type> type)
-        : name{std::move(name)}, type{std::move(type)} {}
+    explicit function(symbol name, const ir::function_type * type) : name{name}, type{type} {}
 
-    [[nodiscard]] three_address * instruction_number(size_t) const;
+    // The blocks in order. Blocks and instructions are only added and removed through the
+    // functions below, which take constant time.
+    [[nodiscard]] intrusive_list<basic_block> & blocks() noexcept { return body; }
+    [[nodiscard]] const intrusive_list<basic_block> & blocks() const noexcept { return body; }
+    basic_block & append_block(symbol name);
+    // Adds the block before pos
+    basic_block & insert_block(intrusive_list<basic_block>::iterator pos, symbol name);
+    // Also erases the instructions in the block
+    void erase_block(basic_block & block);
+
+    instruction & append(basic_block & block, const three_address & inst);
+    // Adds the instruction before pos, which is in the block
+    instruction & insert(basic_block & block, instruction & pos, const three_address & inst);
+    void erase(basic_block & block, instruction & inst);
+
+    // The instruction at that position, counting through the blocks in order.
+    // Returns nullptr if the function has fewer instructions.
+    // The index behind it is rebuilt on the first call after instructions were added or removed.
+    [[nodiscard]] const instruction * instruction_number(size_t pos) const;
 
     [[nodiscard]] std::vector<ir::operand> parameters() const;
 
-    std::string name;
-    std::vector<std::unique_ptr<basic_block>> body{};
-    std::vector<std::string> param_names;
-    std::shared_ptr<ir::function_type> type;
+    // A value nothing else has, like a temporary
+    [[nodiscard]] value_id new_value();
+    // The same value every time for the same name, like a variable or a parameter
+    value_id named_value(symbol name);
+    // Empty for temporaries
+    [[nodiscard]] symbol value_name(value_id value) const { return value_names.at(id(value)); }
+    [[nodiscard]] size_t value_count() const noexcept { return value_names.size(); }
+
+    // Print with the names of the values instead of their numbers
+    struct named_operand {
+        const function & func;
+        const operand & op;
+    };
+    struct named_instruction {
+        const function & func;
+        const three_address & inst;
+    };
+    [[nodiscard]] named_operand named(const operand & op) const { return {*this, op}; }
+    [[nodiscard]] named_instruction named(const three_address & inst) const {
+        return {*this, inst};
+    }
+
+    symbol name;
+    std::vector<symbol> param_names;
+    const ir::function_type * type;
+    // The operands of instructions that have too many to keep them inline
+    operand_arena overflow{};
+
+  private:
+    std::vector<std::unique_ptr<basic_block>> block_storage{};
+    intrusive_list<basic_block> body{};
+    instruction_arena instruction_storage{};
+
+    mutable std::vector<const instruction *> numbering{};
+    mutable bool numbering_valid = true;
+
+    static constexpr size_t id(value_id value) noexcept { return static_cast<size_t>(value); }
+
+    std::vector<symbol> value_names{};
+    std::unordered_map<symbol, value_id> named_values{};
 };
 
+std::ostream & operator<<(std::ostream & lhs, const function::named_operand & rhs);
+std::ostream & operator<<(std::ostream & lhs, const function::named_instruction & rhs);
+
 class program {
   public:
     explicit program();
@@ -97,34 +452,71 @@ class program {
 
     ~program() noexcept = default;
 
-    [[nodiscard]] bool function_exists(const std::string & name) const noexcept;
-    [[nodiscard]] bool function_exists(const std::string & name, size_t param_count) const noexcept;
-    [[nodiscard]] bool function_exists(const std::string & name,
+    [[nodiscard]] bool function_exists(symbol name) const noexcept;
+    [[nodiscard]] bool function_exists(symbol name, size_t param_count) const noexcept;
+    [[nodiscard]] bool function_exists(symbol name,
                                        const ir::function_type & func_type) const noexcept;
 
-    [[nodiscard]] function * lookup_function(const std::string & name) const noexcept;
-    [[nodiscard]] function * lookup_function(const std::string & name,
+    [[nodiscard]] function * lookup_function(symbol name) const noexcept;
+    [[nodiscard]] function * lookup_function(symbol name,
                                              size_t param_count) const noexcept;
-    [[nodiscard]] function * lookup_function(const std::string & name,
+    [[nodiscard]] function * lookup_function(symbol name,
                                              const ir::function_type & func_type) const noexcept;
 
-    [[nodiscard]] function * register_function(const std::string & name,
-                                               std::shared_ptr<ir::function_type> func_type);
+    // The functions with that name and number of parameters, in the order they were registered
+    [[nodiscard]] const std::vector<function *> & candidates(symbol name,
+                                                            size_t param_count) const noexcept;
+
+    // Returns the function that is already registered with that name and type, if there is one.
+    // Functions stay where they are until they are removed.
+    [[nodiscard]] function * register_function(symbol name, const ir::function_type * func_type);
+    // Every function with that name, whatever its type
+    void remove_function(symbol name);
 
     // This function first looks up the type where the name is equal to the given name.
     // Next, if the first lookup failed, it finds the type of the function with the given name.
-    [[nodiscard]] std::shared_ptr<ir::type> lookup_type(const std::string & name);
+    [[nodiscard]] const ir::type * lookup_type(symbol name);
+    [[nodiscard]] const ir::type * lookup_type(std::string_view name) {
+        return lookup_type(intern(name));
+    }
+    [[nodiscard]] ir::type_table & types() noexcept { return type_context; }
 
-    void for_each_func(const std::function<void(ir::function *)> & visitor) const {
+    template<typename Visitor> void for_each_func(Visitor && visitor) const {
         for (const auto & func : prog) visitor(func.get());
     }
 
-    [[nodiscard]] std::shared_ptr<ir::type>
-    generate_func_type(const std::vector<std::string> param_types, std::string return_type);
+    // Returns nullptr if one of the names is not a type
+    [[nodiscard]] const ir::function_type *
+    generate_func_type(const std::vector<std::string> & param_types,
+                       const std::string & return_type);
 
   private:
+    struct name_and_arity {
+        symbol name;
+        size_t param_count;
+        bool operator==(const name_and_arity & rhs) const noexcept {
+            return name == rhs.name and param_count == rhs.param_count;
+        }
+    };
+    struct name_and_type {
+        symbol name;
+        const ir::function_type * type;
+        bool operator==(const name_and_type & rhs) const noexcept {
+            return name == rhs.name and type == rhs.type;
+        }
+    };
+    struct key_hash {
+        size_t operator()(const name_and_arity & key) const noexcept;
+        size_t operator()(const name_and_type & key) const noexcept;
+    };
+
+    // In the order the functions were registered
     std::vector<std::unique_ptr<ir::function>> prog;
-    std::map<std::string, std::shared_ptr<ir::type>> types;
+    // The same functions by what they are looked up with, each list in the order of prog
+    std::unordered_map<symbol, std::vector<ir::function *>> by_name;
+    std::unordered_map<name_and_arity, std::vector<ir::function *>, key_hash> by_arity;
+    std::unordered_map<name_and_type, ir::function *, key_hash> by_signature;
+    ir::type_table type_context;
 };
 
 } // namespace ir
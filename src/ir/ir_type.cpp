@@ -0,0 +1,60 @@
+//
+// Created by nick on 10/17/26.
+//
+
+#include "ir_type.h"
+
+#include <functional>
+
+namespace ir {
+
+type_table::type_table() {
+    primitives = {std::make_unique<unit_type>(),   std::make_unique<boolean_type>(),
+                  std::make_unique<string_type>(), std::make_unique<i32_type>(),
+                  std::make_unique<i64_type>(),    std::make_unique<f32_type>(),
+                  std::make_unique<f64_type>()};
+
+    names.emplace(intern("unit"), primitive(ir_type::unit));
+    names.emplace(intern("boolean"), primitive(ir_type::boolean));
+    names.emplace(intern("string"), primitive(ir_type::str));
+    names.emplace(intern("int32"), primitive(ir_type::i32));
+    names.emplace(intern("int64"), primitive(ir_type::i64));
+    names.emplace(intern("float32"), primitive(ir_type::f32));
+    names.emplace(intern("float64"), primitive(ir_type::f64));
+}
+
+const type * type_table::named(symbol name) const noexcept {
+    const auto iter = names.find(name);
+    return iter != names.end() ? iter->second : nullptr;
+}
+
+const function_type * type_table::function(std::vector<const type *> parameters,
+                                           const type * return_type) {
+    auto key = parameters;
+    key.push_back(return_type);
+
+    auto & func = functions[std::move(key)];
+    if (func == nullptr)
+        func.reset(new function_type{std::move(parameters), return_type});
+    return func.get();
+}
+
+struct_type * type_table::structure(symbol name) {
+    auto & to_ret = structs[name];
+    if (to_ret == nullptr) {
+        to_ret = std::make_unique<struct_type>(std::string{text_of(name)});
+        names.emplace(name, to_ret.get());
+    }
+    return to_ret.get();
+}
+
+size_t type_table::signature_hash::operator()(const signature & types) const noexcept {
+    size_t seed = types.size();
+    for (const auto * item : types) {
+        const auto value = std::hash<const type *>{}(item);
+        seed ^= value + 0x9e3779b97f4a7c15ul + (seed << 6u) + (seed >> 2u);
+    }
+    return seed;
+}
+
+} // namespace ir
@@ -5,8 +5,13 @@
 #ifndef NEW_J_COMPILER_IR_TYPE_H
 #define NEW_J_COMPILER_IR_TYPE_H
 
+#include "ast/interner.h"
+
+#include <array>
+#include <cstdint>
 #include <memory>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 namespace ir {
@@ -51,19 +56,16 @@ struct string_type final : public type {
 };
 
 struct function_type final : public type {
-
-    function_type(std::vector<std::shared_ptr<type>> && params, std::shared_ptr<type> return_type)
-        : parameters{std::move(params)}, return_type{std::move(return_type)} {}
-
     [[nodiscard]] explicit operator ir_type() const noexcept final { return ir_type::func; }
 
-    std::vector<std::shared_ptr<type>> parameters;
-    std::shared_ptr<type> return_type;
+    std::vector<const type *> parameters;
+    const type * return_type;
 
   private:
-    friend bool operator==(const function_type & lhs, const function_type & rhs) noexcept {
-        return lhs.parameters == rhs.parameters and lhs.return_type == rhs.return_type;
-    }
+    // Only made by type_table, so that there is one for each signature
+    friend class type_table;
+    function_type(std::vector<const type *> && params, const type * return_type)
+        : parameters{std::move(params)}, return_type{return_type} {}
 };
 
 struct struct_type final : public type {
@@ -76,13 +78,53 @@ struct struct_type final : public type {
 
     struct field {
         std::string name;
-        std::shared_ptr<ir::type> type;
+        const ir::type * type;
         uint64_t offset;
     };
 
     std::vector<field> fields;
 };
 
+// Every type of a program is made here, and only once: there is one of each primitive,
+// one function type for each signature, and one struct type for each name.
+// Types can be compared by their address, and live as long as the table.
+class type_table {
+  public:
+    type_table();
+
+    type_table(const type_table &) = delete;
+    type_table & operator=(const type_table &) = delete;
+
+    type_table(type_table &&) noexcept = default;
+    type_table & operator=(type_table &&) noexcept = default;
+
+    ~type_table() noexcept = default;
+
+    [[nodiscard]] const type * primitive(ir_type kind) const noexcept {
+        return primitives.at(static_cast<size_t>(kind)).get();
+    }
+    // The type a name in the source refers to, like int32 or the name of a struct.
+    // Returns nullptr if there is none.
+    [[nodiscard]] const type * named(symbol name) const noexcept;
+
+    [[nodiscard]] const function_type * function(std::vector<const type *> parameters,
+                                                 const type * return_type);
+    // The struct with that name, which is empty when it is made
+    [[nodiscard]] struct_type * structure(symbol name);
+
+  private:
+    // The parameters, followed by the return type
+    using signature = std::vector<const type *>;
+    struct signature_hash {
+        size_t operator()(const signature & types) const noexcept;
+    };
+
+    std::array<std::unique_ptr<type>, static_cast<size_t>(ir_type::func)> primitives;
+    std::unordered_map<symbol, const type *> names;
+    std::unordered_map<signature, std::unique_ptr<function_type>, signature_hash> functions;
+    std::unordered_map<symbol, std::unique_ptr<struct_type>> structs;
+};
+
 } // namespace ir
 
 #endif // NEW_J_COMPILER_IR_TYPE_H
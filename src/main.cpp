@@ -1,13 +1,105 @@
 
+#include "ast/diagnostics.h"
 #include "ast/lexer.h"
 #include "ast/nodes.h"
 #include "ast/parser.h"
 #include "ast/program.h"
+#include "ast/scan.h"
+#include "ast_cache.h"
 #include "bytecode.h"
 #include "config.h"
 #include "visitor.h"
+#include "watch.h"
 
+#include <array>
+#include <chrono>
+#include <cstdint>
 #include <iostream>
+#include <limits>
+#include <numeric>
+#include <type_traits>
+
+#if __has_include(<sys/resource.h>)
+#include <sys/resource.h>
+#endif
+
+namespace {
+// The most memory the process has had resident, or 0 if the platform cannot tell
+double peak_rss_megabytes() {
+#if __has_include(<sys/resource.h>)
+    rusage usage{};
+    // Linux reports kilobytes
+    if (getrusage(RUSAGE_SELF, &usage) == 0) return usage.ru_maxrss / 1e3;
+#endif
+    return 0;
+}
+
+// Both return how many nodes were seen
+long walk(ast::program & program) {
+    counting_visitor counter{};
+    program.visit([&counter](const auto & item) { counter.visit(item); });
+    return counter.visited_count();
+}
+long walk(const ast::flat_tree & tree) {
+    // A pass that does not care about nesting is a scan over the node arrays
+    std::array<long, std::numeric_limits<uint8_t>::max() + 1> kinds{};
+    for (uint32_t i = 0; i < tree.size(); i++) kinds[static_cast<uint8_t>(tree.kind({i}))]++;
+    return std::accumulate(kinds.begin(), kinds.end(), 0l);
+}
+
+// Loads the syntax tree from the cache if the same text was parsed before.
+// Otherwise parses the file and adds the tree to the cache, unless parsing found errors.
+std::unique_ptr<ast::program> parse_cached(const user_settings & settings) {
+    const ast_cache cache{settings.cache_directory};
+
+    const auto file = source_manager::global().open(settings.input_filename);
+    // The lexer reports that the file cannot be opened
+    if (not file.has_value())
+        return parser{lexer{settings.input_filename}}.parse_program(settings.parse_threads);
+
+    if (auto program = cache.load(file.value()); program != nullptr) {
+        diag::note() << "Loaded the syntax tree of " << settings.input_filename << " from "
+                     << settings.cache_directory;
+        return program;
+    }
+
+    const auto errors_before = diagnostics::global().error_count();
+    auto program = parser{lexer{file.value()}}.parse_program(settings.parse_threads);
+    if (program != nullptr and diagnostics::global().error_count() == errors_before
+        and not cache.store(file.value(), *program))
+        diag::warning() << "Could not add the syntax tree of " << settings.input_filename
+                        << " to " << settings.cache_directory;
+    return program;
+}
+
+// Prints the diagnostics that are still kept, whichever way main returns
+struct flush_diagnostics {
+    ~flush_diagnostics() { diagnostics::global().flush(); }
+};
+
+template<typename parser_type>
+void report_parse(const user_settings & settings) {
+    const auto start = std::chrono::steady_clock::now();
+    auto program = [&settings] {
+        // Only the pointer tree is cached
+        if constexpr (std::is_same_v<parser_type, parser>)
+            if (not settings.cache_directory.empty()) return parse_cached(settings);
+        return parser_type{lexer{settings.input_filename}}.parse_program(settings.parse_threads);
+    }();
+    const auto parsed = std::chrono::steady_clock::now();
+    const auto node_count = walk(*program);
+    const auto walked = std::chrono::steady_clock::now();
+    program.reset();
+    const auto freed = std::chrono::steady_clock::now();
+
+    const std::chrono::duration<double, std::milli> parse_time = parsed - start;
+    const std::chrono::duration<double, std::milli> walk_time = walked - parsed;
+    const std::chrono::duration<double, std::milli> free_time = freed - walked;
+    std::cout << "Parsed in " << parse_time.count() << " ms, walked " << node_count
+              << " nodes in " << walk_time.count() << " ms, freed in " << free_time.count()
+              << " ms, peak RSS " << peak_rss_megabytes() << " MB" << std::endl;
+}
+} // namespace
 
 int main(const int arg_count, const char ** args) {
     const auto user_args = parse_cmdline_args(arg_count, args);
@@ -18,7 +110,20 @@ int main(const int arg_count, const char ** args) {
                      "Options: [-h|--help|-v|--version] <input filename>\n"
                      "\t-h or --help -> print this help message and exit\n"
                      "\t-v or --version -> print version number and exit\n"
-                     "\tinput filename -> the input source code to compile"
+                     "\t-q or --quiet -> print only errors and what was asked for with -f "
+                     "options\n"
+                     "\t--verbose -> also print notes on what the compiler is doing\n"
+                     "\t--watch -> build again every time the input file is written\n"
+                     "\t-flex-only -> only tokenize the input and report the throughput\n"
+                     "\t-fparse-only -> only parse and walk the input, and report the time and "
+                     "memory\n"
+                     "\t-fflat-ast -> build the array based syntax tree for -fparse-only and "
+                     "-fsyntax-tree\n"
+                     "\t-fparse-threads=<n> -> parse top level items on n threads\n"
+                     "\t-fno-simd -> scan the input one character at a time\n"
+                     "\t-fcache-dir=<dir> -> keep parsed syntax trees in dir and reuse them "
+                     "while the input does not change\n"
+                     "\tinput filename -> the input source code to compile, or - for stdin"
                   << std::endl;
         return 0;
     } else if (user_args->print_version) {
@@ -26,14 +131,58 @@ int main(const int arg_count, const char ** args) {
         return 0;
     }
 
-    std::cout << "File to read: " << user_args->input_filename << std::endl;
+    diagnostics::global().set_verbosity(user_args->diagnostics);
+    const flush_diagnostics flush_on_return{};
+    const auto quiet = user_args->diagnostics == verbosity::quiet;
+
+    if (not quiet) std::cout << "File to read: " << user_args->input_filename << std::endl;
+
+    scan::use_simd(user_args->simd);
+
+    if (user_args->lex_only) {
+        lexer lex{user_args->input_filename};
 
-    parser p{lexer{user_args->input_filename}};
+        const auto start = std::chrono::steady_clock::now();
+        size_t token_count = 0;
+        auto tok = lex.next();
+        for (; tok.type() != token_type::EndOfFile; tok = lex.next()) token_count++;
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
 
-    auto program = p.parse_program();
-    if (program == nullptr) std::cout << "Failed\n";
+        // The end of file token sits at the end of the text
+        const auto megabytes = tok.start() / 1e6;
+        std::cout << "Lexed " << token_count << " tokens from " << megabytes << " MB in "
+                  << elapsed.count() * 1e3 << " ms (" << megabytes / elapsed.count() << " MB/s, "
+                  << scan::implementation() << ")" << std::endl;
+        return 0;
+    }
+
+    if (user_args->parse_only) {
+        if (user_args->flat_ast) report_parse<flat_parser>(*user_args);
+        else
+            report_parse<parser>(*user_args);
+        return 0;
+    }
+
+    if (user_args->watch) return watch(*user_args);
+
+    if (user_args->flat_ast and user_args->print_syntax) {
+        // Code generation still works on the pointer tree, so stop after printing
+        const auto tree = flat_parser{lexer{user_args->input_filename}}.parse_program();
+        std::cout << "Syntax tree:\n";
+        printing_visitor pv{};
+        for (const auto root : tree->roots()) pv.visit(*tree, root);
+        std::cout << "Visited " << pv.visited_count() << " nodes" << std::endl;
+        return 0;
+    }
+
+    auto program = user_args->cache_directory.empty()
+                       ? parser{lexer{user_args->input_filename}}.parse_program(
+                           user_args->parse_threads)
+                       : parse_cached(*user_args);
+    diagnostics::global().flush();
+    if (program == nullptr) diag::error() << "Parsing failed";
     else {
-        std::cout << "Success\n";
+        if (not quiet) std::cout << "Success\n";
 
         if (user_args->print_syntax) {
             std::cout << "Syntax tree:\n";
@@ -44,6 +193,7 @@ int main(const int arg_count, const char ** args) {
 
         ir_gen_visitor ir_gen{};
         program->visit([&](auto & node) { ir_gen.visit(node); });
+        diagnostics::global().flush();
         if (user_args->print_ir) {
             std::cout << "IR Dump" << std::endl;
             ir_gen.dump();
@@ -51,17 +201,16 @@ int main(const int arg_count, const char ** args) {
 
         auto bytecode = bytecode::program::from_ir(ir_gen.program());
         if (not bytecode.has_value()) {
-            std::cerr << "Bytecode generation failed." << std::endl;
+            diag::error() << "Bytecode generation failed.";
         } else {
-            std::cout << "Bytecode generated" << std::endl;
+            if (not quiet) std::cout << "Bytecode generated" << std::endl;
             if (user_args->print_bytecode) { bytecode->print_human_readable(std::cout); }
 
-            auto byte_code_dest = user_args->input_filename;
-            // Delete everything after the dot
-            byte_code_dest.erase(byte_code_dest.find_last_of('.'));
-            byte_code_dest += ".bin";
-            std::cout << "Bytecode output to " << byte_code_dest << std::endl;
+            const auto byte_code_dest = bytecode::output_filename(user_args->input_filename);
+            if (not quiet) std::cout << "Bytecode output to " << byte_code_dest << std::endl;
             bytecode->print_file(byte_code_dest);
         }
     }
+
+    return diagnostics::global().error_count() == 0 ? 0 : 1;
 }
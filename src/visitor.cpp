@@ -4,267 +4,444 @@
 
 #include "visitor.h"
 
+#include "ast/diagnostics.h"
+#include "ast/flat_tree.h"
 #include "ast/nodes.h"
 
+#include <algorithm>
 #include <iostream>
+#include <utility>
+#include <vector>
 
-void printing_visitor::visit(const ast::node & node) {
+namespace {
+symbol entry_block_name(symbol function_name) {
+    return intern(std::string{text_of(function_name)} + "_entry");
+}
+} // namespace
+
+void printing_visitor::visit(const ast::function & func_decl) {
+    const auto nested = enter();
+    std::cout << "Function decl for " << func_decl.identifier() << '\n';
+    visit(func_decl.name);
+    for (const auto & param : func_decl.params) visit(param);
+    visit(*func_decl.body);
+}
+
+void printing_visitor::visit(const ast::parameter & param) {
+    const auto nested = enter();
+    std::cout << "Parameter " << param.text() << '\n';
+}
+
+void printing_visitor::visit(const ast::opt_typed & name) {
+    const auto nested = enter();
+    std::cout << "Optionally typed " << name.text() << '\n';
+    print_indent();
+    std::cout << "Has user type: " << name.user_explicit() << '\n';
+}
+
+void printing_visitor::visit(const ast::var_decl & decl) {
+    const auto nested = enter();
+    std::cout << (decl.detail == ast::var_decl::details::Let ? "Variable" : "Const")
+              << " decl for " << decl.identifier() << '\n';
+    if (decl.detail != ast::var_decl::details::Let) {
+        print_indent();
+        std::cout << "Is global: " << decl.in_global_scope() << '\n';
+    }
+    visit(decl.name);
+    visit(*decl.val);
+}
+
+void printing_visitor::visit(const ast::struct_decl & decl) {
+    const auto nested = enter();
+    std::cout << "Unimplemented visit on node " << decl.text() << std::endl;
+}
+
+void printing_visitor::visit(const ast::stmt_block & block) {
+    const auto nested = enter();
+    std::cout << "Statement block " << block.text() << '\n';
+    for (const auto & stmt : block.stmts) visit(*stmt);
+}
+
+void printing_visitor::visit(const ast::if_stmt & condition) {
+    const auto nested = enter();
+    std::cout << "If statement\n";
+    visit(*condition.cond);
+    visit(*condition.then_block);
+    if (condition.else_block != nullptr) visit(*condition.else_block);
+}
+
+void printing_visitor::visit(const ast::while_loop & loop) {
+    const auto nested = enter();
+    std::cout << "While loop\n";
+    visit(*loop.condition);
+    visit(*loop.body);
+}
+
+void printing_visitor::visit(const ast::ret_stmt & ret) {
+    const auto nested = enter();
+    std::cout << "Return\n";
+    if (ret.value != nullptr) visit(*ret.value);
+}
 
+void printing_visitor::visit(const ast::assign_stmt & assign_stmt) {
+    const auto nested = enter();
+    std::cout << "Assignment statement\n";
     print_indent();
-    indent_depth += indent_size;
+    std::cout << "Is op-assign: " << std::boolalpha
+              << (assign_stmt.assign_op != ast::operation::assign) << '\n';
+    visit(*assign_stmt.dest);
+    visit(*assign_stmt.value_src);
+}
+
+void printing_visitor::visit(const ast::func_call & call) {
+    const auto nested = enter();
+    std::cout << "Function call to " << call.text() << '\n';
+    visit(*call.func_name);
+    for (const auto & arg : call.arguments) visit(*arg);
+}
+
+void printing_visitor::visit(const ast::literal_or_variable & value) {
+    const auto nested = enter();
+    std::cout << "Value " << value.text() << '\n';
+}
+
+void printing_visitor::visit(const ast::bin_op & bin_op) {
+    // Operator chains are as long as the input makes them, so they are walked without recursion
+    const auto depth = indent_depth;
+    std::vector<std::pair<const ast::expression *, int>> pending{{&bin_op, depth}};
+    while (not pending.empty()) {
+        const auto [expr, expr_depth] = pending.back();
+        pending.pop_back();
+
+        indent_depth = expr_depth;
+        if (expr->type() != ast::node_type::binary_op) {
+            visit(*expr);
+            continue;
+        }
+
+        const auto & op = static_cast<const ast::bin_op &>(*expr);
+        const auto nested = enter();
+        std::cout << "Binary operation\n";
+        pending.emplace_back(&op.rhs_ref(), indent_depth);
+        pending.emplace_back(&op.lhs_ref(), indent_depth);
+    }
+    indent_depth = depth;
+}
 
-    if (node_count == 0) std::cout << std::boolalpha;
+void printing_visitor::visit(const ast::flat_tree & tree, ast::node_ref node) {
+    // Statements and expressions nest as deep as the input does
+    stack_guard::nested([this, &tree, node] { print_node(tree, node); });
+}
 
-    this->node_count++;
+void printing_visitor::print_node(const ast::flat_tree & tree, ast::node_ref node) {
+    const auto nested = enter();
 
-    switch (node.type()) {
+    switch (tree.kind(node)) {
     case ast::node_type::var_decl: {
-        auto & decl = dynamic_cast<const ast::var_decl &>(node);
-        std::cout << (decl.detail == ast::var_decl::details::Let ? "Variable" : "Const")
-                  << " decl for " << decl.identifier() << '\n';
-        if (decl.detail != ast::var_decl::details::Let) {
+        const auto detail = static_cast<ast::var_decl::details>(tree.detail(node));
+        std::cout << (detail == ast::var_decl::details::Let ? "Variable" : "Const")
+                  << " decl for " << tree.identifier(node) << '\n';
+        if (detail != ast::var_decl::details::Let) {
             print_indent();
-            std::cout << "Is global: " << decl.in_global_scope() << '\n';
+            std::cout << "Is global: " << (detail == ast::var_decl::details::GlobalConst) << '\n';
         }
-        visit(decl.name);
-        visit(*decl.val);
+        visit(tree, tree.lhs(node));
+        visit(tree, tree.rhs(node));
     } break;
     case ast::node_type::function: {
-        auto & func_decl = dynamic_cast<const ast::function &>(node);
-        std::cout << "Function decl for " << func_decl.identifier() << '\n';
-        visit(func_decl.name);
-        for (const auto & param : func_decl.params) visit(param);
-        visit(*func_decl.body);
+        std::cout << "Function decl for " << tree.identifier(node) << '\n';
+        visit(tree, tree.lhs(node));
+        // The body comes first, followed by the parameters
+        const auto children = tree.rhs_list(node);
+        for (size_t i = 1; i < children.size(); i++) visit(tree, children[i]);
+        visit(tree, children[0]);
     } break;
     case ast::node_type::parameter:
-        std::cout << "Parameter " << node.text() << '\n';
+        std::cout << "Parameter " << tree.text(node) << '\n';
+        break;
+    case ast::node_type::statement_block:
+        std::cout << "Statement block " << tree.text(node) << '\n';
+        for (const auto stmt : tree.lhs_list(node)) visit(tree, stmt);
         break;
-    case ast::node_type::statement_block: {
-        auto & block = dynamic_cast<const ast::stmt_block &>(node);
-        std::cout << "Statement block " << block.text() << '\n';
-        for (const auto & stmt : block.stmts) visit(*stmt);
-    } break;
     case ast::node_type::value:
-        std::cout << "Value " << node.text() << '\n';
+        std::cout << "Value " << tree.text(node) << '\n';
         break;
     case ast::node_type::opt_typed:
-        std::cout << "Optionally typed " << node.text() << '\n';
+        std::cout << "Optionally typed " << tree.text(node) << '\n';
         print_indent();
-        std::cout << "Has user type: " << dynamic_cast<const ast::opt_typed &>(node).user_explicit()
-                  << '\n';
+        std::cout << "Has user type: "
+                  << (tree.detail(node) != static_cast<uint8_t>(token_type::EndOfFile)) << '\n';
         break;
-    case ast::node_type::func_call: {
-        auto & call = dynamic_cast<const ast::func_call &>(node);
-        std::cout << "Function call to " << call.text() << '\n';
-        visit(*call.func_name);
-        for (const auto & arg : call.arguments) visit(*arg);
-    } break;
-    case ast::node_type::if_statement: {
+    case ast::node_type::func_call:
+        std::cout << "Function call to " << tree.text(node) << '\n';
+        visit(tree, tree.lhs(node));
+        for (const auto arg : tree.rhs_list(node)) visit(tree, arg);
+        break;
+    case ast::node_type::if_statement:
         std::cout << "If statement\n";
-        auto & condition = dynamic_cast<const ast::if_stmt &>(node);
-        visit(*condition.cond);
-        visit(*condition.then_block);
-        if (condition.else_block != nullptr) visit(*condition.else_block);
-    } break;
-    case ast::node_type ::binary_op:
-        std::cout << "Binary operation\n";
-        visit(dynamic_cast<const ast::bin_op &>(node).lhs_ref());
-        visit(dynamic_cast<const ast::bin_op &>(node).rhs_ref());
+        visit(tree, tree.lhs(node));
+        for (const auto branch : tree.rhs_list(node)) visit(tree, branch);
         break;
+    case ast::node_type ::binary_op: {
+        std::cout << "Binary operation\n";
+        // Walked like the pointer tree, without recursion along operator chains
+        const auto depth = indent_depth;
+        std::vector<std::pair<ast::node_ref, int>> pending{{tree.rhs(node), depth},
+                                                           {tree.lhs(node), depth}};
+        while (not pending.empty()) {
+            const auto [operand, operand_depth] = pending.back();
+            pending.pop_back();
+
+            indent_depth = operand_depth;
+            if (tree.kind(operand) != ast::node_type::binary_op) {
+                visit(tree, operand);
+                continue;
+            }
+
+            const auto operand_nested = enter();
+            std::cout << "Binary operation\n";
+            pending.emplace_back(tree.rhs(operand), indent_depth);
+            pending.emplace_back(tree.lhs(operand), indent_depth);
+        }
+        indent_depth = depth;
+    } break;
     case ast::node_type ::return_statement:
         std::cout << "Return\n";
-        if (auto & ret = dynamic_cast<const ast::ret_stmt &>(node); ret.value != nullptr)
-            visit(*ret.value);
+        if (const auto value = tree.lhs(node); value) visit(tree, value);
         break;
-    case ast::node_type::while_loop: {
-        auto & loop = dynamic_cast<const ast::while_loop &>(node);
+    case ast::node_type::while_loop:
         std::cout << "While loop\n";
-        visit(*loop.condition);
-        visit(*loop.body);
-    } break;
-    case ast::node_type::assign_statement: {
-        auto & assign_stmt = dynamic_cast<const ast::assign_stmt &>(node);
+        visit(tree, tree.lhs(node));
+        visit(tree, tree.rhs(node));
+        break;
+    case ast::node_type::assign_statement:
         std::cout << "Assignment statement\n";
         print_indent();
         std::cout << "Is op-assign: " << std::boolalpha
-                  << (assign_stmt.assign_op != ast::operation::assign) << '\n';
-        visit(*assign_stmt.dest);
-        visit(*assign_stmt.value_src);
-    } break;
+                  << (static_cast<ast::operation>(tree.detail(node)) != ast::operation::assign)
+                  << '\n';
+        visit(tree, tree.lhs(node));
+        visit(tree, tree.rhs(node));
+        break;
     default:
-        std::cout << "Unimplemented visit on node " << node.text() << std::endl;
+        std::cout << "Unimplemented visit on node " << tree.text(node) << std::endl;
     }
-
-    indent_depth -= indent_size;
 }
 
 void printing_visitor::print_indent() const { std::cout << std::string(indent_depth, ' '); }
 
-void ir_gen_visitor::visit(const ast::node & node) {
-    switch (node.type()) {
-    case ast::node_type ::var_decl: {
-        auto & decl = dynamic_cast<const ast::var_decl &>(node);
-        auto id = decl.identifier();
-
-        auto value = this->fold_to_constant(decl.value_expr());
-        if (not value) {
-            std::cerr << "Could not evaluate the constant " << decl.identifier() << '\n';
-            return;
-        }
+void counting_visitor::visit(const ast::function & func) {
+    node_count++;
+    visit(*func.body);
+}
 
-        if (decl.in_global_scope()) {
-            // Is a global
+void counting_visitor::visit(const ast::var_decl & decl) {
+    node_count++;
+    visit(*decl.val);
+}
 
-            // Check that we are not redeclaring the value
-            auto & globals = this->global_scope();
-            if (globals.count(id) != 0) {
-                std::cerr << "Redeclaring the global constant " << decl.identifier() << '\n';
-                return;
-            }
+void counting_visitor::visit(const ast::stmt_block & block) {
+    node_count++;
+    for (const auto & stmt : block.stmts) visit(*stmt);
+}
 
-            globals.try_emplace(id, std::move(*value));
-        } else {
-            // Some local
-            auto & locals = this->current_scope();
-            if (locals.count(id) != 0) {
-                std::cerr << "Redeclaring the local constant " << decl.identifier() << '\n';
-                return;
-            }
+void counting_visitor::visit(const ast::if_stmt & condition) {
+    node_count++;
+    visit(*condition.cond);
+    visit(*condition.then_block);
+    if (condition.else_block != nullptr) visit(*condition.else_block);
+}
 
-            if (decl.detail == ast::var_decl::details::Const)
-                locals.try_emplace(id, std::move(*value));
-            else {
-                auto operand = ir::operand{id, value.value().type, false};
-                append_instruction(ir::operation::assign, {operand, value.value()});
-                locals.try_emplace(id, operand);
-            }
-        }
+void counting_visitor::visit(const ast::while_loop & loop) {
+    node_count++;
+    visit(*loop.condition);
+    visit(*loop.body);
+}
 
-    } break;
-    case ast::node_type ::function:
-        generate_function(dynamic_cast<const ast::function &>(node));
-        break;
-    case ast::node_type::opt_typed: {
-        auto & name = dynamic_cast<const ast::opt_typed &>(node);
-        if (current_func != nullptr and name.name() == current_func->name
-            and *current_func->type->return_type == ir::ir_type::unit and name.user_explicit()) {
-            std::cerr << "Deprecated path for assigning return type of function\n";
-        } else if (name.user_explicit())
-            std::cerr << "Unknown action to preform on " << name.text() << '\n';
-    } break;
-    case ast::node_type ::statement_block:
-        this->active_variables.emplace_back();
-        if (not current_block()->contents.empty() and current_block()->terminated())
-            this->append_block(this->block_name());
+void counting_visitor::visit(const ast::ret_stmt & ret) {
+    node_count++;
+    if (ret.value != nullptr) visit(*ret.value);
+}
 
-        for (const auto & stmt : dynamic_cast<const ast::stmt_block &>(node).stmts) visit(*stmt);
-        this->active_variables.pop_back();
-        break;
-    case ast::node_type ::func_call: {
-        auto & func_call = dynamic_cast<const ast::func_call &>(node);
+void counting_visitor::visit(const ast::assign_stmt & assign) {
+    node_count++;
+    visit(*assign.dest);
+    visit(*assign.value_src);
+}
 
-        std::vector<ir::operand> args;
-        args.push_back(eval_ast(*func_call.func_name));
-        for (const auto & arg : func_call.arguments) args.push_back(eval_ast(*arg));
+void counting_visitor::visit(const ast::func_call & call) {
+    node_count++;
+    visit(*call.func_name);
+    for (const auto & arg : call.arguments) visit(*arg);
+}
 
-        append_instruction(ir::operation ::call, std::move(args));
-    } break;
-    case ast::node_type ::parameter: {
-        std::cerr << "Deprecated path for generating parameter ir\n";
-    } break;
-    case ast::node_type::if_statement: {
-        auto & if_stmt = dynamic_cast<const ast::if_stmt &>(node);
-
-        auto then_block_name = this->block_name();
-        auto exit_name = this->block_name();
-
-        eval_if_condition(*if_stmt.cond, then_block_name, exit_name);
-
-        append_block(std::move(then_block_name));
-        visit(*if_stmt.then_block);
-
-        auto label_type = prog.lookup_type("string");
-
-        if (if_stmt.else_block == nullptr and not current_block()->terminated()) {
-            append_instruction(ir::operation ::branch, {{exit_name, label_type, false}});
-            append_block(std::move(exit_name));
-        } else if (if_stmt.else_block != nullptr) {
-            auto real_exit_name = block_name();
-            if (not current_block()->terminated())
-                append_instruction(ir::operation ::branch, {{real_exit_name, label_type, false}});
-            append_block(std::move(exit_name));
-            visit(*if_stmt.else_block);
-            if (not current_block()->terminated()) {
-                append_instruction(ir::operation ::branch, {{real_exit_name, label_type, false}});
-                append_block(std::move(real_exit_name));
-            }
+void counting_visitor::visit(const ast::bin_op & bin_op) {
+    // Without recursion along operator chains, like printing_visitor
+    std::vector<const ast::expression *> pending{&bin_op};
+    while (not pending.empty()) {
+        const auto * expr = pending.back();
+        pending.pop_back();
+        if (expr->type() != ast::node_type::binary_op) {
+            visit(*expr);
+            continue;
         }
-    } break;
-    case ast::node_type ::value:
-        std::cerr << "Cannot do anything with " << node.text() << " in visit\n";
-        break;
-    case ast::node_type ::return_statement: {
-        auto & ret = dynamic_cast<const ast::ret_stmt &>(node);
 
-        std::vector<ir::operand> return_value;
+        const auto & op = static_cast<const ast::bin_op &>(*expr);
+        node_count++;
+        pending.push_back(&op.rhs_ref());
+        pending.push_back(&op.lhs_ref());
+    }
+}
 
-        if (ret.value != nullptr) return_value.push_back(eval_ast(*ret.value));
-        append_instruction(ir::operation ::ret, std::move(return_value));
-    } break;
-    case ast::node_type::while_loop: {
-        auto & loop = dynamic_cast<const ast::while_loop &>(node);
+void ir_gen_visitor::visit(const ast::var_decl & decl) {
+    auto id = decl.identifier();
 
-        auto * cond_block = append_block(block_name());
+    auto value = this->fold_to_constant(decl.value_expr());
+    if (not value) {
+        diag::error(decl) << "Could not evaluate the constant " << decl.identifier();
+        return;
+    }
 
-        auto loop_block = block_name();
-        auto loop_end = block_name();
+    if (decl.in_global_scope()) {
+        // Is a global
 
-        eval_if_condition(*loop.condition, loop_block, loop_end);
+        // Check that we are not redeclaring the value
+        auto & globals = this->global_scope();
+        if (globals.count(id) != 0) {
+            diag::error(decl) << "Redeclaring the global constant " << decl.identifier();
+            return;
+        }
 
-        append_block(std::move(loop_block));
-        visit(*loop.body);
-        append_instruction(ir::operation::branch,
-                           {{cond_block->name, prog.lookup_type("string"), false}});
-        append_block(std::move(loop_end));
-    } break;
-    case ast::node_type::assign_statement: {
-        auto & assign = dynamic_cast<const ast::assign_stmt &>(node);
-        auto lhs_op = eval_ast(*assign.dest);
-        if (lhs_op.is_immediate) {
-            std::cerr << "Cannot assign to " << lhs_op << '\n';
+        declare(globals, id, std::move(*value));
+    } else {
+        // Some local
+        auto & locals = this->current_scope();
+        if (locals.count(id) != 0) {
+            diag::error(decl) << "Redeclaring the local constant " << decl.identifier();
             return;
         }
 
-        auto rhs = eval_ast(*assign.value_src);
+        if (decl.detail == ast::var_decl::details::Const)
+            declare(locals, id, std::move(*value));
+        else {
+            auto operand = ir::operand{current_func->named_value(id), value.value().type};
+            append_instruction(ir::operation::assign, {operand, value.value()});
+            declare(locals, id, operand);
+        }
+    }
+}
 
-        switch (std::vector operands{lhs_op, lhs_op, rhs}; assign.assign_op) {
-        case ast::operation::add:
-            append_instruction(ir::operation::add, std::move(operands));
-            break;
-        case ast::operation::assign:
-            if (not rhs.is_immediate)
-                // Rename operand to us
-                this->current_block()->contents.back().operands.front() = lhs_op;
-            else
-                append_instruction(ir::operation::assign, {lhs_op, rhs});
-            break;
-        case ast::operation::div:
-            append_instruction(ir::operation::div, std::move(operands));
-            break;
-        case ast::operation::mult:
-            append_instruction(ir::operation::mul, std::move(operands));
-            break;
-        case ast::operation::sub:
-            append_instruction(ir::operation::sub, std::move(operands));
-            break;
-        default:
-            std::cerr << "Unsupported op-assign " << assign.text() << '\n';
+void ir_gen_visitor::visit(const ast::struct_decl & decl) {
+    diag::error(decl) << "Unimplemented ir gen for node " << decl.text();
+}
+
+void ir_gen_visitor::visit(const ast::stmt_block & block) {
+    this->enter_scope();
+    if (current_block()->terminated())
+        this->append_block(this->block_name());
+
+    for (const auto & stmt : block.stmts) visit(*stmt);
+    this->leave_scope();
+}
+
+void ir_gen_visitor::visit(const ast::func_call & func_call) {
+    std::vector<ir::operand> args;
+    args.reserve(func_call.arguments.size() + 1);
+    args.push_back(eval_ast(*func_call.func_name));
+    for (const auto & arg : func_call.arguments) args.push_back(eval_ast(*arg));
+
+    append_call(args);
+}
+
+void ir_gen_visitor::visit(const ast::if_stmt & if_stmt) {
+    auto then_block_name = this->block_name();
+    auto exit_name = this->block_name();
+
+    eval_if_condition(*if_stmt.cond, then_block_name, exit_name);
+
+    append_block(then_block_name);
+    visit(*if_stmt.then_block);
+
+    const auto * label_type = primitive(ir::ir_type::str);
+
+    if (if_stmt.else_block == nullptr and not current_block()->terminated()) {
+        append_instruction(ir::operation ::branch, {ir::operand::label(exit_name, label_type)});
+        append_block(exit_name);
+    } else if (if_stmt.else_block != nullptr) {
+        auto real_exit_name = block_name();
+        if (not current_block()->terminated())
+            append_instruction(ir::operation ::branch,
+                               {ir::operand::label(real_exit_name, label_type)});
+        append_block(exit_name);
+        visit(*if_stmt.else_block);
+        if (not current_block()->terminated()) {
+            append_instruction(ir::operation ::branch,
+                               {ir::operand::label(real_exit_name, label_type)});
+            append_block(real_exit_name);
         }
+    }
+}
 
-    } break;
-    default:
-        std::cerr << "Unimplemented ir gen for node " << node.text() << std::endl;
+void ir_gen_visitor::visit(const ast::literal_or_variable & value) {
+    diag::error(value) << "Cannot do anything with " << value.text() << " in visit";
+}
+
+void ir_gen_visitor::visit(const ast::bin_op & bin_op) {
+    diag::error(bin_op) << "Unimplemented ir gen for node " << bin_op.text();
+}
+
+void ir_gen_visitor::visit(const ast::ret_stmt & ret) {
+    if (ret.value != nullptr) append_instruction(ir::operation ::ret, {eval_ast(*ret.value)});
+    else
+        append_instruction(ir::operation ::ret);
+}
+
+void ir_gen_visitor::visit(const ast::while_loop & loop) {
+    auto * cond_block = append_block(block_name());
+
+    auto loop_block = block_name();
+    auto loop_end = block_name();
+
+    eval_if_condition(*loop.condition, loop_block, loop_end);
+
+    append_block(loop_block);
+    visit(*loop.body);
+    append_instruction(ir::operation::branch,
+                       {ir::operand::label(cond_block->name, primitive(ir::ir_type::str))});
+    append_block(loop_end);
+}
+
+void ir_gen_visitor::visit(const ast::assign_stmt & assign) {
+    auto lhs_op = eval_ast(*assign.dest);
+    if (lhs_op.is_immediate()) {
+        diag::error(assign) << "Cannot assign to " << lhs_op;
+        return;
+    }
+
+    auto rhs = eval_ast(*assign.value_src);
+
+    switch (ir::operand_list operands{lhs_op, lhs_op, rhs}; assign.assign_op) {
+    case ast::operation::add:
+        append_instruction(ir::operation::add, operands);
         break;
+    case ast::operation::assign:
+        if (auto * last = last_instruction(); last != nullptr and not rhs.is_immediate())
+            // Rename operand to us
+            last->operands.front() = lhs_op;
+        else
+            append_instruction(ir::operation::assign, {lhs_op, rhs});
+        break;
+    case ast::operation::div:
+        append_instruction(ir::operation::div, operands);
+        break;
+    case ast::operation::mult:
+        append_instruction(ir::operation::mul, operands);
+        break;
+    case ast::operation::sub:
+        append_instruction(ir::operation::sub, operands);
+        break;
+    default:
+        diag::error(assign) << "Unsupported op-assign " << assign.text();
     }
 }
 
@@ -277,81 +454,152 @@ ir_gen_visitor::scope_t & ir_gen_visitor::current_scope() noexcept {
     if (active_variables.empty()) active_variables.emplace_back();
     return active_variables.back();
 }
+
+void ir_gen_visitor::enter_scope() { active_variables.emplace_back(); }
+
+void ir_gen_visitor::leave_scope() {
+    for (const auto & entry : active_variables.back()) {
+        auto iter = declared_in.find(entry.first);
+        iter->second.pop_back();
+        if (iter->second.empty()) declared_in.erase(iter);
+    }
+    active_variables.pop_back();
+}
+
+bool ir_gen_visitor::declare(scope_t & scope, symbol name, ir::operand value) {
+    if (not scope.try_emplace(name, std::move(value)).second) return false;
+
+    const auto index = static_cast<size_t>(&scope - active_variables.data());
+    auto & scopes = declared_in[name];
+    scopes.insert(std::upper_bound(scopes.begin(), scopes.end(), index), index);
+    return true;
+}
 std::optional<ir::operand> ir_gen_visitor::fold_to_constant(ast::expression & expr) {
-    switch (expr.type()) {
-    case ast::node_type ::value:
-        switch (auto value = dynamic_cast<ast::literal_or_variable &>(expr).data(); value.index()) {
-        case 2: // long
-            return std::optional{ir::operand{std::get<2>(value), prog.lookup_type("int64"), true}};
+    // Folds operands that are not additions, which end the descent
+    const auto fold_operand = [this](ast::expression & operand) -> std::optional<ir::operand> {
+        switch (operand.type()) {
+        case ast::node_type ::value: {
+            auto & value = static_cast<ast::literal_or_variable &>(operand);
+            if (value.val.type() == token_type::Int) {
+                // Decoded by the lexer
+                if (const auto * number = std::get_if<long>(&value.val.number().value))
+                    return std::optional{ir::operand{*number, primitive(ir::ir_type::i64)}};
+            }
 
-        case 0: // monostate
+            diag::error(value) << "Unknown immediate data: " << value;
+        } break;
+        case ast::node_type::binary_op:
+            diag::error(operand) << "Could not evaluate binary expression " << operand.text();
+            break;
         default:
-            std::cerr << "Unknown immediate data: "
-                      << dynamic_cast<ast::literal_or_variable &>(expr)
-                      << " (Index number: " << value.index() << ")\n";
+            diag::error(operand) << "Could not fold expression " << operand.text();
         }
-        break;
-    case ast::node_type::binary_op:
-        switch (auto & bin_op = dynamic_cast<ast::bin_op &>(expr); bin_op.oper()) {
-        case ast::operation ::add: {
-            auto lhs = fold_to_constant(bin_op.lhs_ref());
-            if (not lhs) {
-                std::cerr << "Could not evaluate left hand side of " << bin_op.text() << '\n';
-                break;
-            }
-            auto rhs = fold_to_constant(bin_op.rhs_ref());
-            if (not rhs) {
-                std::cerr << "Could not evaluate right hand side of " << bin_op.text() << '\n';
-                break;
+        return {};
+    };
+    const auto is_addition = [](const ast::expression & operand) {
+        return operand.type() == ast::node_type::binary_op
+               and static_cast<const ast::bin_op &>(operand).oper() == ast::operation::add;
+    };
+
+    // Additions nest as deep as the input makes them, so they are folded from a work stack.
+    // lhs is empty until the left hand side of the addition is folded.
+    struct addition {
+        ast::bin_op * node;
+        std::optional<ir::operand> lhs;
+    };
+    std::vector<addition> pending;
+    std::optional<ir::operand> folded;
+    ast::expression * next = &expr;
+    while (true) {
+        for (; next != nullptr and is_addition(*next); next = &pending.back().node->lhs_ref())
+            pending.push_back({static_cast<ast::bin_op *>(next), {}});
+        if (next != nullptr) folded = fold_operand(*next);
+        next = nullptr;
+
+        // folded is the value of the operand that was finished last
+        if (pending.empty()) return folded;
+        auto & top = pending.back();
+        if (not top.lhs.has_value()) {
+            if (not folded) {
+                diag::error(*top.node) << "Could not evaluate left hand side of "
+                                       << top.node->text();
+                pending.pop_back();
+                continue;
             }
+            top.lhs = std::move(folded);
+            next = &top.node->rhs_ref();
+            continue;
+        }
 
-            if (lhs.value().data.index() != rhs.value().data.index()) {
-                std::cerr << "Left and right hand sides of expression are of different types: "
-                          << bin_op.text() << '\n';
-                break;
-            }
+        const auto [bin_op, lhs] = std::move(top);
+        pending.pop_back();
+        const auto rhs = std::move(folded);
+        folded.reset();
+        if (not rhs) {
+            diag::error(*bin_op) << "Could not evaluate right hand side of " << bin_op->text();
+            continue;
+        }
 
-            switch (lhs.value().data.index()) {
-            case 2: // long
-                return std::optional{
-                    ir::operand{std::get<2>(lhs.value().data) + std::get<2>(rhs.value().data),
-                                prog.lookup_type("int64"), true}};
-            case 0:
-            default:
-                std::cerr << "Unknown type of expression: " << bin_op.text()
-                          << " (Index number: " << lhs.value().data.index() << ")\n";
-            }
-        } break;
+        // Only integers are folded so far
+        if (lhs.value().type != rhs.value().type) {
+            diag::error(*bin_op)
+                << "Left and right hand sides of expression are of different types: "
+                << bin_op->text();
+            continue;
+        }
+
+        switch (static_cast<ir::ir_type>(*lhs.value().type)) {
+        case ir::ir_type::i64:
+            folded = ir::operand{lhs.value().integer() + rhs.value().integer(),
+                                 primitive(ir::ir_type::i64)};
+            break;
         default:
-            std::cerr << "Could not evaluate binary expression " << bin_op.text() << '\n';
+            diag::error(*bin_op) << "Unknown type of expression: " << bin_op->text() << " ("
+                                 << lhs.value() << ")";
         }
-        break;
-    default:
-        std::cerr << "Could not fold expression " << expr.text() << '\n';
     }
-
-    return {};
 }
 
 void ir_gen_visitor::append_instruction(ir::three_address && inst) {
-    if (current_block() != nullptr) current_block()->contents.push_back(inst);
+    if (auto * block = current_block(); block != nullptr) current_func->append(*block, inst);
     else
-        std::cerr << "[ " << (current_func != nullptr ? current_func->name : "global")
-                  << " ] Cannot add instruction as a block does not exist\n";
+        diag::error() << "[ " << (current_func != nullptr ? text_of(current_func->name) : "global")
+                      << " ] Cannot add instruction as a block does not exist";
+}
+
+void ir_gen_visitor::append_call(const std::vector<ir::operand> & operands) {
+    if (current_func == nullptr) {
+        diag::error() << "[ global ] Cannot add a call as there is no function";
+        return;
+    }
+    append_instruction({ir::operation::call, {operands, current_func->overflow}});
 }
 
 ir::basic_block * ir_gen_visitor::current_block() {
     if (current_func == nullptr) return nullptr;
-    if (current_func->body.empty()) return append_block(current_func->name + "_entry");
-    return current_func->body.back().get();
+    if (current_func->blocks().empty())
+        return append_block(entry_block_name(current_func->name));
+    return &current_func->blocks().back();
+}
+
+ir::instruction * ir_gen_visitor::last_instruction() {
+    auto * block = current_block();
+    if (block == nullptr or block->instructions.empty()) return nullptr;
+    return &block->instructions.back();
 }
 
-ir::basic_block * ir_gen_visitor::append_block(std::string && name) {
+ir::operand ir_gen_visitor::last_result() {
+    if (const auto * last = last_instruction(); last != nullptr) {
+        if (auto result = last->result(); result.has_value()) return result.value();
+    }
+    return {0l, primitive(ir::ir_type::i32)};
+}
+
+ir::basic_block * ir_gen_visitor::append_block(symbol name) {
     if (current_func != nullptr) {
-        current_func->body.push_back(std::make_unique<ir::basic_block>(name));
-        return current_func->body.back().get();
+        return &current_func->append_block(name);
     } else {
-        std::cerr << "Could not add block " << name << ", as there was no current function.\n";
+        diag::error() << "Could not add block " << name << ", as there was no current function.";
         return nullptr;
     }
 }
@@ -367,218 +615,164 @@ void ir_gen_visitor::dump() const {
                     else
                         first = false;
 
-                    std::cout << param;
+                    std::cout << func->named(param);
                 }
             }
             std::cout << " {" << std::endl;
-            for (const auto & block : func->body) {
-                std::cout << block->name << ":\n";
-                for (const auto & inst : block->contents) std::cout << '\t' << inst << std::endl;
+            for (const auto & block : func->blocks()) {
+                std::cout << block.name << ":\n";
+                for (const auto & inst : block.instructions)
+                    std::cout << '\t' << func->named(inst) << std::endl;
             }
             std::cout << "}\n" << std::endl;
         }
     });
 }
-std::string ir_gen_visitor::temp_name() { return "temp_" + std::to_string(this->temp_num++); }
-std::shared_ptr<ir::type> ir_gen_visitor::type_from(const token & tok) {
+const ir::type * ir_gen_visitor::type_from(const token & tok) {
     switch (tok.type()) {
     case token_type::Identifier: {
-        auto ident = std::get<std::string>(tok.get_data());
-        std::cerr << "Looking up type of " << ident << std::endl;
+        auto ident = tok.name();
+        diag::note(tok) << "Looking up type of " << ident;
         if (auto user_specified = prog.lookup_type(ident); user_specified != nullptr)
             return user_specified;
         else {
-            std::cerr << "Could find type named " << tok << '\n';
+            diag::error(tok) << "Could find type named " << tok.text();
             return nullptr;
         }
     }
     case token_type::Int32:
-        return prog.lookup_type("int32");
+        return primitive(ir::ir_type::i32);
     case token_type::Int64:
-        return prog.lookup_type("int64");
+        return primitive(ir::ir_type::i64);
     default:
-        std::cerr << "Cannot use " << tok << " as a type\n";
+        diag::error(tok) << "Cannot use " << tok.text() << " as a type";
         return nullptr;
     }
 }
-std::string ir_gen_visitor::block_name() {
-    if (current_func == nullptr) return std::to_string(this->block_num++);
+symbol ir_gen_visitor::block_name() {
+    if (current_func == nullptr) return intern(std::to_string(this->block_num++));
     else
-        return current_func->name + std::to_string(this->block_num++);
-}
-
-namespace {
-std::map<std::string, ir::operand> builtins;
+        return intern(std::string{text_of(current_func->name)}
+                      + std::to_string(this->block_num++));
 }
 
 ir::operand ir_gen_visitor::eval_ast(const ast::expression & expr) {
 
     if (builtins.empty()) {
 
-        ir::function_type print_type{{prog.lookup_type("int32")}, prog.lookup_type("unit")};
+        const auto * print_type
+            = prog.types().function({primitive(ir::ir_type::i32)}, primitive(ir::ir_type::unit));
 
-        builtins.emplace(
-            "print",
-            ir::operand{"print", std::make_shared<ir::function_type>(std::move(print_type)), true});
+        const auto print = intern("print");
+        builtins.emplace(print, ir::operand{print, print_type});
     }
 
     switch (expr.type()) {
-    case ast::node_type::binary_op: {
-        auto & bin = dynamic_cast<const ast::bin_op &>(expr);
-        auto lhs = eval_ast(bin.lhs_ref());
-
-        // TODO: Make the ast do type checking
-        // TODO: Modularize
-
-        switch (auto bool_type = prog.lookup_type("boolean"); bin.oper()) {
-        case ast::operation::add:
-            append_instruction(ir::operation ::add,
-                               {temp_operand(lhs.type, false), lhs, eval_ast(bin.rhs_ref())});
-            break;
-        default:
-            std::cerr << "Unimplemented operation: " << expr.text() << '\n';
-            break;
-        case ast::operation::gt:
-            append_instruction(ir::operation::gt,
-                               {temp_operand(bool_type, false), lhs, eval_ast(bin.rhs_ref())});
-            break;
-        case ast::operation::le:
-            append_instruction(ir::operation ::le,
-                               {temp_operand(bool_type, false), lhs, eval_ast(bin.rhs_ref())});
-            break;
-        case ast::operation::eq:
-            append_instruction(ir::operation ::eq,
-                               {temp_operand(bool_type, false), lhs, eval_ast(bin.rhs_ref())});
-            break;
-        case ast::operation::boolean_or:
-            if (*lhs.type != ir::ir_type::boolean) return {false, bool_type, false};
-            else {
-                auto false_block_name = block_name();
-                auto true_block_name = block_name();
-                auto label_type = prog.lookup_type("string");
-                append_instruction(ir::operation::branch, {lhs,
-                                                           {true_block_name, label_type, false},
-                                                           {false_block_name, label_type, false}});
-                append_block(std::move(false_block_name));
-                auto rhs_val = eval_ast(bin.rhs_ref());
-                append_block(std::move(true_block_name));
-                append_instruction(ir::operation::phi,
-                                   {temp_operand(bool_type, false), lhs, rhs_val});
-            }
-            break;
-        case ast::operation::sub:
-            append_instruction(ir::operation::sub,
-                               {temp_operand(lhs.type, false), lhs, eval_ast(bin.rhs_ref())});
-            break;
-            /*
-        case ast::operation::mult:
-            break;
-        case ast::operation::div:
-            break;
-        case ast::operation::boolean_and:
-            break;
-        case ast::operation::lt:
-            break;
-        case ast::operation::gt:
-            break;
-        case ast::operation::ge:
-            break;
-             */
-        }
-    } break;
+    case ast::node_type::binary_op:
+        return eval_bin_op(static_cast<const ast::bin_op &>(expr));
     case ast::node_type::func_call: {
         if (current_block() == nullptr) {
-            std::cerr << "Found func_call not in a block: " << expr.text() << '\n';
-            return {0l, prog.lookup_type("int32"), true};
+            diag::error(expr) << "Found func_call not in a block: " << expr.text();
+            return {0l, primitive(ir::ir_type::i32)};
         }
-        auto & call = dynamic_cast<const ast::func_call &>(expr);
+        auto & call = static_cast<const ast::func_call &>(expr);
 
         if (call.name() == nullptr) {
-            std::cerr << "Name expression of a function call was null\n";
-            return {0l, prog.lookup_type("int32"), true};
+            diag::error(call) << "Name expression of a function call was null";
+            return {0l, primitive(ir::ir_type::i32)};
         }
 
         std::optional<ir::operand> func_name;
         if (call.name()->type() == ast::node_type::value) {
-            auto call_name = call.name()->text();
+            const auto & callee = static_cast<const ast::literal_or_variable &>(*call.name());
+            auto call_name = callee.val.name();
             // TODO: Should lookup_type(some_function_name) return the type of that function?
-            func_name = ir::operand{call_name, prog.lookup_type(call_name), true};
+            func_name = ir::operand{call_name, prog.lookup_type(call_name)};
         } else {
             visit(*call.func_name);
-            func_name = current_block()->contents.back().result();
+            if (const auto * last = last_instruction(); last != nullptr) func_name = last->result();
         }
 
         if (not func_name) {
-            std::cerr << "Could not get name of function call for " << call.text() << '\n';
-            return {0l, prog.lookup_type("int32"), true};
+            diag::error(call) << "Could not get name of function call for " << call.text();
+            return {0l, primitive(ir::ir_type::i32)};
         }
 
-        auto lookup_name = std::get<std::string>(func_name.value().data);
+        auto lookup_name = func_name.value().name();
 
         // Search previous declarations
-        if (not prog.function_exists(lookup_name, call.arguments.size())) {
-            std::cerr << "Function " << std::get<std::string>(func_name.value().data)
-                      << " is not defined\n";
-            return {0l, prog.lookup_type("int32"), true};
-        }
-
         auto * callee = prog.lookup_function(lookup_name, call.arguments.size());
+        if (callee == nullptr) {
+            diag::error(call) << "Function " << lookup_name << " is not defined";
+            return {0l, primitive(ir::ir_type::i32)};
+        }
 
-        std::vector operands{temp_operand(callee->type->return_type, false), func_name.value()};
-        for (auto & arg : call.arguments) { operands.push_back(eval_ast(*arg)); }
+        std::vector<ir::operand> operands;
+        operands.reserve(call.arguments.size() + 2);
+        operands.push_back(temp_operand(callee->type->return_type));
+        operands.push_back(func_name.value());
+        // Arguments can be calls themselves
+        for (auto & arg : call.arguments)
+            operands.push_back(stack_guard::nested([this, &arg] { return eval_ast(*arg); }));
 
-        this->append_instruction(ir::operation ::call, std::move(operands));
+        this->append_call(operands);
     } break;
     case ast::node_type::value: {
-        auto & value = dynamic_cast<const ast::literal_or_variable &>(expr);
+        auto & value = static_cast<const ast::literal_or_variable &>(expr);
         switch (value.val.type()) {
         case token_type ::Int:
-            return {std::get<long>(value.data()), prog.lookup_type("int32"), true};
+            switch (const auto & number = value.val.number(); number.range) {
+            case literal_range::i32:
+                return {std::get<long>(number.value), primitive(ir::ir_type::i32)};
+            case literal_range::i64:
+                return {std::get<long>(number.value), primitive(ir::ir_type::i64)};
+            default:
+                diag::error(value.val) << "Integer literal " << value.val.text() << " is too large";
+                return {0l, primitive(ir::ir_type::i32)};
+            }
         case token_type ::Identifier: {
-            auto name = std::get<std::string>(value.data());
+            auto name = std::get<symbol>(value.data());
             if (auto oper = read_variable(name); oper) return oper.value();
             else if (auto iter = builtins.find(name); iter != builtins.end())
                 return iter->second;
             else
-                std::cerr << "Variable " << value.val << " does not exist\n";
+                diag::error(value.val) << "Variable " << value.val.text() << " does not exist";
         } break;
         case token_type ::StringLiteral:
-            return {std::get<std::string>(value.data()), prog.lookup_type("string"), true};
+            return {std::get<symbol>(value.data()), primitive(ir::ir_type::str)};
         default:
-            std::cerr << "Cannot get value from " << value.text() << '\n';
+            diag::error(value) << "Cannot get value from " << value.text();
         }
     } break;
     default:
-        std::cerr << expr.text() << " cannot be evaluated." << std::endl;
-        return {0l, prog.lookup_type("int32"), true};
+        diag::error(expr) << expr.text() << " cannot be evaluated.";
+        return {0l, primitive(ir::ir_type::i32)};
     }
-    return current_block()->contents.back().result().value();
+    return last_result();
 }
-std::optional<ir::operand> ir_gen_visitor::read_variable(const std::string & name) const {
-    for (auto iter = active_variables.rbegin(); iter != active_variables.rend(); ++iter) {
-        if (iter->count(name) != 0) return iter->at(name);
-    }
-    return {};
+std::optional<ir::operand> ir_gen_visitor::read_variable(symbol name) const {
+    const auto iter = declared_in.find(name);
+    if (iter == declared_in.end()) return {};
+    return active_variables.at(iter->second.back()).at(name);
 }
-void ir_gen_visitor::eval_if_condition(const ast::expression & expr,
-                                       const std::string & true_branch,
-                                       const std::string & false_branch) {
+void ir_gen_visitor::eval_if_condition(const ast::expression & expr, symbol true_branch,
+                                       symbol false_branch) {
 
-    auto label_type = prog.lookup_type("string");
-    auto true_operand = ir::operand{true_branch, label_type, false};
-    auto false_operand = ir::operand{false_branch, label_type, false};
+    const auto * label_type = primitive(ir::ir_type::str);
+    auto true_operand = ir::operand::label(true_branch, label_type);
+    auto false_operand = ir::operand::label(false_branch, label_type);
     switch (expr.type()) {
 
     case ast::node_type::binary_op:
-        switch (auto & bin = dynamic_cast<const ast::bin_op &>(expr); bin.op) {
+        switch (auto & bin = static_cast<const ast::bin_op &>(expr); bin.op) {
         case ast::operation::boolean_and: {
             auto lhs = eval_ast(bin.lhs_ref());
             auto short_circuit = block_name();
 
-            auto short_operand = ir::operand{short_circuit, label_type, false};
+            auto short_operand = ir::operand::label(short_circuit, label_type);
             append_instruction(ir::operation::branch, {lhs, short_operand, false_operand});
 
-            append_block(std::move(short_circuit));
+            append_block(short_circuit);
             auto rhs = eval_ast(bin.rhs_ref());
             append_instruction(ir::operation::branch, {rhs, true_operand, false_operand});
         } break;
@@ -586,10 +780,10 @@ void ir_gen_visitor::eval_if_condition(const ast::expression & expr,
             auto lhs = eval_ast(bin.lhs_ref());
             auto short_circuit = block_name();
 
-            auto short_operand = ir::operand{short_circuit, label_type, false};
+            auto short_operand = ir::operand::label(short_circuit, label_type);
             append_instruction(ir::operation::branch, {lhs, true_operand, short_operand});
 
-            append_block(std::move(short_circuit));
+            append_block(short_circuit);
             auto rhs = eval_ast(bin.rhs_ref());
             append_instruction(ir::operation::branch, {rhs, true_operand, false_operand});
         } break;
@@ -602,15 +796,14 @@ void ir_gen_visitor::eval_if_condition(const ast::expression & expr,
                                {eval_ast(expr), true_operand, false_operand});
             break;
         default:
-            std::cerr << "Unexpected non-boolean binary op in if branch: " << bin.text()
-                      << std::endl;
+            diag::error(bin) << "Unexpected non-boolean binary op in if branch: " << bin.text();
         }
         break;
     case ast::node_type::func_call: {
         auto result = eval_ast(expr);
 
         if (*result.type != ir::ir_type::boolean) {
-            std::cerr << "Function call " << expr.text() << " does not return boolean" << std::endl;
+            diag::error(expr) << "Function call " << expr.text() << " does not return boolean";
             return;
         }
 
@@ -620,55 +813,192 @@ void ir_gen_visitor::eval_if_condition(const ast::expression & expr,
         append_instruction(ir::operation::branch, {eval_ast(expr), true_operand, false_operand});
         break;
     default:
-        std::cerr << "Unexpected node as condition of if: " << expr.text() << std::endl;
+        diag::error(expr) << "Unexpected node as condition of if: " << expr.text();
         return;
     }
 }
 void ir_gen_visitor::generate_function(const ast::function & func) {
 
-    auto return_type = prog.lookup_type("unit");
+    auto return_type = primitive(ir::ir_type::unit);
 
     if (func.name.user_explicit()) {
         return_type = type_from(func.name.type_data());
         if (return_type == nullptr) {
-            std::cerr << "Cannot use " << func.name.type_data() << " as a return type.\n";
+            diag::error(func.name.type_data())
+                << "Cannot use " << func.name.type_data().text() << " as a return type.";
         }
     }
 
-    std::vector<std::shared_ptr<ir::type>> param_types;
+    std::vector<const ir::type *> param_types;
     for (auto & param : func.params) {
         auto param_type = type_from(param.val_type);
         if (param_type != nullptr) param_types.push_back(param_type);
         else
-            std::cerr << "Could not find type " << param.val_type << '\n';
+            diag::error(param.val_type) << "Could not find type " << param.val_type.text();
     }
 
-    auto func_type = std::make_shared<ir::function_type>(std::move(param_types), return_type);
+    const auto * func_type = prog.types().function(std::move(param_types), return_type);
 
-    ir::function * func_ir = this->prog.register_function(func.identifier(), std::move(func_type));
+    ir::function * func_ir = this->prog.register_function(func.identifier(), func_type);
     this->current_func = func_ir;
-    this->append_block(current_func->name + "_entry");
-    this->active_variables.emplace_back();
+    this->append_block(entry_block_name(current_func->name));
+    this->enter_scope();
 
     for (const auto & param : func.params) {
-        func_ir->param_names.push_back(std::get<std::string>(param.name.get_data()));
+        func_ir->param_names.push_back(param.name.name());
+        func_ir->named_value(param.name.name());
     }
 
     for (size_t i = 0; i < func.params.size(); i++) {
-        auto name = std::get<std::string>(func.params.at(i).name.get_data());
-        if (not current_scope().try_emplace(name, func_ir->parameters().at(i)).second) {
-            std::cerr << "Duplicate parameter: " << name << '\n';
+        auto name = func.params.at(i).name.name();
+        if (not declare(current_scope(), name, func_ir->parameters().at(i))) {
+            diag::error(func.params.at(i)) << "Duplicate parameter: " << name;
         }
     }
 
     visit(*func.body);
-    if (not func_ir->body.back()->terminated()) {
-        if (func_ir->name == "main")
+    if (func_ir->blocks().empty() or not func_ir->blocks().back().terminated()) {
+        if (text_of(func_ir->name) == "main")
             // TODO: Return the actual value from main
-            append_instruction(ir::operation::halt, {{0, prog.lookup_type("int32"), true}});
+            append_instruction(ir::operation::halt, {{0l, primitive(ir::ir_type::i32)}});
         else
             append_instruction(ir::operation ::ret);
     }
-    this->active_variables.pop_back();
+    this->leave_scope();
     this->current_func = nullptr;
 }
+
+ir::operand ir_gen_visitor::eval_bin_op(const ast::bin_op & root) {
+    // Operator chains are as long as the input makes them, so they are evaluated from a work
+    // stack. An operation goes from its left hand side, to its right hand side, to the
+    // instruction that combines them.
+    enum struct step : uint8_t { lhs, rhs, combine };
+    struct pending_op {
+        const ast::bin_op * node;
+        step next = step::lhs;
+        std::optional<ir::operand> lhs{};
+        // Made before the right hand side is evaluated, so temporaries keep their order
+        std::optional<ir::operand> result{};
+        symbol true_block{};
+    };
+
+    const auto * bool_type = primitive(ir::ir_type::boolean);
+    const auto * label_type = primitive(ir::ir_type::str);
+    std::vector<pending_op> pending{{&root}};
+    // The value of the operand that was finished last
+    std::optional<ir::operand> value;
+    // Evaluates an operand, or puts it on the stack if it is an operation itself
+    const auto eval_operand = [this, &pending, &value](const ast::expression & operand) {
+        if (operand.type() == ast::node_type::binary_op)
+            pending.push_back({&static_cast<const ast::bin_op &>(operand)});
+        else
+            value = eval_ast(operand);
+    };
+
+    while (true) {
+        auto & top = pending.back();
+        const auto & bin = *top.node;
+        switch (top.next) {
+        case step::lhs:
+            top.next = step::rhs;
+            eval_operand(bin.lhs_ref());
+            continue;
+        case step::rhs:
+            top.next = step::combine;
+            top.lhs = std::move(value);
+            value.reset();
+
+            // TODO: Make the ast do type checking
+            switch (bin.oper()) {
+            case ast::operation::add:
+            case ast::operation::sub:
+            case ast::operation::mult:
+            case ast::operation::bit_or:
+            case ast::operation::shl:
+            case ast::operation::shr:
+                top.result = temp_operand(top.lhs->type);
+                break;
+            case ast::operation::gt:
+            case ast::operation::ge:
+            case ast::operation::lt:
+            case ast::operation::le:
+            case ast::operation::eq:
+                top.result = temp_operand(bool_type);
+                break;
+            case ast::operation::boolean_or:
+                if (*top.lhs->type != ir::ir_type::boolean) {
+                    value = ir::operand{false, bool_type};
+                    break;
+                } else {
+                    auto false_block_name = block_name();
+                    top.true_block = block_name();
+                    append_instruction(ir::operation::branch,
+                                       {*top.lhs,
+                                        ir::operand::label(top.true_block, label_type),
+                                        ir::operand::label(false_block_name, label_type)});
+                    append_block(false_block_name);
+                }
+                break;
+            default:
+                diag::error(bin) << "Unimplemented operation: " << bin.text();
+                value = ir::operand{0l, primitive(ir::ir_type::i32)};
+                break;
+            }
+
+            // Done without the right hand side
+            if (value.has_value()) break;
+            eval_operand(bin.rhs_ref());
+            continue;
+        case step::combine: {
+            const ir::operand_list operands{*top.result, *top.lhs, *value};
+            switch (bin.oper()) {
+            case ast::operation::add:
+                append_instruction(ir::operation::add, operands);
+                break;
+            case ast::operation::sub:
+                append_instruction(ir::operation::sub, operands);
+                break;
+            case ast::operation::mult:
+                append_instruction(ir::operation::mul, operands);
+                break;
+            case ast::operation::bit_or:
+                append_instruction(ir::operation::bit_or, operands);
+                break;
+            case ast::operation::shl:
+                append_instruction(ir::operation::shift_left, operands);
+                break;
+            case ast::operation::shr:
+                append_instruction(ir::operation::shift_right, operands);
+                break;
+            case ast::operation::gt:
+                append_instruction(ir::operation::gt, operands);
+                break;
+            case ast::operation::ge:
+                append_instruction(ir::operation::ge, operands);
+                break;
+            case ast::operation::lt:
+                append_instruction(ir::operation::lt, operands);
+                break;
+            case ast::operation::le:
+                append_instruction(ir::operation::le, operands);
+                break;
+            case ast::operation::eq:
+                append_instruction(ir::operation::eq, operands);
+                break;
+            case ast::operation::boolean_or:
+                append_block(top.true_block);
+                append_instruction(ir::operation::phi,
+                                   {temp_operand(bool_type), *top.lhs, *value});
+                break;
+            default:
+                break;
+            }
+            value = last_result();
+        } break;
+        }
+
+        // top is finished and value holds its result
+        pending.pop_back();
+        if (pending.empty()) return std::move(*value);
+    }
+}
@@ -5,86 +5,231 @@
 #ifndef NEW_J_COMPILER_VISITOR_H
 #define NEW_J_COMPILER_VISITOR_H
 
-#include "ast/node_forward.h"
+#include "ast/diagnostics.h"
+#include "ast/nodes.h"
+#include "ast/stack_guard.h"
 #include "ast/token.h"
 #include "ir/ir.h"
 
-#include <map>
+#include <iostream>
+#include <unordered_map>
 
-class visitor {
+// Calls Derived::visit with the concrete class of a node.
+// Nodes are held as a top_level, statement or expression, and no concrete class inherits those
+// virtually, so once the node_type tag names the class a static_cast is enough.
+// Derived classes bring these overloads in with `using visitor::visit`.
+template<typename Derived> class visitor {
   public:
+    void visit(const ast::top_level & item) {
+        switch (item.type()) {
+        case ast::node_type::function:
+            return derived().visit(static_cast<const ast::function &>(item));
+        case ast::node_type::var_decl:
+            return derived().visit(static_cast<const ast::var_decl &>(item));
+        case ast::node_type::struct_decl:
+            return derived().visit(static_cast<const ast::struct_decl &>(item));
+        default:
+            diag::error(item) << "Node " << item.text() << " is not a top level item";
+        }
+    }
+
+    // Statements and expressions nest as deep as the input does
+    void visit(const ast::statement & stmt) {
+        stack_guard::nested([this, &stmt] { visit_statement(stmt); });
+    }
+    void visit(const ast::expression & expr) {
+        stack_guard::nested([this, &expr] { visit_expression(expr); });
+    }
+
+  protected:
     constexpr visitor() noexcept = default;
 
     visitor(const visitor &) = delete;
     visitor & operator=(const visitor &) = delete;
 
-    visitor(visitor &&) = default;
-    visitor & operator=(visitor &&) = default;
+    visitor(visitor &&) noexcept = default;
+    visitor & operator=(visitor &&) noexcept = default;
 
-    virtual ~visitor() noexcept = default;
+    ~visitor() noexcept = default;
 
-    virtual void visit(const ast::node &) = 0;
+  private:
+    Derived & derived() noexcept { return static_cast<Derived &>(*this); }
+
+    void visit_statement(const ast::statement & stmt) {
+        switch (stmt.type()) {
+        case ast::node_type::statement_block:
+            return derived().visit(static_cast<const ast::stmt_block &>(stmt));
+        case ast::node_type::if_statement:
+            return derived().visit(static_cast<const ast::if_stmt &>(stmt));
+        case ast::node_type::while_loop:
+            return derived().visit(static_cast<const ast::while_loop &>(stmt));
+        case ast::node_type::return_statement:
+            return derived().visit(static_cast<const ast::ret_stmt &>(stmt));
+        case ast::node_type::assign_statement:
+            return derived().visit(static_cast<const ast::assign_stmt &>(stmt));
+        case ast::node_type::func_call:
+            return derived().visit(static_cast<const ast::func_call &>(stmt));
+        case ast::node_type::var_decl:
+            return derived().visit(static_cast<const ast::var_decl &>(stmt));
+        default:
+            diag::error(stmt) << "Node " << stmt.text() << " is not a statement";
+        }
+    }
+
+    void visit_expression(const ast::expression & expr) {
+        switch (expr.type()) {
+        case ast::node_type::value:
+            return derived().visit(static_cast<const ast::literal_or_variable &>(expr));
+        case ast::node_type::binary_op:
+            return derived().visit(static_cast<const ast::bin_op &>(expr));
+        case ast::node_type::func_call:
+            return derived().visit(static_cast<const ast::func_call &>(expr));
+        default:
+            diag::error(expr) << "Node " << expr.text() << " is not an expression";
+        }
+    }
 };
 
-class printing_visitor final : public visitor {
+class printing_visitor final : public visitor<printing_visitor> {
   public:
     explicit printing_visitor(int indent_size = 2) : indent_size(indent_size) {}
 
-    void visit(const ast::node & node) override;
+    using visitor::visit;
+    void visit(const ast::function &);
+    void visit(const ast::parameter &);
+    void visit(const ast::opt_typed &);
+    void visit(const ast::var_decl &);
+    void visit(const ast::struct_decl &);
+    void visit(const ast::stmt_block &);
+    void visit(const ast::if_stmt &);
+    void visit(const ast::while_loop &);
+    void visit(const ast::ret_stmt &);
+    void visit(const ast::assign_stmt &);
+    void visit(const ast::func_call &);
+    void visit(const ast::literal_or_variable &);
+    void visit(const ast::bin_op &);
+
+    // Prints the same as visiting the matching ast::node
+    void visit(const ast::flat_tree & tree, ast::node_ref node);
 
     [[nodiscard]] constexpr auto visited_count() const noexcept { return node_count; }
 
   private:
+    // Indents the next line, and the lines of the children until the returned value goes away
+    [[nodiscard]] auto enter() {
+        print_indent();
+        if (node_count == 0) std::cout << std::boolalpha;
+        node_count++;
+
+        indent_depth += indent_size;
+        struct nesting {
+            printing_visitor & printer;
+            ~nesting() { printer.indent_depth -= printer.indent_size; }
+        };
+        return nesting{*this};
+    }
+
     void print_indent() const;
+    void print_node(const ast::flat_tree & tree, ast::node_ref node);
 
     int indent_size;
     int indent_depth = 0;
     long node_count = 0;
 };
 
-class ir_gen_visitor final : public visitor {
-    using scope_t = std::map<std::string, ir::operand>;
+// Walks every node without doing anything else, to measure how long a traversal takes
+class counting_visitor final : public visitor<counting_visitor> {
+  public:
+    using visitor::visit;
+    void visit(const ast::function &);
+    void visit(const ast::var_decl &);
+    void visit(const ast::struct_decl &) { node_count++; }
+    void visit(const ast::stmt_block &);
+    void visit(const ast::if_stmt &);
+    void visit(const ast::while_loop &);
+    void visit(const ast::ret_stmt &);
+    void visit(const ast::assign_stmt &);
+    void visit(const ast::func_call &);
+    void visit(const ast::literal_or_variable &) { node_count++; }
+    void visit(const ast::bin_op &);
+
+    [[nodiscard]] constexpr auto visited_count() const noexcept { return node_count; }
+
+  private:
+    long node_count = 0;
+};
+
+class ir_gen_visitor final : public visitor<ir_gen_visitor> {
+    using scope_t = std::unordered_map<symbol, ir::operand>;
 
   public:
-    void visit(const ast::node &) override;
+    using visitor::visit;
+    void visit(const ast::function & func) { generate_function(func); }
+    void visit(const ast::var_decl &);
+    void visit(const ast::struct_decl &);
+    void visit(const ast::stmt_block &);
+    void visit(const ast::if_stmt &);
+    void visit(const ast::while_loop &);
+    void visit(const ast::ret_stmt &);
+    void visit(const ast::assign_stmt &);
+    void visit(const ast::func_call &);
+    void visit(const ast::literal_or_variable &);
+    void visit(const ast::bin_op &);
 
     std::optional<ir::operand> fold_to_constant(ast::expression &);
 
     void dump() const;
 
     [[nodiscard]] const ir::program & program() const { return prog; }
+    // So the function can be generated again
+    void forget_function(symbol name) { prog.remove_function(name); }
 
   private:
     void generate_function(const ast::function &);
 
-    [[nodiscard]] std::shared_ptr<ir::type> type_from(const token &);
+    [[nodiscard]] const ir::type * type_from(const token &);
+    [[nodiscard]] const ir::type * primitive(ir::ir_type kind) {
+        return prog.types().primitive(kind);
+    }
 
     [[nodiscard]] ir::operand eval_ast(const ast::expression &);
-    void eval_if_condition(const ast::expression &, const std::string & true_branch,
-                           const std::string & false_branch);
-    [[nodiscard]] std::optional<ir::operand> read_variable(const std::string & name) const;
+    [[nodiscard]] ir::operand eval_bin_op(const ast::bin_op &);
+    void eval_if_condition(const ast::expression &, symbol true_branch, symbol false_branch);
+    [[nodiscard]] std::optional<ir::operand> read_variable(symbol name) const;
 
     [[nodiscard]] scope_t & global_scope() noexcept;
     [[nodiscard]] scope_t & current_scope() noexcept;
+    void enter_scope();
+    void leave_scope();
+    // Returns false if the scope already has the name
+    bool declare(scope_t & scope, symbol name, ir::operand value);
     [[nodiscard]] ir::basic_block * current_block();
+    // The instruction appended last to the current block, or nullptr if it has none
+    [[nodiscard]] ir::instruction * last_instruction();
+    // The result of the last instruction, or a placeholder if it has none after an error
+    [[nodiscard]] ir::operand last_result();
 
     void append_instruction(ir::three_address && inst);
-    void append_instruction(ir::operation op, std::vector<ir::operand> && operands = {}) {
-        append_instruction({op, std::move(operands)});
+    void append_instruction(ir::operation op, ir::operand_list operands = {}) {
+        append_instruction({op, operands});
     }
-    ir::basic_block * append_block(std::string && name);
+    // Calls can have more operands than fit in an instruction
+    void append_call(const std::vector<ir::operand> & operands);
+    ir::basic_block * append_block(symbol name);
 
-    [[nodiscard]] std::string temp_name();
-    [[nodiscard]] ir::operand temp_operand(std::shared_ptr<ir::type> type, bool immediate) {
-        return {temp_name(), std::move(type), immediate};
+    [[nodiscard]] ir::operand temp_operand(const ir::type * type) {
+        return {current_func->new_value(), type};
     }
-    [[nodiscard]] std::string block_name();
+    [[nodiscard]] symbol block_name();
 
     ir::program prog{};
     std::vector<scope_t> active_variables{};
+    // The scopes in active_variables that have each name, innermost last
+    std::unordered_map<symbol, std::vector<size_t>> declared_in{};
     ir::function * current_func = nullptr;
+    // Functions that every program has, made the first time they are needed
+    std::unordered_map<symbol, ir::operand> builtins{};
     long block_num = 0;
-    long temp_num = 0;
 };
 
 #endif // NEW_J_COMPILER_VISITOR_H
@@ -0,0 +1,245 @@
+//
+// Created by nick on 10/17/26.
+//
+
+#include "image.h"
+
+#include "bytecode.h"
+
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <utility>
+
+#if __has_include(<sys/mman.h>)
+#define NJ_HAS_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace vm {
+
+namespace {
+
+// The text can only be used in place if the host agrees with the file on byte order
+#if defined(__BYTE_ORDER__) and __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+constexpr bool little_endian_host = true;
+#else
+constexpr bool little_endian_host = false;
+#endif
+
+uint32_t read_u32(const uint8_t * bytes) {
+    uint32_t to_ret = 0;
+    for (auto i = 0u; i < sizeof(uint32_t); i++) to_ret |= uint32_t{bytes[i]} << i * 8u;
+    return to_ret;
+}
+
+struct section_entry {
+    uint32_t offset = 0;
+    uint32_t length = 0;
+};
+
+struct layout {
+    section_entry data;
+    section_entry text;
+};
+
+std::optional<layout> parse_header(const uint8_t * bytes, size_t size,
+                                   const std::string & filename) {
+
+    constexpr auto preamble_size = 4 + sizeof(uint32_t);
+    if (size < preamble_size or bytes[0] != bytecode::magic_byte or bytes[1] != 'N'
+        or bytes[2] != 'J') {
+        std::cerr << filename << " is not a New-J binary\n";
+        return {};
+    }
+
+    if (bytes[3] != bytecode::format_version) {
+        std::cerr << filename << " uses format version " << static_cast<int>(bytes[3])
+                  << ", but only version " << static_cast<int>(bytecode::format_version)
+                  << " is supported. Recompile it with new_jc.\n";
+        return {};
+    }
+
+    const auto header_end = preamble_size + read_u32(bytes + 4);
+    if (header_end > size) {
+        std::cerr << "Header table of " << filename << " is truncated\n";
+        return {};
+    }
+
+    layout to_ret;
+
+    // Each entry is the null terminated name, the offset, the length and a null byte
+    auto pos = preamble_size;
+    while (pos < header_end) {
+        std::string name;
+        while (pos < header_end and bytes[pos] != '\0') name.push_back(bytes[pos++]);
+        pos++;
+
+        if (pos + 2 * sizeof(uint32_t) + 1 > header_end) {
+            std::cerr << "Malformed header entry " << name << '\n';
+            return {};
+        }
+
+        const section_entry entry{read_u32(bytes + pos), read_u32(bytes + pos + sizeof(uint32_t))};
+        pos += 2 * sizeof(uint32_t) + 1;
+
+        if (static_cast<size_t>(entry.offset) + entry.length > size) {
+            std::cerr << "Section " << name << " extends past the end of " << filename << '\n';
+            return {};
+        }
+
+        if (name == ".data") to_ret.data = entry;
+        else if (name == ".text") {
+            if (entry.length % sizeof(uint64_t) != 0) {
+                std::cerr << "Text section is not a whole number of instructions\n";
+                return {};
+            }
+            to_ret.text = entry;
+        } else
+            std::cerr << "Unknown section " << name << '\n';
+    }
+
+    if (to_ret.text.length == 0) {
+        std::cerr << filename << " has no runnable code\n";
+        return {};
+    }
+
+    return to_ret;
+}
+
+std::vector<uint64_t> copy_text(const uint8_t * bytes, uint32_t length) {
+    std::vector<uint64_t> to_ret;
+    to_ret.reserve(length / sizeof(uint64_t));
+    for (auto i = 0u; i < length; i += sizeof(uint64_t)) {
+        uint64_t raw_inst = 0;
+        for (auto j = 0u; j < sizeof(uint64_t); j++) raw_inst |= uint64_t{bytes[i + j]} << j * 8u;
+        to_ret.push_back(raw_inst);
+    }
+    return to_ret;
+}
+
+} // namespace
+
+std::optional<image> image::load(const std::string & filename) {
+
+    image to_ret;
+
+#ifdef NJ_HAS_MMAP
+    const auto file = open(filename.c_str(), O_RDONLY);
+    if (file < 0) {
+        std::cerr << "Could not open " << filename << '\n';
+        return {};
+    }
+
+    struct stat file_info {};
+    if (fstat(file, &file_info) != 0 or file_info.st_size == 0) {
+        std::cerr << filename << " is empty\n";
+        close(file);
+        return {};
+    }
+
+    const auto file_size = static_cast<size_t>(file_info.st_size);
+    auto * file_start = mmap(nullptr, file_size, PROT_READ, MAP_PRIVATE, file, 0);
+    if (file_start == MAP_FAILED) {
+        std::cerr << "Could not map " << filename << '\n';
+        close(file);
+        return {};
+    }
+    to_ret.file_map = {file_start, file_size};
+
+    const auto * bytes = static_cast<const uint8_t *>(file_start);
+    const auto sections = parse_header(bytes, file_size, filename);
+    if (not sections.has_value()) {
+        close(file);
+        return {};
+    }
+
+    if (const auto & text = sections->text;
+        little_endian_host and text.offset % alignof(uint64_t) == 0) {
+        to_ret.text = {reinterpret_cast<const uint64_t *>(bytes + text.offset),
+                       text.length / sizeof(uint64_t)};
+    } else {
+        to_ret.text_copy = copy_text(bytes + text.offset, text.length);
+        to_ret.text = {to_ret.text_copy.data(), to_ret.text_copy.size()};
+    }
+
+    if (const auto & data = sections->data; data.length != 0) {
+        // Older files or hosts with large pages will not line up
+        if (data.offset % sysconf(_SC_PAGESIZE) == 0) {
+            auto * data_start = mmap(nullptr, data.length, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+                                     file, data.offset);
+            if (data_start != MAP_FAILED) {
+                to_ret.data_map = {data_start, data.length};
+                to_ret.data = {static_cast<uint8_t *>(data_start), data.length};
+            }
+        }
+
+        if (to_ret.data_map.address == nullptr) {
+            to_ret.data_copy.assign(bytes + data.offset, bytes + data.offset + data.length);
+            to_ret.data = {to_ret.data_copy.data(), to_ret.data_copy.size()};
+        }
+    }
+
+    // The mappings stay valid after the file is closed
+    close(file);
+#else
+    std::vector<uint8_t> file_contents;
+    {
+        std::ifstream file{filename, std::ios::binary | std::ios::in};
+        if (not file) {
+            std::cerr << "Could not open " << filename << '\n';
+            return {};
+        }
+        file_contents.assign(std::istreambuf_iterator<char>{file},
+                             std::istreambuf_iterator<char>{});
+    }
+
+    const auto sections = parse_header(file_contents.data(), file_contents.size(), filename);
+    if (not sections.has_value()) return {};
+
+    const auto & text = sections->text;
+    to_ret.text_copy = copy_text(file_contents.data() + text.offset, text.length);
+    to_ret.text = {to_ret.text_copy.data(), to_ret.text_copy.size()};
+
+    const auto & data = sections->data;
+    to_ret.data_copy.assign(file_contents.begin() + data.offset,
+                            file_contents.begin() + data.offset + data.length);
+    to_ret.data = {to_ret.data_copy.data(), to_ret.data_copy.size()};
+#endif
+
+    return to_ret;
+}
+
+image::image(image && other) noexcept
+    : data{std::exchange(other.data, {})}, text{std::exchange(other.text, {})},
+      file_map{std::exchange(other.file_map, {})}, data_map{std::exchange(other.data_map, {})},
+      data_copy{std::move(other.data_copy)}, text_copy{std::move(other.text_copy)} {}
+
+image & image::operator=(image && other) noexcept {
+    if (this != &other) {
+        release();
+        data = std::exchange(other.data, {});
+        text = std::exchange(other.text, {});
+        file_map = std::exchange(other.file_map, {});
+        data_map = std::exchange(other.data_map, {});
+        data_copy = std::move(other.data_copy);
+        text_copy = std::move(other.text_copy);
+    }
+    return *this;
+}
+
+image::~image() noexcept { release(); }
+
+void image::release() noexcept {
+#ifdef NJ_HAS_MMAP
+    for (auto * map : {&file_map, &data_map})
+        if (map->address != nullptr) munmap(map->address, map->length);
+#endif
+    file_map = {};
+    data_map = {};
+}
+
+} // namespace vm
@@ -0,0 +1,74 @@
+//
+// Created by nick on 10/17/26.
+//
+
+#ifndef NEW_J_COMPILER_IMAGE_H
+#define NEW_J_COMPILER_IMAGE_H
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace vm {
+
+// A view of one section of a loaded image
+template <typename T> class section final {
+  public:
+    constexpr section() noexcept = default;
+    constexpr section(T * start, size_t length) noexcept : start{start}, length{length} {}
+
+    [[nodiscard]] constexpr T * data() const noexcept { return start; }
+    [[nodiscard]] constexpr size_t size() const noexcept { return length; }
+    [[nodiscard]] constexpr bool empty() const noexcept { return length == 0; }
+
+    [[nodiscard]] constexpr T & operator[](size_t index) const noexcept { return start[index]; }
+
+    [[nodiscard]] constexpr T * begin() const noexcept { return start; }
+    [[nodiscard]] constexpr T * end() const noexcept { return start + length; }
+
+  private:
+    T * start = nullptr;
+    size_t length = 0;
+};
+
+// The sections of a ~NJ file produced by bytecode::program::print_file.
+// Where possible, the file is mapped instead of read:
+// the text points straight into a read only mapping of the file
+// and the data is a private copy-on-write mapping, so no section is copied at load time.
+class image final {
+  public:
+    [[nodiscard]] static std::optional<image> load(const std::string & filename);
+
+    image(const image &) = delete;
+    image & operator=(const image &) = delete;
+
+    image(image &&) noexcept;
+    image & operator=(image &&) noexcept;
+
+    ~image() noexcept;
+
+    section<uint8_t> data{};
+    section<const uint64_t> text{};
+
+  private:
+    image() = default;
+
+    struct mapping {
+        void * address = nullptr;
+        size_t length = 0;
+    };
+
+    void release() noexcept;
+
+    mapping file_map{};
+    mapping data_map{};
+
+    // Used when the file cannot be mapped
+    std::vector<uint8_t> data_copy{};
+    std::vector<uint64_t> text_copy{};
+};
+
+} // namespace vm
+
+#endif // NEW_J_COMPILER_IMAGE_H
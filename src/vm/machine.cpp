@@ -0,0 +1,616 @@
+//
+// Created by nick on 10/17/26.
+//
+
+#include "machine.h"
+
+#include "bytecode.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+
+namespace vm {
+
+namespace {
+constexpr uint64_t reg_mask = (1u << bytecode::reg_width) - 1;
+constexpr uint64_t jump_mask = ~(~0ul << bytecode::opcode_offset);
+
+constexpr uint16_t opcode_of(uint64_t raw) { return raw >> bytecode::opcode_offset; }
+constexpr uint8_t register_of(uint64_t raw, uint8_t offset) { return (raw >> offset) & reg_mask; }
+constexpr uint64_t unsigned_imm_of(uint64_t raw) {
+    return static_cast<uint32_t>(raw >> bytecode::imm_offset);
+}
+constexpr int64_t signed_imm_of(uint64_t raw) {
+    return static_cast<int32_t>(raw >> bytecode::imm_offset);
+}
+} // namespace
+
+static_assert(machine::opcode_count == 1u << (64u - bytecode::opcode_offset));
+
+machine::machine(image && program)
+    : program{std::move(program)}, stack(stack_size), pc{bytecode::pc_start} {
+    registers[bytecode::stack_pointer] = stack_top;
+    registers[bytecode::frame_pointer] = stack_top;
+    interpret(true);
+}
+
+uint64_t machine::address_of(const decoded_inst * inst) const noexcept {
+    return bytecode::pc_start + (inst - code.data()) * sizeof(uint64_t);
+}
+
+uint8_t * machine::address(uint64_t addr, size_t size) noexcept {
+    if (addr >= bytecode::data_start and addr - bytecode::data_start + size <= program.data.size())
+        return program.data.data() + (addr - bytecode::data_start);
+    else if (constexpr auto stack_bottom = stack_top - stack_size;
+             addr >= stack_bottom and addr + size <= stack_top)
+        return stack.data() + (addr - stack_bottom);
+    else
+        return nullptr;
+}
+
+// Narrow loads are zero extended
+template <typename T> bool machine::load(uint64_t addr, uint64_t & dest) noexcept {
+    const auto * src = address(addr, sizeof(T));
+    if (src == nullptr) return false;
+
+    T value;
+    std::memcpy(&value, src, sizeof(T));
+    dest = value;
+    return true;
+}
+
+template <typename T> bool machine::store(uint64_t addr, uint64_t value) noexcept {
+    auto * dest = address(addr, sizeof(T));
+    if (dest == nullptr) return false;
+
+    const auto narrowed = static_cast<T>(value);
+    std::memcpy(dest, &narrowed, sizeof(T));
+    return true;
+}
+
+bool machine::syscall(uint64_t code, uint64_t arg) {
+    switch (code) {
+    case 0: // exit
+        exit_code = static_cast<int>(arg);
+        return true;
+    case 1: // print int32
+        std::cout << static_cast<int32_t>(arg) << '\n';
+        return false;
+    case 4: { // print string
+        size_t length = 0;
+        while (const auto * chr = address(arg + length, 1)) {
+            if (*chr == '\0') break;
+            length++;
+        }
+        if (length != 0) std::cout.write(reinterpret_cast<const char *>(address(arg, 1)), length);
+        std::cout << '\n';
+    }
+        return false;
+    case 5: // print int64
+        std::cout << static_cast<int64_t>(arg) << '\n';
+        return false;
+    default:
+        std::cerr << "Unknown syscall " << code << " at " << std::hex << std::showbase << pc
+                  << std::dec << '\n';
+        exit_code = 1;
+        return true;
+    }
+}
+
+int machine::run_raw() {
+    using bytecode::opcode;
+
+    auto & reg = registers;
+    const auto & text = program.text;
+    uint64_t raw = 0;
+
+#define RA register_of(raw, bytecode::r0_offset)
+#define RB register_of(raw, bytecode::r1_offset)
+#define RC register_of(raw, bytecode::r2_offset)
+
+    // r0 always reads as 0, so any write to it is thrown away before the next instruction
+#define FETCH()                                                                                    \
+    do {                                                                                           \
+        if ((pc & 7u) != 0 or (pc - bytecode::pc_start) >> 3u >= text.size()) goto bad_pc;         \
+        raw = text[(pc - bytecode::pc_start) >> 3u];                                               \
+        reg[0] = 0;                                                                                \
+        executed++;                                                                                \
+    } while (false)
+
+#define LOAD(type)                                                                                 \
+    if (not load<type>(reg[RB] + signed_imm_of(raw), reg[RA])) goto bad_access;                    \
+    pc += 8;                                                                                       \
+    DISPATCH();
+
+#define STORE(type)                                                                                \
+    if (not store<type>(reg[RB] + signed_imm_of(raw), reg[RA])) goto bad_access;                   \
+    pc += 8;                                                                                       \
+    DISPATCH();
+
+#ifdef NJ_THREADED_DISPATCH
+    std::array<void *, opcode_count> dispatch_table;
+    dispatch_table.fill(&&illegal);
+#define VM_CASE(name)                                                                              \
+    dispatch_table[static_cast<uint16_t>(opcode::name)] = &&op_##name;                             \
+    if (false) op_##name:
+
+    // The table is filled the first time through the cases below, so nothing may run yet.
+#define DISPATCH()                                                                                 \
+    do {                                                                                           \
+        FETCH();                                                                                   \
+        goto * dispatch_table[opcode_of(raw)];                                                     \
+    } while (false)
+#else
+#define VM_CASE(name) case opcode::name:
+#define DISPATCH() continue
+
+    while (true) {
+        FETCH();
+        switch (static_cast<opcode>(opcode_of(raw))) {
+#endif
+
+    VM_CASE(syscall) {
+        if (syscall(reg[RA], reg[RB])) return exit_code;
+        pc += 8;
+        DISPATCH();
+    }
+    VM_CASE(add) {
+        reg[RA] = reg[RB] + reg[RC];
+        pc += 8;
+        DISPATCH();
+    }
+    VM_CASE(sub) {
+        reg[RA] = reg[RB] - reg[RC];
+        pc += 8;
+        DISPATCH();
+    }
+    VM_CASE(or_) {
+        reg[RA] = reg[RB] | reg[RC];
+        pc += 8;
+        DISPATCH();
+    }
+    VM_CASE(ori) {
+        reg[RA] = reg[RB] | unsigned_imm_of(raw);
+        pc += 8;
+        DISPATCH();
+    }
+    VM_CASE(sl) {
+        reg[RA] = reg[RB] << (reg[RC] & 63u);
+        pc += 8;
+        DISPATCH();
+    }
+    VM_CASE(sr) {
+        reg[RA] = static_cast<int64_t>(reg[RB]) >> (reg[RC] & 63u);
+        pc += 8;
+        DISPATCH();
+    }
+    VM_CASE(lui) {
+        reg[RA] = unsigned_imm_of(raw) << 32u;
+        pc += 8;
+        DISPATCH();
+    }
+    VM_CASE(sli) {
+        reg[RA] = reg[RB] << (unsigned_imm_of(raw) & 63u);
+        pc += 8;
+        DISPATCH();
+    }
+    VM_CASE(sri) {
+        reg[RA] = static_cast<int64_t>(reg[RB]) >> (unsigned_imm_of(raw) & 63u);
+        pc += 8;
+        DISPATCH();
+    }
+    VM_CASE(slt) {
+        reg[RA] = static_cast<int64_t>(reg[RB]) < static_cast<int64_t>(reg[RC]);
+        pc += 8;
+        DISPATCH();
+    }
+    VM_CASE(slti) {
+        reg[RA] = static_cast<int64_t>(reg[RB]) < signed_imm_of(raw);
+        pc += 8;
+        DISPATCH();
+    }
+    VM_CASE(addi) {
+        reg[RA] = reg[RB] + signed_imm_of(raw);
+        pc += 8;
+        DISPATCH();
+    }
+    VM_CASE(mul) {
+        reg[RA] = reg[RB] * reg[RC];
+        pc += 8;
+        DISPATCH();
+    }
+    VM_CASE(jmp) {
+        pc = (raw & jump_mask) << 3u;
+        DISPATCH();
+    }
+    VM_CASE(jal) {
+        reg[bytecode::return_address] = pc + 8;
+        pc = (raw & jump_mask) << 3u;
+        DISPATCH();
+    }
+    VM_CASE(jeq) {
+        pc += 8;
+        if (reg[RA] == reg[RB]) pc += signed_imm_of(raw) * 8;
+        DISPATCH();
+    }
+    VM_CASE(jne) {
+        pc += 8;
+        if (reg[RA] != reg[RB]) pc += signed_imm_of(raw) * 8;
+        DISPATCH();
+    }
+    VM_CASE(jr) {
+        pc = reg[RA];
+        DISPATCH();
+    }
+    VM_CASE(lw) { LOAD(uint16_t) }
+    VM_CASE(sw) { STORE(uint16_t) }
+    VM_CASE(ldw) { LOAD(uint32_t) }
+    VM_CASE(sdw) { STORE(uint32_t) }
+    VM_CASE(lqw) { LOAD(uint64_t) }
+    VM_CASE(sqw) { STORE(uint64_t) }
+    VM_CASE(lb) { LOAD(uint8_t) }
+    VM_CASE(sb) { STORE(uint8_t) }
+
+#ifdef NJ_THREADED_DISPATCH
+    // Every case has registered itself, so start executing
+    DISPATCH();
+#else
+        default:
+            goto illegal;
+        }
+    }
+#endif
+
+illegal:
+    std::cerr << "Illegal opcode " << opcode_of(raw) << " at " << std::hex << std::showbase << pc
+              << std::dec << '\n';
+    return 1;
+
+bad_pc:
+    std::cerr << "Program counter " << std::hex << std::showbase << pc << std::dec
+              << " is outside of the text section\n";
+    return 1;
+
+bad_access:
+    std::cerr << "Invalid memory access at " << std::hex << std::showbase << pc << std::dec
+              << '\n';
+    return 1;
+
+#undef RA
+#undef RB
+#undef RC
+#undef FETCH
+#undef LOAD
+#undef STORE
+#undef VM_CASE
+#undef DISPATCH
+}
+
+void machine::translate(const std::array<handler_t, opcode_count> & handlers, handler_t bad_pc) {
+    using bytecode::opcode;
+
+    const auto & text = program.text;
+
+    // Anything that leaves the text section goes to an extra instruction after it, which holds
+    // the address it was going to, so errors name the same address as without translation.
+    // The first one catches running off the end of the text, and every jump that leaves the
+    // text gets its own. Room for all of them is reserved, so the text never moves.
+    const auto jumps = std::count_if(text.begin(), text.end(), [](uint64_t raw) {
+        switch (static_cast<opcode>(opcode_of(raw))) {
+        case opcode::jmp:
+        case opcode::jal:
+        case opcode::jeq:
+        case opcode::jne:
+            return true;
+        default:
+            return false;
+        }
+    });
+    code.clear();
+    code.reserve(text.size() + 1 + jumps);
+    code.resize(text.size());
+
+    const auto leave_text = [this, bad_pc](uint64_t address) -> const decoded_inst * {
+        auto & exit = code.emplace_back();
+        exit.handler = bad_pc;
+        exit.imm = static_cast<int64_t>(address);
+        return &exit;
+    };
+    leave_text(bytecode::pc_start + text.size() * sizeof(uint64_t));
+
+    const auto instruction_at = [this, &text, &leave_text](uint64_t address) {
+        if (const auto index = (address - bytecode::pc_start) / sizeof(uint64_t);
+            address % sizeof(uint64_t) == 0 and index < text.size())
+            return static_cast<const decoded_inst *>(&code[index]);
+        else
+            return leave_text(address);
+    };
+
+    for (size_t i = 0; i < text.size(); i++) {
+        const auto raw = text[i];
+        auto & inst = code[i];
+
+        inst.handler = handlers[opcode_of(raw)];
+        inst.regs = {register_of(raw, bytecode::r0_offset), register_of(raw, bytecode::r1_offset),
+                     register_of(raw, bytecode::r2_offset)};
+
+        switch (static_cast<opcode>(opcode_of(raw))) {
+        case opcode::jmp:
+        case opcode::jal:
+            inst.target = instruction_at((raw & jump_mask) << 3u);
+            break;
+        case opcode::jeq:
+        case opcode::jne:
+            inst.target = instruction_at(bytecode::pc_start + (i + 1) * sizeof(uint64_t)
+                                         + signed_imm_of(raw) * sizeof(uint64_t));
+            break;
+        case opcode::ori:
+            inst.imm = unsigned_imm_of(raw);
+            break;
+        case opcode::lui:
+            inst.imm = unsigned_imm_of(raw) << 32u;
+            break;
+        case opcode::sli:
+        case opcode::sri:
+            inst.imm = unsigned_imm_of(raw) & 63u;
+            break;
+        default:
+            inst.imm = signed_imm_of(raw);
+            break;
+        }
+
+        switch (static_cast<opcode>(opcode_of(raw))) {
+        case opcode::syscall:
+        case opcode::jmp:
+        case opcode::jal:
+        case opcode::jeq:
+        case opcode::jne:
+        case opcode::jr:
+        case opcode::sw:
+        case opcode::sdw:
+        case opcode::sqw:
+        case opcode::sb:
+            // The first register is only read
+            break;
+        default:
+            if (inst.regs[0] == 0) inst.regs[0] = sink_register;
+        }
+    }
+}
+
+int machine::run() { return interpret(false); }
+
+int machine::interpret(bool translate_only) {
+    using bytecode::opcode;
+
+    std::array<handler_t, opcode_count> handlers;
+
+#ifdef NJ_THREADED_DISPATCH
+#define VM_HANDLER(name) &&op_##name
+#define VM_CASE(name) op_##name:
+
+    handlers.fill(&&illegal);
+    const handler_t off_text_handler = &&off_text;
+#else
+#define VM_HANDLER(name) static_cast<handler_t>(opcode::name)
+#define VM_CASE(name) case static_cast<handler_t>(opcode::name):
+
+    constexpr handler_t illegal_handler = opcode_count;
+    constexpr handler_t off_text_handler = opcode_count + 1;
+    handlers.fill(illegal_handler);
+#endif
+
+#define VM_REGISTER(name) handlers[static_cast<uint16_t>(opcode::name)] = VM_HANDLER(name)
+    VM_REGISTER(syscall);
+    VM_REGISTER(add);
+    VM_REGISTER(sub);
+    VM_REGISTER(or_);
+    VM_REGISTER(ori);
+    VM_REGISTER(sl);
+    VM_REGISTER(sr);
+    VM_REGISTER(lui);
+    VM_REGISTER(sli);
+    VM_REGISTER(sri);
+    VM_REGISTER(slt);
+    VM_REGISTER(slti);
+    VM_REGISTER(addi);
+    VM_REGISTER(mul);
+    VM_REGISTER(jmp);
+    VM_REGISTER(jal);
+    VM_REGISTER(jeq);
+    VM_REGISTER(jne);
+    VM_REGISTER(jr);
+    VM_REGISTER(lw);
+    VM_REGISTER(sw);
+    VM_REGISTER(ldw);
+    VM_REGISTER(sdw);
+    VM_REGISTER(lqw);
+    VM_REGISTER(sqw);
+    VM_REGISTER(lb);
+    VM_REGISTER(sb);
+#undef VM_REGISTER
+
+    if (translate_only) {
+        translate(handlers, off_text_handler);
+        return 0;
+    }
+
+    auto & reg = registers;
+    const decoded_inst * ip = code.data();
+
+#define RA ip->regs[0]
+#define RB ip->regs[1]
+#define RC ip->regs[2]
+
+#define LOAD(type)                                                                                 \
+    if (not load<type>(reg[RB] + ip->imm, reg[RA])) goto bad_access;                               \
+    ip++;                                                                                          \
+    DISPATCH();
+
+#define STORE(type)                                                                                \
+    if (not store<type>(reg[RB] + ip->imm, reg[RA])) goto bad_access;                              \
+    ip++;                                                                                          \
+    DISPATCH();
+
+#ifdef NJ_THREADED_DISPATCH
+#define DISPATCH()                                                                                 \
+    do {                                                                                           \
+        executed++;                                                                                \
+        goto * ip->handler;                                                                        \
+    } while (false)
+
+    DISPATCH();
+#else
+#define DISPATCH() continue
+
+    while (true) {
+        executed++;
+        switch (ip->handler) {
+#endif
+
+    VM_CASE(syscall) {
+        pc = address_of(ip);
+        if (syscall(reg[RA], reg[RB])) return exit_code;
+        ip++;
+        DISPATCH();
+    }
+    VM_CASE(add) {
+        reg[RA] = reg[RB] + reg[RC];
+        ip++;
+        DISPATCH();
+    }
+    VM_CASE(sub) {
+        reg[RA] = reg[RB] - reg[RC];
+        ip++;
+        DISPATCH();
+    }
+    VM_CASE(or_) {
+        reg[RA] = reg[RB] | reg[RC];
+        ip++;
+        DISPATCH();
+    }
+    VM_CASE(ori) {
+        reg[RA] = reg[RB] | ip->imm;
+        ip++;
+        DISPATCH();
+    }
+    VM_CASE(sl) {
+        reg[RA] = reg[RB] << (reg[RC] & 63u);
+        ip++;
+        DISPATCH();
+    }
+    VM_CASE(sr) {
+        reg[RA] = static_cast<int64_t>(reg[RB]) >> (reg[RC] & 63u);
+        ip++;
+        DISPATCH();
+    }
+    VM_CASE(lui) {
+        reg[RA] = ip->imm;
+        ip++;
+        DISPATCH();
+    }
+    VM_CASE(sli) {
+        reg[RA] = reg[RB] << ip->imm;
+        ip++;
+        DISPATCH();
+    }
+    VM_CASE(sri) {
+        reg[RA] = static_cast<int64_t>(reg[RB]) >> ip->imm;
+        ip++;
+        DISPATCH();
+    }
+    VM_CASE(slt) {
+        reg[RA] = static_cast<int64_t>(reg[RB]) < static_cast<int64_t>(reg[RC]);
+        ip++;
+        DISPATCH();
+    }
+    VM_CASE(slti) {
+        reg[RA] = static_cast<int64_t>(reg[RB]) < ip->imm;
+        ip++;
+        DISPATCH();
+    }
+    VM_CASE(addi) {
+        reg[RA] = reg[RB] + ip->imm;
+        ip++;
+        DISPATCH();
+    }
+    VM_CASE(mul) {
+        reg[RA] = reg[RB] * reg[RC];
+        ip++;
+        DISPATCH();
+    }
+    VM_CASE(jmp) {
+        ip = ip->target;
+        DISPATCH();
+    }
+    VM_CASE(jal) {
+        reg[bytecode::return_address] = address_of(ip + 1);
+        ip = ip->target;
+        DISPATCH();
+    }
+    VM_CASE(jeq) {
+        ip = reg[RA] == reg[RB] ? ip->target : ip + 1;
+        DISPATCH();
+    }
+    VM_CASE(jne) {
+        ip = reg[RA] != reg[RB] ? ip->target : ip + 1;
+        DISPATCH();
+    }
+    VM_CASE(jr) {
+        // The only jump whose destination is not known ahead of time
+        pc = reg[RA];
+        if (const auto index = (pc - bytecode::pc_start) / sizeof(uint64_t);
+            pc % sizeof(uint64_t) != 0 or index >= program.text.size())
+            goto bad_pc;
+        else
+            ip = &code[index];
+        DISPATCH();
+    }
+    VM_CASE(lw) { LOAD(uint16_t) }
+    VM_CASE(sw) { STORE(uint16_t) }
+    VM_CASE(ldw) { LOAD(uint32_t) }
+    VM_CASE(sdw) { STORE(uint32_t) }
+    VM_CASE(lqw) { LOAD(uint64_t) }
+    VM_CASE(sqw) { STORE(uint64_t) }
+    VM_CASE(lb) { LOAD(uint8_t) }
+    VM_CASE(sb) { STORE(uint8_t) }
+
+#ifndef NJ_THREADED_DISPATCH
+        case off_text_handler:
+            goto off_text;
+        default:
+            goto illegal;
+        }
+    }
+#endif
+
+illegal:
+    std::cerr << "Illegal opcode " << opcode_of(program.text[ip - code.data()]) << " at "
+              << std::hex << std::showbase << address_of(ip) << std::dec << '\n';
+    return 1;
+
+off_text:
+    pc = static_cast<uint64_t>(ip->imm);
+bad_pc:
+    std::cerr << "Program counter " << std::hex << std::showbase << pc << std::dec
+              << " is outside of the text section\n";
+    return 1;
+
+bad_access:
+    std::cerr << "Invalid memory access at " << std::hex << std::showbase << address_of(ip)
+              << std::dec << '\n';
+    return 1;
+
+#undef RA
+#undef RB
+#undef RC
+#undef LOAD
+#undef STORE
+#undef VM_HANDLER
+#undef VM_CASE
+#undef DISPATCH
+}
+
+} // namespace vm
@@ -0,0 +1,93 @@
+//
+// Created by nick on 10/17/26.
+//
+
+#ifndef NEW_J_COMPILER_MACHINE_H
+#define NEW_J_COMPILER_MACHINE_H
+
+#include "image.h"
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+// Computed gotos are a GNU extension. Everything else gets a switch in a loop.
+#if defined(__GNUC__) or defined(__clang__)
+#define NJ_THREADED_DISPATCH
+#endif
+
+namespace vm {
+
+// The stack sits directly below the text section and grows down
+static constexpr uint64_t stack_top = 0x80000000;
+static constexpr uint64_t stack_size = 1u << 20u;
+
+class machine final {
+  public:
+    // The opcode field of raw_form is 10 bits wide
+    static constexpr size_t opcode_count = 1024;
+
+    explicit machine(image && program);
+
+    // Executes the pre-decoded text from pc_start until the program halts or faults.
+    // Returns the exit status of the program.
+    int run();
+
+    // Same as run, but decodes each raw instruction as it is executed.
+    // Kept as the baseline for measuring dispatch cost.
+    int run_raw();
+
+    [[nodiscard]] uint64_t instructions_executed() const noexcept { return executed; }
+
+  private:
+#ifdef NJ_THREADED_DISPATCH
+    using handler_t = const void *;
+#else
+    using handler_t = uint16_t;
+#endif
+
+    // One instruction of the text after translation.
+    // Every field is ready to use, so executing it needs no decoding.
+    struct decoded_inst {
+        handler_t handler;
+        union {
+            // Sign or zero extended as the opcode requires
+            int64_t imm;
+            // Jumps and branches point straight at their destination
+            const decoded_inst * target;
+        };
+        std::array<uint8_t, 3> regs;
+    };
+
+    // Writes to r0 are redirected here so that r0 never has to be reset
+    static constexpr uint8_t sink_register = 64;
+
+    // Runs the decoded text. If translate_only is set, the text is translated instead,
+    // as only this function knows where its handlers are.
+    int interpret(bool translate_only);
+    void translate(const std::array<handler_t, opcode_count> & handlers, handler_t bad_pc);
+
+    [[nodiscard]] uint64_t address_of(const decoded_inst * inst) const noexcept;
+
+    // Translates a vm address into host memory.
+    // Returns nullptr if [addr, addr + size) is not mapped.
+    [[nodiscard]] uint8_t * address(uint64_t addr, size_t size) noexcept;
+
+    template <typename T> bool load(uint64_t addr, uint64_t & dest) noexcept;
+    template <typename T> bool store(uint64_t addr, uint64_t value) noexcept;
+
+    // Returns true if the program asked to exit
+    bool syscall(uint64_t code, uint64_t arg);
+
+    image program;
+    std::vector<decoded_inst> code{};
+    std::vector<uint8_t> stack;
+    std::array<uint64_t, sink_register + 1> registers{};
+    uint64_t pc;
+    uint64_t executed = 0;
+    int exit_code = 0;
+};
+
+} // namespace vm
+
+#endif // NEW_J_COMPILER_MACHINE_H
@@ -0,0 +1,70 @@
+//
+// Created by nick on 10/17/26.
+//
+
+#include "image.h"
+#include "machine.h"
+
+#include <chrono>
+#include <iostream>
+#include <string>
+
+int main(const int arg_count, const char ** args) {
+
+    std::string input_filename;
+    bool print_stats = false;
+    bool predecode = true;
+
+    for (auto i = 1; i < arg_count; i++) {
+        if (std::string arg{args[i]}; arg == "--help" or arg == "-h") {
+            std::cout << args[0] << '\n'
+                      << "A virtual machine for New-J bytecode\n"
+                         "Options: [-h|--help|-v|--version] [-fstats] [-fno-predecode] "
+                         "<input filename>\n"
+                         "\t-h or --help -> print this help message and exit\n"
+                         "\t-v or --version -> print version number and exit\n"
+                         "\t-fstats -> print the instruction count and run time to stderr\n"
+                         "\t-fno-predecode -> decode each instruction as it is executed\n"
+                         "\tinput filename -> the .bin file to execute"
+                      << std::endl;
+            return 0;
+        } else if (arg == "-v" or arg == "--version") {
+            std::cout << args[0] << '\n' << "Version 0.1" << std::endl;
+            return 0;
+        } else if (arg == "-fstats") {
+            print_stats = true;
+        } else if (arg == "-fpredecode" or arg == "-fno-predecode") {
+            predecode = arg == "-fpredecode";
+        } else if (arg.front() != '-') {
+            input_filename = arg;
+        } else {
+            std::cout << "Unrecognized option: " << arg << std::endl;
+        }
+    }
+
+    if (input_filename.empty()) {
+        std::cerr << "No input file given" << std::endl;
+        return 1;
+    }
+
+    auto program = vm::image::load(input_filename);
+    if (not program.has_value()) return 1;
+
+    vm::machine machine{std::move(program.value())};
+
+    const auto start = std::chrono::steady_clock::now();
+    const auto exit_code = predecode ? machine.run() : machine.run_raw();
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+
+    if (print_stats) {
+        using namespace std::chrono;
+        const auto nanos = duration_cast<nanoseconds>(elapsed).count();
+        const auto count = machine.instructions_executed();
+        std::cout.flush();
+        std::cerr << "Executed " << count << " instructions in " << nanos / 1e6 << " ms ("
+                  << (count == 0 ? 0.0 : static_cast<double>(nanos) / count)
+                  << " ns/instruction)" << std::endl;
+    }
+
+    return exit_code;
+}
@@ -0,0 +1,238 @@
+//
+// Created by nick on 10/17/26.
+//
+
+#include "watch.h"
+
+#include "ast/diagnostics.h"
+#include "ast/lexer.h"
+#include "ast/nodes.h"
+#include "ast/parser.h"
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <optional>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
+#if __has_include(<sys/inotify.h>)
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace {
+// Garbage from replaced items piles up in the arenas, so once there are this many
+// the next build starts over
+constexpr size_t max_arenas = 32;
+
+uint64_t hash_text(std::string_view text) { return std::hash<std::string_view>{}(text); }
+uint64_t combine(uint64_t seed, uint64_t value) {
+    return seed ^ (value + 0x9e3779b97f4a7c15ul + (seed << 6u) + (seed >> 2u));
+}
+
+// What other items see of an item: the whole of a constant or struct,
+// but only the signature of a function
+uint64_t interface_of(const ast::top_level & item) {
+    if (item.type() != ast::node_type::function) return hash_text(item.text());
+
+    const auto & func = static_cast<const ast::function &>(item);
+    if (func.body == nullptr) return hash_text(text_of(func.identifier()));
+
+    const auto start = func.start_pos();
+    return hash_text(source_manager::global().text(func.src(), start,
+                                                   func.body->start_pos() - start));
+}
+} // namespace
+
+incremental_build::incremental_build(std::string input_filename)
+    : input{std::move(input_filename)}, output{bytecode::output_filename(input)} {}
+
+void incremental_build::reset() {
+    release_versions({});
+    tree = std::make_unique<ast::program>();
+    items_by_text.clear();
+    interface = 0;
+    ir_gen = ir_gen_visitor{};
+    functions.clear();
+}
+
+void incremental_build::release_versions(std::vector<file_id> in_use) {
+    std::sort(in_use.begin(), in_use.end());
+    in_use.erase(std::unique(in_use.begin(), in_use.end()), in_use.end());
+
+    for (const auto file : versions)
+        if (not std::binary_search(in_use.begin(), in_use.end(), file))
+            source_manager::global().release(file);
+    versions = std::move(in_use);
+}
+
+bool incremental_build::run() {
+    const auto start = std::chrono::steady_clock::now();
+    const auto errors_before = diagnostics::global().error_count();
+
+    auto full = tree == nullptr or tree->arena_count() > max_arenas;
+    if (full) reset();
+
+    auto text = source_buffer::read(input);
+    if (text == nullptr) {
+        diag::error() << "Could not open " << input;
+        text = source_buffer::from_string({});
+    }
+    const auto file = source_manager::global().add(input, std::move(text));
+
+    parser whole{lexer{file}};
+    const auto & tokens = *whole.token_list();
+    // Changed items are parsed into a new arena, which is only made when one is needed
+    std::optional<parser> changed;
+
+    std::unordered_map<std::string_view, ast::top_level *> next_by_text;
+    std::vector<ast::ptr<ast::top_level>> items;
+    std::unordered_set<const ast::top_level *> parsed;
+    for (const auto slice : whole.split_top_level()) {
+        // Separators after the item do not change it
+        auto last = slice.last;
+        while (last > slice.first + 1) {
+            const auto type = tokens.type(last - 1);
+            if (type != token_type::Newline and type != token_type::Semi
+                and type != token_type::Comma)
+                break;
+            last--;
+        }
+        const auto start_pos = tokens.at(slice.first).start();
+        const auto text = source_manager::global().text(tokens.src(), start_pos,
+                                                        tokens.at(last - 1).end() - start_pos);
+
+        if (auto iter = items_by_text.find(text); iter != items_by_text.end()) {
+            next_by_text.insert(*iter);
+            items.emplace_back(iter->second);
+            continue;
+        }
+
+        if (not changed.has_value())
+            changed.emplace(whole.token_list(), ast::tree_builder{tree->add_arena()});
+        auto slice_items = changed->parse_slice(slice);
+        // Splitting goes by keywords, so a slice with a syntax error can hold more than one
+        if (slice_items.size() == 1) next_by_text.emplace(text, slice_items.front().get());
+        for (auto & item : slice_items) {
+            parsed.insert(item.get());
+            items.push_back(std::move(item));
+        }
+    }
+
+    std::vector<file_id> in_use{file};
+    tree->clear_items();
+    uint64_t next_interface = 0;
+    for (auto & item : items) {
+        in_use.push_back(item->src());
+        next_interface = combine(next_interface, interface_of(*item));
+        if (const auto name = item->identifier(); not tree->add_item(std::move(item)))
+            diag::error() << "Top Level Item " << name << " already exists";
+    }
+    diagnostics::global().flush();
+
+    items_by_text = std::move(next_by_text);
+    full = full or next_interface != interface;
+    interface = next_interface;
+
+    if (full) {
+        ir_gen = ir_gen_visitor{};
+        functions.clear();
+        tree->visit([this](auto & item) { ir_gen.visit(item); });
+    } else {
+        tree->visit([this, &parsed](auto & item) {
+            if (parsed.count(&item) == 0) return;
+
+            // Only functions can change without changing the interface
+            ir_gen.forget_function(item.identifier());
+            functions.erase(item.identifier());
+            ir_gen.visit(item);
+        });
+    }
+    diagnostics::global().flush();
+
+    // main goes first, like in bytecode::program::from_ir
+    size_t generated = 0;
+    std::vector<const bytecode::program *> linked;
+    tree->visit([&](const ast::top_level & item) {
+        if (item.type() != ast::node_type::function) return;
+
+        auto iter = functions.find(item.identifier());
+        if (iter == functions.end()) {
+            const auto * func = ir_gen.program().lookup_function(item.identifier());
+            if (func == nullptr) return;
+
+            iter = functions.emplace(item.identifier(), bytecode::program::from_function(*func))
+                       .first;
+            generated++;
+        }
+
+        if (text_of(item.identifier()) == "main") linked.insert(linked.begin(), &iter->second);
+        else
+            linked.push_back(&iter->second);
+    });
+
+    if (tree->find(intern("main")) == nullptr) diag::error() << "Bytecode generation failed.";
+    else
+        bytecode::program::link(linked).print_file(output);
+    diagnostics::global().flush();
+    release_versions(std::move(in_use));
+
+    const std::chrono::duration<double, std::milli> elapsed
+        = std::chrono::steady_clock::now() - start;
+    if (diagnostics::global().current_verbosity() != verbosity::quiet)
+        std::cout << "Built " << output << " in " << elapsed.count() << " ms, parsed "
+                  << parsed.size() << " of " << items.size() << " items and generated "
+                  << generated << " of " << linked.size() << " functions" << std::endl;
+
+    return diagnostics::global().error_count() == errors_before;
+}
+
+int watch(const user_settings & settings) {
+    if (settings.input_filename == "-") {
+        diag::error() << "--watch needs an input file";
+        return 1;
+    }
+
+#if __has_include(<sys/inotify.h>)
+    const auto & input = settings.input_filename;
+    // Editors often write a new file and move it over the old one, so the directory is watched
+    const auto slash = input.find_last_of('/');
+    const auto directory = slash == std::string::npos ? std::string{"."}
+                                                      : input.substr(0, std::max<size_t>(slash, 1));
+    const auto name = input.substr(slash == std::string::npos ? 0 : slash + 1);
+
+    const auto watcher = inotify_init1(IN_CLOEXEC);
+    if (watcher < 0
+        or inotify_add_watch(watcher, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+        diag::error() << "Cannot watch " << directory;
+        return 1;
+    }
+
+    incremental_build build{input};
+    build.run();
+
+    alignas(inotify_event) char events[4096];
+    while (true) {
+        const auto length = read(watcher, events, sizeof(events));
+        if (length <= 0) break;
+
+        auto changed = false;
+        for (auto offset = 0l; offset < length;) {
+            const auto * event = reinterpret_cast<const inotify_event *>(events + offset);
+            if (event->len != 0 and name == event->name) changed = true;
+            offset += sizeof(inotify_event) + event->len;
+        }
+        if (changed) build.run();
+    }
+
+    close(watcher);
+    diag::error() << "Stopped watching " << input;
+    return 1;
+#else
+    diag::error() << "--watch needs inotify, which this platform does not have";
+    return 1;
+#endif
+}
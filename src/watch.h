@@ -0,0 +1,60 @@
+//
+// Created by nick on 10/17/26.
+//
+
+#ifndef NEW_J_COMPILER_WATCH_H
+#define NEW_J_COMPILER_WATCH_H
+
+#include "ast/program.h"
+#include "bytecode.h"
+#include "config.h"
+#include "visitor.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Compiles the same file again and again, keeping the syntax tree, IR and bytecode
+// of every top level item whose text did not change since the last build.
+//
+// A function only depends on the signatures of the items before it and on the constants,
+// so as long as none of those change, only the functions whose text changed are generated
+// again. Otherwise all of the IR and bytecode is, while the syntax tree is still reused.
+class incremental_build final {
+  public:
+    explicit incremental_build(std::string input_filename);
+
+    // Returns false if there were errors
+    bool run();
+
+  private:
+    // Drops everything kept from earlier builds
+    void reset();
+    // Frees the text of every version of the input that is not in use
+    void release_versions(std::vector<file_id> in_use);
+
+    std::string input;
+    std::string output;
+
+    // Owns the nodes of every item, including those of earlier builds
+    std::unique_ptr<ast::program> tree{};
+    // Every version of the input is read into memory, so the items kept from it keep their
+    // text when the file is written again. These are the versions the items come from.
+    std::vector<file_id> versions{};
+    // Keyed by the text of the item, which stays in memory as long as the item is kept
+    std::unordered_map<std::string_view, ast::top_level *> items_by_text{};
+    // A hash of the constants, structs and function signatures, in order
+    uint64_t interface = 0;
+
+    ir_gen_visitor ir_gen{};
+    std::unordered_map<symbol, bytecode::program> functions{};
+};
+
+// Builds the input, then builds it again every time the file is written.
+// Only returns if watching the file fails.
+int watch(const user_settings & settings);
+
+#endif // NEW_J_COMPILER_WATCH_H
@@ -0,0 +1,31 @@
+#!/bin/sh
+
+# Compiles a call with more arguments than fit in one chunk of the IR operand arena, followed
+# by short calls that are placed after it. The wide function is rejected by bytecode
+# generation, so the compile must end with that error rather than a crash.
+# Usage: tests/long_call.sh <new_jc>
+
+compiler=$1
+work_dir=$(mktemp -d)
+trap 'rm -rf "$work_dir"' EXIT
+
+awk 'BEGIN {
+    printf "func wide("
+    for (i = 0; i < 300; i++) printf "%sa%d : int32", (i ? ", " : ""), i
+    print ") : int64 {\n    ret a0 + a299\n}"
+    print "func four(a : int32, b : int32, c : int32, d : int32) : int64 {"
+    print "    ret a + b + c + d\n}"
+    printf "func main {\n    print(wide("
+    for (i = 0; i < 300; i++) printf "%s%d", (i ? ", " : ""), i
+    print "))"
+    for (k = 0; k < 8; k++) print "    print(four(1, 2, 3, 4))"
+    print "}"
+}' > "$work_dir/long_call.nj"
+
+"$compiler" -q "$work_dir/long_call.nj" > "$work_dir/out.txt" 2>&1
+status=$?
+if [ "$status" -ne 1 ] || ! grep -q "300 parameter functions" "$work_dir/out.txt"; then
+    cat "$work_dir/out.txt" >&2
+    echo "Compiling a call with 300 arguments ended with status $status" >&2
+    exit 1
+fi
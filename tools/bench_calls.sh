@@ -0,0 +1,34 @@
+#!/bin/sh
+
+# Measures how compile time grows with the number of functions when every function calls
+# several others, which is bound by finding the callee of each call among all functions.
+# Usage: tools/bench_calls.sh [build directory] [largest function count]
+# The build directory should be configured with -DCMAKE_BUILD_TYPE=Release
+
+build_dir=${1:-build}
+largest=${2:-100000}
+work_dir=$(mktemp -d)
+trap 'rm -rf "$work_dir"' EXIT
+
+count=1000
+while [ "$count" -le "$largest" ]; do
+    # Each function calls four functions declared before it, spread over the whole program
+    awk -v count="$count" 'BEGIN {
+        print "func f0(a : int32) : int64 {\n    ret a + 1\n}"
+        for (i = 1; i < count; i++) {
+            printf "func f%d(a : int32) : int64 {\n    ret a", i
+            for (k = 1; k <= 4; k++) printf " + f%d(a)", (i * 7919 + k * 104729) % i
+            printf "\n}\n"
+        }
+        printf "func main {\n    print(f%d(1))\n}\n", count - 1
+    }' > "$work_dir/calls.nj"
+
+    start=$(date +%s%N)
+    if ! "$build_dir/src/new_jc" -q "$work_dir/calls.nj" > /dev/null; then
+        echo "Compiling $count functions failed" >&2
+        exit 1
+    fi
+    end=$(date +%s%N)
+    printf '%-8s %d ms\n' "$count" "$(((end - start) / 1000000))"
+    count=$((count * 10))
+done
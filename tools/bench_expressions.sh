@@ -0,0 +1,43 @@
+#!/bin/sh
+
+# Measures how long it takes to parse a large generated program that is mostly long expressions,
+# once with every binary operator and once with only those the parser has always known,
+# so older builds can be compared on the second file.
+# Usage: tools/bench_expressions.sh [build directory] [line count]
+# The build directory should be configured with -DCMAKE_BUILD_TYPE=Release
+
+build_dir=${1:-build}
+lines=${2:-1000000}
+work_dir=$(mktemp -d)
+trap 'rm -rf "$work_dir"' EXIT
+
+# Each function is 10 lines, each expression mixes every precedence level and a call
+generate() {
+    awk -v count="$((lines / 10))" -v all="$1" 'BEGIN {
+        if (all) split("or | == < <= > >= << >> + - *", ops, " ")
+        else split("or == <= > + -", ops, " ")
+        op_count = length(ops)
+        for (i = 0; i < count; i++) {
+            printf "func expr%d(a : int32, b : int32) : int64 {\n", i
+            for (j = 0; j < 8; j++) {
+                printf "    a = b"
+                for (k = 0; k < 12; k++)
+                    printf " %s %s", ops[(i + j + k) % op_count + 1], k % 4 == 0 ? "f(a, b)" : "a"
+                printf "\n"
+            }
+            printf "}\n"
+        }
+    }' > "$2"
+}
+
+generate 1 "$work_dir/all.nj"
+generate 0 "$work_dir/old.nj"
+
+for file in all old; do
+    for mode in pointer flat; do
+        flag=
+        if [ "$mode" = flat ]; then flag=-fflat-ast; fi
+        printf '%-4s %-8s ' "$file" "$mode"
+        "$build_dir/src/new_jc" -fparse-only $flag "$work_dir/$file.nj" 2> /dev/null | tail -n 1
+    done
+done
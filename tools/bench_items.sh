@@ -0,0 +1,30 @@
+#!/bin/sh
+
+# Measures how parse time grows with the number of top level items,
+# which is bound by looking up each new name among the items before it.
+# Usage: tools/bench_items.sh [build directory] [largest item count]
+# The build directory should be configured with -DCMAKE_BUILD_TYPE=Release
+
+build_dir=${1:-build}
+largest=${2:-1000000}
+work_dir=$(mktemp -d)
+trap 'rm -rf "$work_dir"' EXIT
+
+count=1000
+while [ "$count" -le "$largest" ]; do
+    # Small items, so the lookups are a large share of the work
+    awk -v count="$count" 'BEGIN {
+        for (i = 0; i < count; i++) {
+            if (i % 2 == 0) printf "func item%d(n : int32) : int32 { ret n }\n", i
+            else printf "const item%d = %d\n", i, i
+        }
+    }' > "$work_dir/items.nj"
+
+    for mode in pointer flat; do
+        flag=
+        if [ "$mode" = flat ]; then flag=-fflat-ast; fi
+        printf '%-8s %-8s ' "$count" "$mode"
+        "$build_dir/src/new_jc" -fparse-only $flag "$work_dir/items.nj" 2> /dev/null | tail -n 1
+    done
+    count=$((count * 10))
+done
@@ -0,0 +1,37 @@
+#!/bin/sh
+
+# Measures the throughput of the lexer on large generated inputs.
+# Usage: tools/bench_lexer.sh [build directory] [function count]
+# The build directory should be configured with -DCMAKE_BUILD_TYPE=Release
+
+build_dir=${1:-build}
+count=${2:-100000}
+work_dir=$(mktemp -d)
+trap 'rm -rf "$work_dir"' EXIT
+
+# Identifier heavy: most words share a prefix with a keyword
+awk -v count="$count" 'BEGIN {
+    for (i = 0; i < count; i++) {
+        printf "func iffy%d(letter : int32, constant : int64) : int64 {\n", i
+        printf "    let returned%d = letter + constant - orbit + elsewhere\n", i
+        printf "    let whiley = funcs(returned%d, retry, iffy, int3, int640)\n", i
+        printf "    ret returned%d\n}\n", i
+    }
+}' > "$work_dir/identifiers.nj"
+
+# Machine generated style: deep indentation, long names and comments
+awk -v count="$count" 'BEGIN {
+    for (i = 0; i < count; i++) {
+        printf "# Generated from node %d of the input model. Do not edit this function by hand.\n", i
+        printf "func generatedAccumulatorForModelNode%d(inputValue : int64) : int64 {\n", i
+        printf "                let intermediateResultOfNode%d = inputValue + 1234567890\t\t# carry\n", i
+        printf "                ret intermediateResultOfNode%d\n}\n", i
+    }
+}' > "$work_dir/generated.nj"
+
+for input in identifiers generated; do
+    for mode in -fno-simd -fsimd; do
+        printf '%-12s %-10s ' "$input" "$mode"
+        "$build_dir/src/new_jc" -flex-only $mode "$work_dir/$input.nj" | tail -n 1
+    done
+done
@@ -0,0 +1,37 @@
+#!/bin/sh
+
+# Measures how long it takes to parse and then free a large generated program,
+# and how much memory that needs, once for each AST representation
+# and once more with the top level items parsed on several threads.
+# Usage: tools/bench_parser.sh [build directory] [line count] [thread count]
+# The build directory should be configured with -DCMAKE_BUILD_TYPE=Release
+
+build_dir=${1:-build}
+lines=${2:-1000000}
+threads=${3:-$(nproc)}
+work_dir=$(mktemp -d)
+trap 'rm -rf "$work_dir"' EXIT
+
+# Each function is 100 lines.
+# tools/bench_items.sh covers programs with many small items.
+awk -v count="$((lines / 100))" 'BEGIN {
+    for (i = 0; i < count; i++) {
+        printf "func step%d(n : int32, m : int32) : int64 {\n", i
+        printf "    let z = m - n + 1\n"
+        for (j = 0; j < 32; j++) {
+            printf "    while (n > %d or m == %d) {\n", j, i
+            printf "        n -= 1, m += n + z - 2\n"
+            printf "    }\n"
+        }
+        printf "    ret step%d(m + n - 1, z)\n", i
+        printf "}\n"
+    }
+}' > "$work_dir/program.nj"
+
+printf 'pointer AST: '
+"$build_dir/src/new_jc" -fparse-only "$work_dir/program.nj" 2> /dev/null | tail -n 1
+printf 'flat AST:    '
+"$build_dir/src/new_jc" -fparse-only -fflat-ast "$work_dir/program.nj" 2> /dev/null | tail -n 1
+printf 'threads (%s): ' "$threads"
+"$build_dir/src/new_jc" -fparse-only -fparse-threads="$threads" "$work_dir/program.nj" 2> /dev/null \
+    | tail -n 1
@@ -0,0 +1,39 @@
+#!/bin/sh
+
+# Measures the dispatch cost of new_jvm with and without pre-decoding.
+# Usage: tools/bench_vm.sh [build directory]
+# The build directory should be configured with -DCMAKE_BUILD_TYPE=Release
+
+build_dir=${1:-build}
+work_dir=$(mktemp -d)
+trap 'rm -rf "$work_dir"' EXIT
+
+cat > "$work_dir/loop.nj" << 'EOF'
+func main {
+    let x = 0
+    let n = 50000000
+    while (n > 0) {
+        x += n, n -= 1
+    }
+    print(x)
+}
+EOF
+
+cat > "$work_dir/calls.nj" << 'EOF'
+func fib(n : int32) : int64
+    if (n <= 1) {
+        ret n;
+    } else {
+        return fib(n - 1) + fib(n - 2)
+    }
+
+func main print(fib(30))
+EOF
+
+for program in loop calls; do
+    "$build_dir/src/new_jc" "$work_dir/$program.nj" > /dev/null 2>&1
+    for mode in -fno-predecode -fpredecode; do
+        printf '%-8s %-15s ' "$program" "$mode"
+        "$build_dir/src/new_jvm" -fstats $mode "$work_dir/$program.bin" 2>&1 > /dev/null
+    done
+done